@@ -1,4 +1,5 @@
 include(CMakeFindDependencyMacro)
 find_dependency(Vulkan)
+find_dependency(Threads)
 include("${CMAKE_CURRENT_LIST_DIR}/VuhTargets.cmake")
 include("${CMAKE_CURRENT_LIST_DIR}/VuhCompileShader.cmake")
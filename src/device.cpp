@@ -1,15 +1,83 @@
 #include <vuh/device.h>
+#include <vuh/error.h>
+#include <vuh/instance.h>
+#include <vuh/arr/memoryPool.h>
+#include <vuh/arr/pinnedHeap.h>
+#include <vuh/arr/residencyManager.h>
+#include <vuh/arr/stagingRing.h>
+#include <vuh/memoryStats.h>
+#include <vuh/releaseQueue.h>
+#include <vuh/workerPool.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stdint.h>
 #include <limits>
+#include <stdexcept>
 
 namespace {
+	/// Device extensions enabled whenever physical device supports them.
+	static const std::vector<const char*> optional_extensions = {
+#ifdef VK_EXT_memory_budget
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_dedicated_allocation
+		VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+		VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
+#endif
+#if defined(VK_EXT_external_memory_host) || defined(VK_KHR_external_memory_fd)
+		VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+#endif
+#ifdef VK_EXT_external_memory_host
+		VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_external_memory_fd
+		VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+#endif
+	};
+
+	/// @return optional device extensions supported by the physical device
+	auto supportedExtensions(const vk::PhysicalDevice& physicalDevice)-> std::vector<const char*> {
+		const auto avail = physicalDevice.enumerateDeviceExtensionProperties();
+		auto r = std::vector<const char*>{};
+		for(auto e: optional_extensions){
+			if(std::any_of(begin(avail), end(avail)
+			               , [e](const auto& p){ return 0 == std::strcmp(e, p.extensionName); }))
+			{
+				r.push_back(e);
+			}
+		}
+		return r;
+	}
+
+	/// @return minimal alignment of host pointers (and sizes) that may be imported to the device
+	/// memory with VK_EXT_external_memory_host, 0 if that can not be queried.
+	auto queryHostImportAlignment(const vuh::Instance& instance, vk::PhysicalDevice physdevice
+	                              )-> vk::DeviceSize
+	{
+#ifdef VK_EXT_external_memory_host
+		auto fn = instance.procAddr("vkGetPhysicalDeviceProperties2KHR");
+		if(fn){
+			auto host_props = VkPhysicalDeviceExternalMemoryHostPropertiesEXT{};
+			host_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+			auto props = VkPhysicalDeviceProperties2{};
+			props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			props.pNext = &host_props;
+			auto getProperties = PFN_vkGetPhysicalDeviceProperties2KHR(fn);
+			getProperties(static_cast<VkPhysicalDevice>(physdevice), &props);
+			return host_props.minImportedHostPointerAlignment;
+		}
+#endif
+		return 0;
+	}
+
 	/// Create logical device.
 	/// Compute and transport queue family id may point to the same queue.
 	auto createDevice(const vk::PhysicalDevice& physicalDevice ///< physical device to wrap
 	                  , uint32_t compute_family_id             ///< index of queue family supporting compute operations
 	                  , uint32_t transfer_family_id            ///< index of queue family supporting transfer operations
+	                  , const std::vector<const char*>& extensions ///< device extensions to enable
 	                  )-> vk::Device
 	{
 		// When creating the device specify what queues it has
@@ -23,7 +91,8 @@ namespace {
 			                                        , transfer_family_id, 1, &p);
 			n_queues += 1;
 		}
-		auto devCI = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), n_queues, queueCIs.data());
+		auto devCI = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), n_queues, queueCIs.data()
+		                                  , 0, nullptr, uint32_t(extensions.size()), extensions.data());
 
 		return physicalDevice.createDevice(devCI, nullptr);
 	}
@@ -82,12 +151,58 @@ namespace vuh {
 	Device::Device(Instance& instance, vk::PhysicalDevice physdevice
 	               , uint32_t computeFamilyId, uint32_t transferFamilyId
 	               )
-	  : vk::Device(createDevice(physdevice, computeFamilyId, transferFamilyId))
+	   : Device(instance, physdevice, computeFamilyId, transferFamilyId
+	            , supportedExtensions(physdevice))
+	{}
+
+	/// Helper constructor
+	Device::Device(Instance& instance, vk::PhysicalDevice physdevice
+	               , uint32_t computeFamilyId, uint32_t transferFamilyId
+	               , std::vector<const char*> extensions
+	               )
+	  : vk::Device(createDevice(physdevice, computeFamilyId, transferFamilyId, extensions))
 	  , _instance(instance)
 	  , _physdev(physdevice)
 	  , _cmp_family_id(computeFamilyId)
 	  , _tfr_family_id(transferFamilyId)
+	  , _ring_size(arr::StagingRing::default_size)
+	  , _properties(physdevice.getProperties())
+	  , _memprops(physdevice.getMemoryProperties())
+	  , _extensions(std::move(extensions))
+	  , _stats(std::make_unique<MemoryStats>(_memprops))
+	  , _releases(std::make_unique<ReleaseQueue>())
 	{
+		_heap_limit.fill(VK_WHOLE_SIZE);
+#ifdef VK_EXT_memory_budget
+		if(hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+		   && instance.hasExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+		{
+			_fn_memprops2 = instance.procAddr("vkGetPhysicalDeviceMemoryProperties2KHR");
+		}
+#endif
+#ifdef VK_KHR_dedicated_allocation
+		if(hasExtension(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME)
+		   && hasExtension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME))
+		{
+			_fn_memreqs2 = getProcAddr("vkGetBufferMemoryRequirements2KHR");
+		}
+#endif
+#ifdef VK_EXT_external_memory_host
+		if(hasExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)
+		   && instance.hasExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+		{
+			_fn_hostptrprops = getProcAddr("vkGetMemoryHostPointerPropertiesEXT");
+			_host_import_alignment = _fn_hostptrprops ? queryHostImportAlignment(instance, physdevice) : 0;
+			if(_host_import_alignment == 0){
+				_fn_hostptrprops = nullptr;
+			}
+		}
+#endif
+#ifdef VK_KHR_external_memory_fd
+		if(hasExtension(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME)){
+			_fn_getmemfd = getProcAddr("vkGetMemoryFdKHR");
+		}
+#endif
 		try {
 			_cmdpool_compute = createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer
 			                                     , computeFamilyId});
@@ -109,6 +224,26 @@ namespace vuh {
 	/// release resources associated with device
 	auto Device::release() noexcept-> void {
 		if(static_cast<vk::Device&>(*this)){
+			_workers.reset(); // host stages of transfers may still refer the fences and staging memory
+			if(_releases){ // deferred releases may return memory to the pools and rings
+				_releases->release(*this);
+			}
+			if(_ring_upload){
+				_ring_upload->release(*this);
+				_ring_upload.reset();
+			}
+			if(_ring_readback){
+				_ring_readback->release(*this);
+				_ring_readback.reset();
+			}
+			if(_pinned){
+				_pinned->release(*this);
+				_pinned.reset();
+			}
+			if(_mempool){
+				_mempool->release(*this);
+				_mempool.reset();
+			}
 			if(_tfr_family_id != _cmp_family_id){
 				freeCommandBuffers(_cmdpool_transfer, _cmdbuf_transfer);
 				destroyCommandPool(_cmdpool_transfer);
@@ -137,6 +272,8 @@ namespace vuh {
 	}
 
 	/// Move constructor.
+	/// Moved-from device is left with zero memory counters and an empty release queue,
+	/// so that those may still be accessed.
 	Device::Device(Device&& other) noexcept
 	   : vk::Device(std::move(other))
 	   , _instance(other._instance)
@@ -147,6 +284,30 @@ namespace vuh {
 	   , _cmdbuf_transfer(other._cmdbuf_transfer)
 	   , _cmp_family_id(other._cmp_family_id)
 	   , _tfr_family_id(other._tfr_family_id)
+	   , _mempool(std::move(other._mempool))
+	   , _pinned(std::move(other._pinned))
+	   , _ring_upload(std::move(other._ring_upload))
+	   , _ring_readback(std::move(other._ring_readback))
+	   , _ring_size(other._ring_size)
+	   , _properties(other._properties)
+	   , _memprops(other._memprops)
+	   , _extensions(std::move(other._extensions))
+	   , _fn_memprops2(other._fn_memprops2)
+	   , _fn_memreqs2(other._fn_memreqs2)
+	   , _fn_hostptrprops(other._fn_hostptrprops)
+	   , _host_import_alignment(other._host_import_alignment)
+	   , _fn_getmemfd(other._fn_getmemfd)
+	   , _dedicated_threshold(other._dedicated_threshold)
+	   , _allocations(std::move(other._allocations))
+	   , _heap_usage(other._heap_usage)
+	   , _heap_budget(other._heap_budget)
+	   , _budget_dirty(other._budget_dirty)
+	   , _heap_limit(other._heap_limit)
+	   , _stats(std::exchange(other._stats, std::make_unique<MemoryStats>(other._memprops)))
+	   , _residency(std::move(other._residency))
+	   , _releases(std::exchange(other._releases, std::make_unique<ReleaseQueue>()))
+	   , _workers(std::move(other._workers))
+	   , _relocations(other._relocations)
 	{
 		static_cast<vk::Device&>(other)= nullptr;
 	}
@@ -168,29 +329,61 @@ namespace vuh {
 		swap(d1._cmdbuf_transfer , d2._cmdbuf_transfer );
 		swap(d1._cmp_family_id   , d2._cmp_family_id   );
 		swap(d1._tfr_family_id   , d2._tfr_family_id   );
-	}
-
-	/// @return physical device properties
-	auto Device::properties() const-> vk::PhysicalDeviceProperties {
-		return _physdev.getProperties();
+		swap(d1._mempool         , d2._mempool         );
+		swap(d1._pinned          , d2._pinned          );
+		swap(d1._ring_upload     , d2._ring_upload     );
+		swap(d1._ring_readback   , d2._ring_readback   );
+		swap(d1._ring_size       , d2._ring_size       );
+		swap(d1._properties      , d2._properties      );
+		swap(d1._memprops        , d2._memprops        );
+		swap(d1._extensions      , d2._extensions      );
+		swap(d1._fn_memprops2    , d2._fn_memprops2    );
+		swap(d1._fn_memreqs2     , d2._fn_memreqs2     );
+		swap(d1._fn_hostptrprops , d2._fn_hostptrprops );
+		swap(d1._host_import_alignment, d2._host_import_alignment);
+		swap(d1._fn_getmemfd     , d2._fn_getmemfd     );
+		swap(d1._dedicated_threshold, d2._dedicated_threshold);
+		swap(d1._allocations     , d2._allocations     );
+		swap(d1._heap_usage      , d2._heap_usage      );
+		swap(d1._heap_budget     , d2._heap_budget     );
+		swap(d1._budget_dirty    , d2._budget_dirty    );
+		swap(d1._heap_limit      , d2._heap_limit      );
+		swap(d1._stats           , d2._stats           );
+		swap(d1._residency       , d2._residency       );
+		swap(d1._releases        , d2._releases        );
+		swap(d1._workers         , d2._workers         );
+		swap(d1._relocations     , d2._relocations     );
 	}
 
 	/// @return memory properties of the memory with given id
 	auto Device::memoryProperties(uint32_t id) const-> vk::MemoryPropertyFlags {
-		return _physdev.getMemoryProperties().memoryTypes[id].propertyFlags;
+		return _memprops.memoryTypes[id].propertyFlags;
 	}
 
-	/// Find first memory matching desired properties.
-	/// Does NOT check for free space availability, only matches the properties.
+	/// @return alignment required for bounds of the mapped ranges of memory with given id
+	/// to be flushed or invalidated. That is nonCoherentAtomSize for host-visible non-coherent memory
+	/// and 1 for all other.
+	auto Device::mapAlignment(uint32_t id) const-> vk::DeviceSize {
+		const auto flags = memoryProperties(id);
+		if((flags & vk::MemoryPropertyFlagBits::eHostVisible)
+		   && !(flags & vk::MemoryPropertyFlagBits::eHostCoherent))
+		{
+			return std::max(_properties.limits.nonCoherentAtomSize, vk::DeviceSize(1));
+		}
+		return 1;
+	}
+
+	/// Find first memory matching desired properties and having enough space left in its heap
+	/// (according to heapAvailable()) to hold the buffer.
 	/// @return id of the suitable memory, -1 if no suitable memory found.
 	auto Device::selectMemory(vk::Buffer buffer, vk::MemoryPropertyFlags properties
 	                          ) const-> uint32_t
 	{
-		auto memProperties = _physdev.getMemoryProperties();
 		auto memoryReqs = getBufferMemoryRequirements(buffer);
-		for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
+		for(uint32_t i = 0; i < _memprops.memoryTypeCount; ++i){
 			if( (memoryReqs.memoryTypeBits & (1u << i))
-			    && ((properties & memProperties.memoryTypes[i].propertyFlags) == properties))
+			    && ((properties & _memprops.memoryTypes[i].propertyFlags) == properties)
+			    && memoryReqs.size <= heapAvailable(_memprops.memoryTypes[i].heapIndex))
 			{
 				return i;
 			}
@@ -198,11 +391,96 @@ namespace vuh {
 		return uint32_t(-1);
 	}
 
+	/// @return true if optional device extension with a given name is enabled on the device
+	auto Device::hasExtension(const char* name) const-> bool {
+		return std::any_of(begin(_extensions), end(_extensions)
+		                   , [name](const char* e){ return 0 == std::strcmp(e, name); });
+	}
+
+	/// @return usage and budget of the memory heap with a given id.
+	/// With VK_EXT_memory_budget supported those are the values reported by the driver (and include
+	/// allocations made by other processes). Otherwise usage is the amount of memory allocated
+	/// through this device and budget is estimated as 80% of the heap size.
+	auto Device::heapBudget(uint32_t heap_id) const-> HeapBudget {
+		assert(heap_id < _memprops.memoryHeapCount);
+		if(_budget_dirty){
+			updateBudget();
+		}
+		return _heap_budget[heap_id];
+	}
+
+	/// @return number of bytes that may still be allocated in the heap with a given id.
+	auto Device::heapAvailable(uint32_t heap_id) const-> vk::DeviceSize {
+		const auto b = heapBudget(heap_id);
+		const auto available = b.budget > b.usage ? b.budget - b.usage : 0;
+		const auto limit = _heap_limit[heap_id];
+		if(limit == VK_WHOLE_SIZE){
+			return available;
+		}
+		return std::min(available, limit > _heap_usage[heap_id] ? limit - _heap_usage[heap_id] : 0);
+	}
+
+	/// Limit the number of bytes that may still be allocated through this device in the heap
+	/// with a given id, on top of the heap budget. Memory allocated after the call counts against
+	/// the limit, freed memory becomes available again. Passing VK_WHOLE_SIZE removes the limit.
+	/// Meant to simulate memory pressure, f.e. when testing the residency management.
+	auto Device::limitHeap(uint32_t heap_id, vk::DeviceSize available)-> void {
+		assert(heap_id < _memprops.memoryHeapCount);
+		_heap_limit[heap_id] = available == VK_WHOLE_SIZE ? VK_WHOLE_SIZE
+		                                                  : _heap_usage[heap_id] + available;
+	}
+
+	/// Refresh cached heap budgets.
+	auto Device::updateBudget() const-> void {
+#ifdef VK_EXT_memory_budget
+		if(_fn_memprops2){
+			auto budget = VkPhysicalDeviceMemoryBudgetPropertiesEXT{};
+			budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			auto props = VkPhysicalDeviceMemoryProperties2{};
+			props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			props.pNext = &budget;
+			auto getProperties = PFN_vkGetPhysicalDeviceMemoryProperties2KHR(_fn_memprops2);
+			getProperties(_physdev, &props);
+			for(uint32_t i = 0; i < _memprops.memoryHeapCount; ++i){
+				_heap_budget[i] = {budget.heapUsage[i], budget.heapBudget[i]};
+			}
+			_budget_dirty = false;
+			return;
+		}
+#endif
+		for(uint32_t i = 0; i < _memprops.memoryHeapCount; ++i){
+			_heap_budget[i] = {_heap_usage[i], _memprops.memoryHeaps[i].size/10*8};
+		}
+		_budget_dirty = false;
+	}
+
 	/// @return true if compute queues family is different from that for transfer queues
 	auto Device::hasSeparateQueues() const-> bool {
 		return _cmp_family_id == _tfr_family_id;
 	}
 
+	/// @return true if device shares memory with the host, so that device-local memory may be
+	/// accessed from host as cheap as the host memory. That is the case for integrated GPUs and
+	/// CPU devices, and for devices all of whose device-local memory types are host-visible.
+	/// Device should also have at least one memory type both device-local and host-visible.
+	auto Device::hasUnifiedMemory() const-> bool {
+		const auto unified = vk::MemoryPropertyFlags(vk::MemoryPropertyFlagBits::eDeviceLocal
+		                                             | vk::MemoryPropertyFlagBits::eHostVisible);
+		auto has_unified = false;
+		auto all_unified = true;
+		for(uint32_t i = 0; i < _memprops.memoryTypeCount; ++i){
+			const auto flags = _memprops.memoryTypes[i].propertyFlags;
+			if(flags & vk::MemoryPropertyFlagBits::eDeviceLocal){
+				const auto is_unified = (flags & unified) == unified;
+				has_unified = has_unified || is_unified;
+				all_unified = all_unified && is_unified;
+			}
+		}
+		const auto type = _properties.deviceType;
+		return has_unified && (all_unified || type == vk::PhysicalDeviceType::eIntegratedGpu
+		                                   || type == vk::PhysicalDeviceType::eCpu);
+	}
+
 	/// @return id of the queue family supporting compute operations
 	auto Device::computeQueue(uint32_t i)-> vk::Queue {
 		return getQueue(_cmp_family_id, i);
@@ -233,6 +511,94 @@ namespace vuh {
 		return new_buffer;
 	}
 
+	/// @return memory pool used to sub-allocate arrays memory.
+	/// Pool is created on the first request.
+	auto Device::memoryPool()-> arr::MemoryPool& {
+		if(!_mempool){
+			_mempool = std::make_unique<arr::MemoryPool>();
+		}
+		return *_mempool;
+	}
+
+	/// @return heap of host-coherent memory used by pinned allocators.
+	/// Heap is created on the first request.
+	auto Device::pinnedHeap()-> arr::PinnedHeap& {
+		if(!_pinned){
+			_pinned = std::make_unique<arr::PinnedHeap>();
+		}
+		return *_pinned;
+	}
+
+	/// @return counters of memory taken by arrays created on this device.
+	/// Those are specific to this Device object, copies of the Device start with zero counters.
+	auto Device::memoryStats() const-> MemoryStats& {
+		return *_stats;
+	}
+
+	/// @return queue of resources waiting for the async submissions using them to complete.
+	auto Device::releaseQueue()-> ReleaseQueue& {
+		return *_releases;
+	}
+
+	/// @return pool of threads running host stages of async transfers (see copy_async() with
+	/// vuh::host_async). Threads are started on the first request.
+	auto Device::workerPool()-> WorkerPool& {
+		if(!_workers){
+			_workers = std::make_unique<WorkerPool>();
+		}
+		return *_workers;
+	}
+
+	/// Enable residency management of the device-local arrays (see arr::ResidencyManager).
+	/// Only arrays created after the call are managed.
+	/// @return residency manager of the device
+	auto Device::enableResidency()-> arr::ResidencyManager& {
+		if(!_residency){
+			_residency = std::make_unique<arr::ResidencyManager>();
+		}
+		return *_residency;
+	}
+
+	/// @return staging ring used for transfers from host to device.
+	/// Ring is created on the first request.
+	auto Device::uploadRing()-> arr::StagingRing& {
+		if(!_ring_upload){
+			_ring_upload = std::make_unique<arr::StagingRing>(*this, arr::StagingRing::Direction::Upload
+			                                                  , _ring_size);
+		}
+		return *_ring_upload;
+	}
+
+	/// @return staging ring used for transfers from device to host.
+	/// Ring is created on the first request.
+	auto Device::readbackRing()-> arr::StagingRing& {
+		if(!_ring_readback){
+			_ring_readback = std::make_unique<arr::StagingRing>(*this
+			                                  , arr::StagingRing::Direction::Readback, _ring_size);
+		}
+		return *_ring_readback;
+	}
+
+	/// Set the capacity of staging rings. Existing rings are released and recreated
+	/// with the new size on the next request.
+	/// @throw std::logic_error if any chunk of the staging rings is still held (by transfers
+	/// in progress, or by the tokens of async transfers not yet synced). Nothing is changed then.
+	auto Device::setStagingRingSize(std::size_t size_bytes)-> void {
+		_releases->collect(*this); // chunks of completed detached transfers go back to the rings
+		for(auto ring: {&_ring_upload, &_ring_readback}){
+			if(*ring && (*ring)->numChunks() != 0){
+				throw std::logic_error("staging ring can not be resized while its chunks are in use");
+			}
+		}
+		for(auto ring: {&_ring_upload, &_ring_readback}){
+			if(*ring){
+				(*ring)->release(*this);
+				ring->reset();
+			}
+		}
+		_ring_size = size_bytes;
+	}
+
 	/// @return i-th queue in the family supporting transfer commands.
 	auto Device::transferQueue(uint32_t i)-> vk::Queue {
 		return getQueue(_tfr_family_id, i);
@@ -245,6 +611,218 @@ namespace vuh {
 		return allocateMemory(allocInfo);
 	}
 
+	/// Allocate device memory and account it in the usage of the corresponding heap.
+	/// Hides vk::Device::allocateMemory, the memory should be released with freeMemory()
+	/// of this class.
+	auto Device::allocateMemory(const vk::MemoryAllocateInfo& info)-> vk::DeviceMemory {
+		auto memory = vk::Device::allocateMemory(info);
+		const auto heap_id = _memprops.memoryTypes[info.memoryTypeIndex].heapIndex;
+		_heap_usage[heap_id] += info.allocationSize;
+		_allocations.emplace(static_cast<VkDeviceMemory>(memory)
+		                     , std::make_pair(heap_id, info.allocationSize));
+		_budget_dirty = true;
+		return memory;
+	}
+
+	/// Allocate device memory to be exclusively used by the given buffer.
+	/// With VK_KHR_dedicated_allocation supported the driver is informed of that, which lets it
+	/// place and page the memory more efficiently. Otherwise this is a normal allocation.
+	auto Device::allocateDedicated(vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id
+	                               )-> vk::DeviceMemory
+	{
+		auto info = vk::MemoryAllocateInfo(size, memory_id);
+#ifdef VK_KHR_dedicated_allocation
+		auto dedicated = VkMemoryDedicatedAllocateInfo{};
+		if(_fn_memreqs2){
+			dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+			dedicated.buffer = static_cast<VkBuffer>(buffer);
+			info.pNext = &dedicated;
+		}
+#endif
+		return allocateMemory(info);
+	}
+
+	/// @return memory requirements of the buffer together with dedicated allocation preference
+	/// (which is only known with VK_KHR_dedicated_allocation supported).
+	auto Device::bufferRequirements(vk::Buffer buffer) const-> BufferRequirements {
+#ifdef VK_KHR_dedicated_allocation
+		if(_fn_memreqs2){
+			auto dedicated = VkMemoryDedicatedRequirements{};
+			dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+			auto reqs = VkMemoryRequirements2{};
+			reqs.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+			reqs.pNext = &dedicated;
+			auto info = VkBufferMemoryRequirementsInfo2{};
+			info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+			info.buffer = static_cast<VkBuffer>(buffer);
+			auto getRequirements = PFN_vkGetBufferMemoryRequirements2KHR(_fn_memreqs2);
+			getRequirements(static_cast<VkDevice>(static_cast<const vk::Device&>(*this)), &info, &reqs);
+
+			auto r = BufferRequirements{};
+			r.memory.size = reqs.memoryRequirements.size;
+			r.memory.alignment = reqs.memoryRequirements.alignment;
+			r.memory.memoryTypeBits = reqs.memoryRequirements.memoryTypeBits;
+			r.prefers_dedicated = dedicated.prefersDedicatedAllocation == VK_TRUE;
+			r.requires_dedicated = dedicated.requiresDedicatedAllocation == VK_TRUE;
+			return r;
+		}
+#endif
+		return BufferRequirements{getBufferMemoryRequirements(buffer), false, false};
+	}
+
+	/// @return true if buffer with given requirements should get a dedicated allocation.
+	/// That is the case when driver prefers (or requires) so, or buffer size is not less than
+	/// dedicatedThreshold().
+	auto Device::useDedicated(const BufferRequirements& requirements) const-> bool {
+		return requirements.requires_dedicated || requirements.prefers_dedicated
+		       || requirements.memory.size >= _dedicated_threshold;
+	}
+
+	/// @return bitmask of memory types the host allocation at given address may be imported to,
+	/// 0 if it can not be imported at all (VK_EXT_external_memory_host is not supported,
+	/// or pointer is not aligned to hostImportAlignment()).
+	auto Device::hostPointerMemoryTypes(const void* ptr) const-> uint32_t {
+#ifdef VK_EXT_external_memory_host
+		if(_fn_hostptrprops && reinterpret_cast<uintptr_t>(ptr) % _host_import_alignment == 0){
+			auto props = VkMemoryHostPointerPropertiesEXT{};
+			props.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+			auto getProperties = PFN_vkGetMemoryHostPointerPropertiesEXT(_fn_hostptrprops);
+			if(VK_SUCCESS == getProperties(static_cast<VkDevice>(static_cast<const vk::Device&>(*this))
+			                               , VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+			                               , ptr, &props))
+			{
+				return props.memoryTypeBits;
+			}
+		}
+#endif
+		return 0;
+	}
+
+	/// Import existing host allocation as device memory of the given type.
+	/// Memory is accounted same as the one allocated with allocateMemory() and should be released
+	/// with freeMemory(). Host allocation should outlive the imported memory.
+	/// @pre ptr and size should be multiples of hostImportAlignment(),
+	/// memory_id should be one of the types reported by hostPointerMemoryTypes().
+	/// @throws vuh::NoSuitableMemoryFound if device does not support host memory import
+	auto Device::importHostMemory(void* ptr, vk::DeviceSize size, uint32_t memory_id
+	                              )-> vk::DeviceMemory
+	{
+#ifdef VK_EXT_external_memory_host
+		if(_fn_hostptrprops){
+			assert(reinterpret_cast<uintptr_t>(ptr) % _host_import_alignment == 0);
+			assert(size % _host_import_alignment == 0);
+			auto import = VkImportMemoryHostPointerInfoEXT{};
+			import.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+			import.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+			import.pHostPointer = ptr;
+			auto info = vk::MemoryAllocateInfo(size, memory_id);
+			info.pNext = &import;
+			return allocateMemory(info);
+		}
+#endif
+		throw NoSuitableMemoryFound("host memory import is not supported by the device");
+	}
+
+	/// Allocate device memory which may be exported as a POSIX file descriptor
+	/// (with VK_KHR_external_memory_fd), see exportMemoryFd().
+	/// Memory is accounted same as the one allocated with allocateMemory() and should be released
+	/// with freeMemory(). Dedicated allocation is made to the buffer if requested and supported.
+	/// @throws vuh::NoSuitableMemoryFound if device does not support memory export
+	auto Device::allocateExportable(vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id
+	                                , bool dedicated)-> vk::DeviceMemory
+	{
+#ifdef VK_KHR_external_memory_fd
+		if(_fn_getmemfd){
+			auto info = vk::MemoryAllocateInfo(size, memory_id);
+			auto export_info = VkExportMemoryAllocateInfo{};
+			export_info.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+			export_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+			info.pNext = &export_info;
+#ifdef VK_KHR_dedicated_allocation
+			auto dedicated_info = VkMemoryDedicatedAllocateInfo{};
+			if(dedicated && _fn_memreqs2){
+				dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+				dedicated_info.buffer = static_cast<VkBuffer>(buffer);
+				export_info.pNext = &dedicated_info;
+			}
+#endif
+			return allocateMemory(info);
+		}
+#endif
+		throw NoSuitableMemoryFound("memory export is not supported by the device");
+	}
+
+	/// Export memory allocated with allocateExportable() as a POSIX file descriptor.
+	/// Every call makes a new descriptor, owned by the caller. It should be either closed or passed
+	/// to importMemoryFd() (normally by another process), which takes its ownership.
+	/// Memory stays alive for as long as it is referred by either this device or any of importers.
+	/// @throws vuh::NoSuitableMemoryFound if device does not support memory export
+	auto Device::exportMemoryFd(vk::DeviceMemory memory)-> int {
+#ifdef VK_KHR_external_memory_fd
+		if(_fn_getmemfd){
+			auto info = VkMemoryGetFdInfoKHR{};
+			info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+			info.memory = static_cast<VkDeviceMemory>(memory);
+			info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+			auto getFd = PFN_vkGetMemoryFdKHR(_fn_getmemfd);
+			auto fd = -1;
+			const auto r = getFd(static_cast<VkDevice>(static_cast<const vk::Device&>(*this)), &info, &fd);
+			if(r != VK_SUCCESS){
+				throw vk::SystemError(vk::make_error_code(vk::Result(r)), "vkGetMemoryFdKHR");
+			}
+			return fd;
+		}
+#endif
+		throw NoSuitableMemoryFound("memory export is not supported by the device");
+	}
+
+	/// Import memory exported with exportMemoryFd() (normally by another process).
+	/// Memory type, size and dedicated allocation should match those of the exported memory,
+	/// and the physical device should be the same.
+	/// Ownership of the file descriptor passes to the device on success (the descriptor should
+	/// not be used any more), and stays with the caller if import fails.
+	/// Memory is accounted same as the one allocated with allocateMemory() and should be released
+	/// with freeMemory().
+	/// @throws vuh::NoSuitableMemoryFound if device does not support memory import
+	auto Device::importMemoryFd(int fd, vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id
+	                            , bool dedicated)-> vk::DeviceMemory
+	{
+#ifdef VK_KHR_external_memory_fd
+		if(_fn_getmemfd){
+			auto info = vk::MemoryAllocateInfo(size, memory_id);
+			auto import = VkImportMemoryFdInfoKHR{};
+			import.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR;
+			import.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+			import.fd = fd;
+			info.pNext = &import;
+#ifdef VK_KHR_dedicated_allocation
+			auto dedicated_info = VkMemoryDedicatedAllocateInfo{};
+			if(dedicated && _fn_memreqs2){
+				dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+				dedicated_info.buffer = static_cast<VkBuffer>(buffer);
+				import.pNext = &dedicated_info;
+			}
+#endif
+			return allocateMemory(info);
+		}
+#endif
+		throw NoSuitableMemoryFound("memory import is not supported by the device");
+	}
+
+	/// Free device memory allocated with allocateMemory() and update the heap usage.
+	auto Device::freeMemory(vk::DeviceMemory memory) noexcept-> void {
+		if(!memory){
+			return;
+		}
+		auto it = _allocations.find(static_cast<VkDeviceMemory>(memory));
+		if(it != end(_allocations)){
+			_heap_usage[it->second.first] -= it->second.second;
+			_allocations.erase(it);
+			_budget_dirty = true;
+		}
+		vk::Device::freeMemory(memory);
+	}
+
 	/// @return handle to command pool for transfer command buffers
 	auto Device::transferCmdPool()-> vk::CommandPool { return _cmdpool_transfer; }
 
@@ -21,4 +21,14 @@ namespace vuh {
 	   : std::runtime_error(message)
 	{}
 
+	/// Constructs the exception object with explanatory string.
+	FileWriteFailure::FileWriteFailure(const std::string& message)
+	   : std::runtime_error(message)
+	{}
+
+	/// Constructs the exception object with explanatory string.
+	FileWriteFailure::FileWriteFailure(const char* message)
+	   : std::runtime_error(message)
+	{}
+
 } // namespace vuh
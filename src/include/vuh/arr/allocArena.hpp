@@ -0,0 +1,221 @@
+#pragma once
+
+#include "allocDevice.hpp"
+
+#include <vuh/device.h>
+#include <vuh/error.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+namespace vuh {
+namespace arr {
+
+/// Linear (bump-pointer) memory arena.
+/// Owns a single chunk of device memory of a fixed size. Arrays created on the arena
+/// (with AllocArena allocator) take consecutive aligned ranges of that chunk, so creating them
+/// costs just the buffer creation and an offset bump. Destroying the array does not return its memory,
+/// instead the whole arena is reset at once with reset().
+/// Intended for transient per-iteration arrays.
+/// Objects of this class are neither copyable nor movable since arrays refer to them.
+template<class Props>
+class Arena {
+public:
+	/// Construct the arena of given size on the device.
+	/// Memory type is selected the same way AllocDevice<Props> would do it for arrays
+	/// with given additional flags.
+	Arena(vuh::Device& device                        ///< device to allocate memory on
+	      , std::size_t size_bytes                   ///< arena size in bytes
+	      , vk::MemoryPropertyFlags flags_memory={}  ///< additional (to defined by Props) memory property flags
+	      , vk::BufferUsageFlags flags_buffer={}     ///< additional (to defined by Props) buffer usage flags of arrays to be created on the arena
+	      )
+	   : _device(device), _size(size_bytes)
+	{
+		auto probe = AllocDevice<Props>::makeBuffer(device, size_bytes
+		                       , vk::BufferUsageFlagBits::eStorageBuffer | flags_buffer);
+		try {
+			_memid = AllocDevice<Props>::findMemory(device, probe, flags_memory);
+			_atom = std::size_t(device.mapAlignment(_memid));
+			_size = (size_bytes + _atom - 1)/_atom*_atom;
+			_memory = device.allocateMemory({_size, _memid});
+		} catch(std::runtime_error&) {
+			device.destroyBuffer(probe);
+			throw;
+		}
+		device.destroyBuffer(probe);
+		_flags = device.memoryProperties(_memid);
+	}
+
+	/// Release arena memory.
+	/// @pre all arrays created on the arena should be destroyed by now.
+	~Arena() noexcept {
+		assert(_n_live == 0);
+		if(_mapped){
+			_device.unmapMemory(_memory);
+		}
+		_device.freeMemory(_memory);
+	}
+
+	Arena(const Arena&) = delete;
+	auto operator= (const Arena&)-> Arena& = delete;
+
+	/// Reserve the range satisfying given memory requirements.
+	/// @return offset of the reserved range wrt the beginning of arena memory.
+	/// @throws vuh::NoSuitableMemoryFound if arena memory type is not suitable for the buffer
+	/// @throws vk::OutOfDeviceMemoryError if arena does not have enough space left
+	auto allocate(const vk::MemoryRequirements& requirements ///< buffer memory requirements
+	              , vk::MemoryPropertyFlags flags={}         ///< memory flags requested for the buffer
+	              )-> std::size_t
+	{
+		if(!(requirements.memoryTypeBits & (1u << _memid)) || (_flags & flags) != flags){
+			throw NoSuitableMemoryFound("arena memory type does not match buffer requirements");
+		}
+		const auto alignment = std::max(std::size_t(requirements.alignment), _atom);
+		const auto size = (std::size_t(requirements.size) + _atom - 1)/_atom*_atom;
+		const auto offset = (_top + alignment - 1)/alignment*alignment;
+		if(offset + size > _size){
+			throw vk::OutOfDeviceMemoryError("arena of size " + std::to_string(_size)
+			                                 + " is exhausted");
+		}
+		_top = offset + size;
+		++_n_live;
+		return offset;
+	}
+
+	/// Mark one array created on the arena as destroyed. Memory is not reclaimed till reset().
+	auto release() noexcept-> void {
+		assert(_n_live > 0);
+		--_n_live;
+	}
+
+	/// Make the whole arena memory available again.
+	/// @pre all arrays created on the arena should be destroyed by now, and all operations
+	/// involving those completed.
+	auto reset() noexcept-> void {
+		assert(_n_live == 0);
+		_top = 0;
+	}
+
+	/// @return host pointer to the beginning of arena memory.
+	/// Memory is mapped on first request and stays mapped till arena is destroyed.
+	/// @pre arena memory should be host-visible.
+	auto map()-> void* {
+		assert(_flags & vk::MemoryPropertyFlagBits::eHostVisible);
+		if(!_mapped){
+			_mapped = _device.mapMemory(_memory, 0, VK_WHOLE_SIZE);
+		}
+		return _mapped;
+	}
+
+	/// @return reference to the device arena memory is allocated on
+	auto device()-> vuh::Device& { return _device; }
+	/// @return arena memory handle
+	auto memory() const-> vk::DeviceMemory { return _memory; }
+	/// @return id of the memory type arena memory is allocated in
+	auto memId() const-> uint32_t { return _memid; }
+	/// @return arena size in bytes
+	auto size() const-> std::size_t { return _size; }
+	/// @return number of bytes taken by arrays since the last reset (including alignment padding)
+	auto used() const-> std::size_t { return _top; }
+private: // data
+	vuh::Device& _device;           ///< device holding the arena memory
+	vk::DeviceMemory _memory;       ///< arena memory
+	vk::MemoryPropertyFlags _flags; ///< actual flags of allocated memory
+	uint32_t _memid;                ///< memory type id
+	std::size_t _size;              ///< arena size in bytes
+	std::size_t _atom = 1;          ///< alignment of the ranges given to arrays (nonCoherentAtomSize for non-coherent memory)
+	std::size_t _top = 0;           ///< offset of the first free byte
+	std::size_t _n_live = 0;        ///< number of arrays created on arena which are not yet destroyed
+	void* _mapped = nullptr;        ///< host pointer to arena memory if it is mapped
+}; // class Arena
+
+/// Allocator taking array memory from the Arena.
+/// Unlike other allocators this one is not default constructible. Arrays using it
+/// are created with constructors taking a reference to Arena in place of the device.
+/// There is no fall-back, allocation failure results in exception.
+/// Binding between memory and buffer is done elsewhere.
+template<class Props>
+class AllocArena {
+public:
+	using properties_t = Props;
+
+	/// Constructor.
+	explicit AllocArena(Arena<Props>& arena): _arena(&arena) {}
+
+	/// Create buffer on a device.
+	static auto makeBuffer(vuh::Device& device   ///< device to create buffer on
+	                      , size_t size_bytes    ///< desired size in bytes
+	                      , vk::BufferUsageFlags flags ///< additional (to the ones defined in Props) buffer usage flags
+	                      )-> vk::Buffer
+	{
+		return AllocDevice<Props>::makeBuffer(device, size_bytes, flags);
+	}
+
+	/// Reserve memory for the buffer in the arena.
+	/// @return arena memory handle. Buffer should be bound to it at offset().
+	auto allocMemory(vuh::Device& device  ///< device to allocate memory
+	                 , vk::Buffer buffer  ///< buffer to allocate memory for
+	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional memory property flags
+	                 )-> vk::DeviceMemory
+	{
+		assert(&device == &_arena->device());
+		_offset = _arena->allocate(device.getBufferMemoryRequirements(buffer), flags_memory);
+		_allocated = true;
+		return _arena->memory();
+	}
+
+	/// @return memory id on which actual allocation took place.
+	auto memId() const-> uint32_t { return _arena->memId(); }
+
+	/// @return memory property flags of the memory on which actual allocation took place.
+	auto memoryProperties(vuh::Device& device) const-> vk::MemoryPropertyFlags {
+		return device.memoryProperties(memId());
+	}
+
+	/// @return offset (bytes) of the buffer memory wrt the beginning of arena memory.
+	auto offset() const-> std::size_t { return _offset; }
+
+	/// Arena memory is shared by all arrays created on it.
+	auto isDedicated() const-> bool { return false; }
+
+	/// Noop. Arena memory is never moved.
+	auto track(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	           , uint64_t&, std::size_t, vk::BufferUsageFlags) noexcept-> void {}
+
+	/// Noop. Arena memory is never moved.
+	auto retrack(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	             , uint64_t&) noexcept-> void {}
+
+	/// Noop. Arena memory is never moved.
+	auto touch(vuh::Device&, vk::DeviceMemory) const-> void {}
+
+	/// Noop. Arena memory is never moved.
+	auto untrack(vuh::Device&, vk::DeviceMemory) noexcept-> void {}
+
+	/// Notify arena the array is destroyed. Memory is only reclaimed with Arena::reset().
+	auto freeMemory(vuh::Device&, vk::DeviceMemory) noexcept-> void {
+		if(_allocated){
+			_arena->release();
+			_allocated = false;
+		}
+	}
+
+	/// @return host pointer to the beginning of buffer memory.
+	/// @pre arena memory should be host-visible
+	auto mapMemory(vuh::Device&, vk::DeviceMemory, std::size_t) const-> void* {
+		return static_cast<char*>(_arena->map()) + _offset;
+	}
+
+	/// Noop. Arena memory stays mapped during its lifetime.
+	auto unmapMemory(vuh::Device&, vk::DeviceMemory) const noexcept-> void {}
+private: // data
+	Arena<Props>* _arena;    ///< arena to take memory from
+	std::size_t _offset = 0; ///< offset of the buffer memory in the arena
+	bool _allocated = false; ///< true if arena range was successfully reserved
+}; // class AllocArena
+
+} // namespace arr
+} // namespace vuh
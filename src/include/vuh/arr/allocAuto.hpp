@@ -0,0 +1,54 @@
+#pragma once
+
+#include "allocDevice.hpp"
+#include "arrayProperties.h"
+
+#include <vuh/device.h>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vuh {
+namespace arr {
+
+/// Allocator picking the cheapest placement of the array memory on the device at hand.
+/// On devices with unified memory (see Device::hasUnifiedMemory()) memory is taken from
+/// device-local host-visible space (preferably host-coherent), so that arrays exchange data
+/// with the host through the persistently mapped memory, without staging.
+/// On discrete GPUs memory is device-local and host transfers are staged, same as with
+/// properties::Device, whose fall-back strategy also applies.
+/// Actual allocation is done by the base allocator (AllocDevice or AllocPool of properties::Device),
+/// so the choice is made at runtime and the same code runs well on both kinds of devices.
+template<class Base=AllocDevice<properties::Device>>
+class AllocAuto: public Base {
+public:
+	/// Allocate memory for the buffer in the placement chosen for the device.
+	auto allocMemory(vuh::Device& device  ///< device to allocate memory
+	                 , vk::Buffer buffer  ///< buffer to allocate memory for
+	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional (to device-local) memory property flags
+	                 )-> vk::DeviceMemory
+	{
+		return Base::allocMemory(device, buffer, flags_memory | placement(device, buffer, flags_memory));
+	}
+
+	/// @return memory property flags to be requested on top of device-local for the buffer.
+	/// On unified memory devices those are host-visible (and host-coherent if there is such
+	/// memory type with enough budget left), on others none.
+	static auto placement(const vuh::Device& device, vk::Buffer buffer
+	                      , vk::MemoryPropertyFlags flags_memory={})-> vk::MemoryPropertyFlags
+	{
+		if(!device.hasUnifiedMemory()){
+			return {};
+		}
+		const auto visible = vk::MemoryPropertyFlags(vk::MemoryPropertyFlagBits::eHostVisible);
+		const auto requested = flags_memory | vk::MemoryPropertyFlags(properties::Device::memory);
+		for(auto flags: {visible | vk::MemoryPropertyFlagBits::eHostCoherent, visible}){
+			if(device.selectMemory(buffer, requested | flags) != uint32_t(-1)){
+				return flags;
+			}
+		}
+		return {};
+	}
+}; // class AllocAuto
+
+} // namespace arr
+} // namespace vuh
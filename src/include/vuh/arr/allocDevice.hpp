@@ -3,6 +3,8 @@
 #include <vuh/device.h>
 #include <vuh/error.h>
 #include <vuh/instance.h>
+#include <vuh/memoryStats.h>
+#include <vuh/arr/residencyManager.h>
 
 #include <vulkan/vulkan.hpp>
 
@@ -13,7 +15,11 @@ namespace arr {
 
 /// Helper class to allocate memory directly from a device memory (incl. host-visible space)
 /// (as opposed to allocating from a pool) and initialize the buffer.
+/// Memory is allocated as dedicated to the buffer when device finds that beneficial
+/// (see Device::useDedicated()).
 /// Binding between memory and buffer is done elsewhere.
+/// With residency management enabled on the device, least recently used device-local arrays
+/// are evicted to make room for the new allocation before falling back to the host memory.
 template<class Props>
 class AllocDevice{
 public:
@@ -36,16 +42,27 @@ public:
 	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional (to the ones defined in Props) memory property flags
 	                 )-> vk::DeviceMemory 
 	{
+		if(auto residency = device.residency()){
+			residency->makeRoom(device, buffer
+			                    , vk::MemoryPropertyFlags(Props::memory) | flags_memory);
+		}
 		_memid = findMemory(device, buffer, flags_memory);
 		auto mem = vk::DeviceMemory{};
 		try{
-			mem = device.allocateMemory({device.getBufferMemoryRequirements(buffer).size, _memid});
+			const auto atom = device.mapAlignment(_memid);
+			const auto reqs = device.bufferRequirements(buffer);
+			const auto size = (reqs.memory.size + atom - 1)/atom*atom;
+			_dedicated = device.useDedicated(reqs);
+			mem = _dedicated ? device.allocateDedicated(buffer, size, _memid)
+			                 : device.allocateMemory({size, _memid});
 		} catch (vk::Error& e){
 			auto allocFallback = AllocFallback{};
 			device.instance().report("AllocDevice failed to allocate memory, using fallback", e.what()
 			                         , VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT);
+			device.memoryStats().onFallback();
 			mem = allocFallback.allocMemory(device, buffer, flags_memory);
 			_memid = allocFallback.memId();
+			_dedicated = allocFallback.isDedicated();
 		}
 		return mem;
 	}
@@ -61,9 +78,74 @@ public:
 		return device.memoryProperties(_memid);
 	}
 
+	/// @return offset (bytes) of the buffer memory wrt the beginning of allocated memory chunk.
+	/// Memory allocated directly from device is not shared between buffers so this is always 0.
+	auto offset() const-> std::size_t { return 0; }
+
+	/// @return true if memory was allocated as dedicated to the buffer.
+	auto isDedicated() const-> bool { return _dedicated; }
+
+	/// Register the buffer and memory handles with the device residency manager (if enabled),
+	/// so that memory may be evicted under memory pressure.
+	/// Memory flags, host mapping and last use of the owner are updated when memory is moved.
+	auto track(vuh::Device& device, vk::Buffer& buffer, vk::DeviceMemory& memory
+	           , vk::MemoryPropertyFlags& flags, void*& mapped, uint64_t& last_use
+	           , std::size_t size_bytes, vk::BufferUsageFlags usage) noexcept-> void
+	{
+		if(auto residency = device.residency()){
+			residency->track(device, {&buffer, &memory, &_memid, &_dedicated, &flags, &mapped, &last_use}
+			                 , size_bytes, usage);
+		}
+	}
+
+	/// Update location of the owner handles after those have been moved.
+	auto retrack(vuh::Device& device, vk::Buffer& buffer, vk::DeviceMemory& memory
+	             , vk::MemoryPropertyFlags& flags, void*& mapped, uint64_t& last_use) noexcept-> void
+	{
+		if(auto residency = device.residency()){
+			residency->retrack({&buffer, &memory, &_memid, &_dedicated, &flags, &mapped, &last_use});
+		}
+	}
+
+	/// Stop updating the handles registered with track(), memory is about to be released.
+	auto untrack(vuh::Device& device, vk::DeviceMemory memory) noexcept-> void {
+		if(auto residency = device.residency()){
+			residency->untrack(memory);
+		}
+	}
+
+	/// Mark memory as just used, restoring it to device memory if it was evicted.
+	/// Buffer and memory handles registered with track() may change.
+	auto touch(vuh::Device& device, vk::DeviceMemory memory) const-> void {
+		if(auto residency = device.residency()){
+			residency->touch(device, memory);
+		}
+	}
+
+	/// Release memory previously allocated with allocMemory().
+	auto freeMemory(vuh::Device& device, vk::DeviceMemory memory) noexcept-> void {
+		if(auto residency = device.residency()){
+			residency->untrack(memory);
+		}
+		device.freeMemory(memory);
+	}
+
+	/// Map the allocated memory to host address space.
+	/// @pre memory should be host-visible
+	auto mapMemory(vuh::Device& device, vk::DeviceMemory memory, std::size_t size_bytes
+	               ) const-> void*
+	{
+		return device.mapMemory(memory, 0, size_bytes);
+	}
+
+	/// Unmap memory previously mapped with mapMemory().
+	auto unmapMemory(vuh::Device& device, vk::DeviceMemory memory) const noexcept-> void {
+		device.unmapMemory(memory);
+	}
+
 	/// @return id of the first memory matchig requirements of the given buffer and Props
-	/// If requirements are not matched memory properties defined in Props are relaxed to
-	/// those of the fallback.
+	/// If requirements are not matched (or matching memory heap does not have enough budget left)
+	/// memory properties defined in Props are relaxed to those of the fallback.
 	/// This may cause for example allocation in host-visible memory when device-local
 	/// was originally requested but not available on a given device.
 	/// This would only be reported through reporter associated with Instance, and no error
@@ -81,10 +163,12 @@ public:
 		}
 		device.instance().report("AllocDevice could not find desired memory type, using fallback", " "
 		                         , VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT);
+		device.memoryStats().onFallback();
 		return AllocFallback::findMemory(device, buffer, flags_memory);
 	}
 private: // data
 	uint32_t _memid = uint32_t(-1); ///< allocated memory id
+	bool _dedicated = false;        ///< true if memory is a dedicated allocation
 }; // class AllocDevice
 
 /// Specialize allocator for void properties type.
@@ -129,6 +213,38 @@ public:
 	auto memId() const-> uint32_t {
 		throw std::logic_error("this function is not supposed to be called");
 	}
+
+	/// Nothing is ever allocated so nothing is shared.
+	auto offset() const-> std::size_t { return 0; }
+
+	/// Nothing is ever allocated.
+	auto isDedicated() const-> bool { return false; }
+
+	/// Noop. Nothing is ever allocated.
+	auto track(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	           , uint64_t&, std::size_t, vk::BufferUsageFlags) noexcept-> void {}
+
+	/// Noop. Nothing is ever allocated.
+	auto retrack(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	             , uint64_t&) noexcept-> void {}
+
+	/// Noop. Nothing is ever allocated.
+	auto touch(vuh::Device&, vk::DeviceMemory) const-> void {}
+
+	/// Noop. Nothing is ever allocated.
+	auto untrack(vuh::Device&, vk::DeviceMemory) noexcept-> void {}
+
+	/// Noop. Nothing is ever allocated.
+	auto freeMemory(vuh::Device&, vk::DeviceMemory) noexcept-> void {}
+
+	/// @throw std::logic_error
+	/// Should not normally be called.
+	auto mapMemory(vuh::Device&, vk::DeviceMemory, std::size_t) const-> void* {
+		throw std::logic_error("this function is not supposed to be called");
+	}
+
+	/// Noop. Nothing is ever allocated.
+	auto unmapMemory(vuh::Device&, vk::DeviceMemory) const noexcept-> void {}
 };
 
 } // namespace arr
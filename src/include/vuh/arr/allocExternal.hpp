@@ -0,0 +1,182 @@
+#pragma once
+
+#include "allocDevice.hpp"
+
+#include <vuh/device.h>
+#include <vuh/error.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+namespace vuh {
+namespace arr {
+
+/// Array memory exported to other processes (see AllocExternal).
+/// Everything the importing side needs to know to construct an array over the same memory.
+/// Plain data, so that it can be passed between processes in any way (the file descriptor
+/// itself is normally passed over a unix domain socket).
+struct ExternalMemory {
+	int fd = -1;                           ///< POSIX file descriptor referring the memory, -1 if none
+	std::size_t allocation_size = 0;       ///< size (bytes) of the exported memory allocation
+	std::size_t offset = 0;                ///< offset (bytes) of the array data wrt the beginning of the allocation
+	std::size_t size_bytes = 0;            ///< size (bytes) of the array data
+	uint32_t memory_type = uint32_t(-1);   ///< memory type id the memory was allocated in
+	bool dedicated = false;                ///< true if memory is a dedicated allocation
+}; // struct ExternalMemory
+
+/// Helper class to allocate memory shareable with other processes through POSIX file descriptors
+/// (with VK_KHR_external_memory_fd), or to import memory shared this way.
+/// Default-constructed allocator allocates exportable memory, to be exported by exportMemory().
+/// Allocator constructed from the ExternalMemory imports it instead, and takes the ownership
+/// of its file descriptor on success. Exporting and importing devices should be created on the
+/// same physical device (normally in different processes), memory is then shared with no copies.
+/// Access to the shared memory is not synchronized between processes in any way.
+/// Shared memory is never moved (evicted) or sub-allocated. Allocation fails with
+/// vuh::NoSuitableMemoryFound if device does not support memory sharing.
+/// Binding between memory and buffer is done elsewhere.
+template<class Props>
+class AllocExternal {
+public:
+	using properties_t = Props;
+
+	/// Constructor. Default-constructed allocator exports memory, otherwise the given memory is imported.
+	explicit AllocExternal(const ExternalMemory& external={} ///< memory to import
+	                       )
+	   : _import(external)
+	{}
+
+	/// Create buffer on a device.
+	/// Buffer is made compatible with the memory shared through file descriptors when the device
+	/// supports that. Transfer usage flags are always added, so that the array can be copied to/from.
+	static auto makeBuffer(vuh::Device& device   ///< device to create buffer on
+	                      , size_t size_bytes    ///< desired size in bytes
+	                      , vk::BufferUsageFlags flags ///< additional (to the ones defined in Props) buffer usage flags
+	                      )-> vk::Buffer
+	{
+		const auto flags_combined = flags | vk::BufferUsageFlags(Props::buffer)
+		                            | vk::BufferUsageFlagBits::eTransferSrc
+		                            | vk::BufferUsageFlagBits::eTransferDst;
+		auto info = vk::BufferCreateInfo({}, size_bytes, flags_combined);
+#ifdef VK_KHR_external_memory_fd
+		auto external = VkExternalMemoryBufferCreateInfo{};
+		if(device.canExportMemory()){
+			external.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+			external.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+			info.pNext = &external;
+		}
+#endif
+		return device.createBuffer(info);
+	}
+
+	/// Allocate exportable memory for the buffer, or import the memory given at construction.
+	/// @throws vuh::NoSuitableMemoryFound if memory can not be shared on this device,
+	/// or imported memory does not match the buffer requirements.
+	auto allocMemory(vuh::Device& device  ///< device to allocate memory
+	                 , vk::Buffer buffer  ///< buffer to allocate memory for
+	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional (to the ones defined in Props) memory property flags
+	                 )-> vk::DeviceMemory
+	{
+		if(!device.canExportMemory()){
+			throw NoSuitableMemoryFound("device can not share memory through file descriptors");
+		}
+		const auto reqs = device.bufferRequirements(buffer);
+		if(_import.fd < 0){
+			_memid = AllocDevice<Props>::findMemory(device, buffer, flags_memory);
+			_size = std::size_t(reqs.memory.size);
+			_dedicated = device.useDedicated(reqs);
+			return device.allocateExportable(buffer, _size, _memid, _dedicated);
+		}
+		if(_import.memory_type >= device.memoryProperties().memoryTypeCount
+		   || !(reqs.memory.memoryTypeBits & (1u << _import.memory_type))
+		   || _import.offset % reqs.memory.alignment != 0
+		   || _import.offset + reqs.memory.size > _import.allocation_size)
+		{
+			throw NoSuitableMemoryFound("imported memory does not match the buffer requirements");
+		}
+		auto mem = device.importMemoryFd(_import.fd, buffer, _import.allocation_size
+		                                 , _import.memory_type, _import.dedicated);
+		_memid = _import.memory_type;
+		_size = _import.allocation_size;
+		_dedicated = _import.dedicated;
+		_import.fd = -1; // owned by the memory now
+		return mem;
+	}
+
+	/// @return memory id on which actual allocation took place.
+	auto memId() const-> uint32_t {
+		assert(_memid != uint32_t(-1)); // should only be called after successful allocMemory() call
+		return _memid;
+	}
+
+	/// @return memory property flags of the memory on which actual allocation took place.
+	auto memoryProperties(vuh::Device& device) const-> vk::MemoryPropertyFlags {
+		return device.memoryProperties(_memid);
+	}
+
+	/// @return offset (bytes) of the buffer memory wrt the beginning of allocated memory chunk.
+	/// Exported memory is not shared between buffers of the same process, so this is 0
+	/// unless the imported memory says otherwise.
+	auto offset() const-> std::size_t { return _import.offset; }
+
+	/// @return true if memory was allocated as dedicated to the buffer.
+	auto isDedicated() const-> bool { return _dedicated; }
+
+	/// @return description of the memory to be imported by other process, with a new file descriptor.
+	/// Descriptor is owned by the caller, and should be either closed or passed to the importer.
+	/// Memory stays alive till it is released by the exporting and all importing processes.
+	auto exportMemory(vuh::Device& device, vk::DeviceMemory memory, std::size_t size_bytes
+	                  ) const-> ExternalMemory
+	{
+		auto r = ExternalMemory{};
+		r.fd = device.exportMemoryFd(memory);
+		r.allocation_size = _size;
+		r.offset = offset();
+		r.size_bytes = size_bytes;
+		r.memory_type = _memid;
+		r.dedicated = _dedicated;
+		return r;
+	}
+
+	/// Noop. Shared memory is never moved.
+	auto track(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	           , uint64_t&, std::size_t, vk::BufferUsageFlags) noexcept-> void {}
+
+	/// Noop. Shared memory is never moved.
+	auto retrack(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	             , uint64_t&) noexcept-> void {}
+
+	/// Noop. Shared memory is never moved.
+	auto touch(vuh::Device&, vk::DeviceMemory) const-> void {}
+
+	/// Noop. Shared memory is never moved.
+	auto untrack(vuh::Device&, vk::DeviceMemory) noexcept-> void {}
+
+	/// Release memory previously allocated (or imported) with allocMemory().
+	/// Memory referred by other processes stays alive for them.
+	auto freeMemory(vuh::Device& device, vk::DeviceMemory memory) noexcept-> void {
+		device.freeMemory(memory);
+	}
+
+	/// Map the allocated memory to host address space.
+	/// @pre memory should be host-visible
+	auto mapMemory(vuh::Device& device, vk::DeviceMemory memory, std::size_t size_bytes
+	               ) const-> void*
+	{
+		return device.mapMemory(memory, _import.offset, size_bytes);
+	}
+
+	/// Unmap memory previously mapped with mapMemory().
+	auto unmapMemory(vuh::Device& device, vk::DeviceMemory memory) const noexcept-> void {
+		device.unmapMemory(memory);
+	}
+private: // data
+	ExternalMemory _import;         ///< memory to import, no file descriptor when exporting
+	std::size_t _size = 0;          ///< size (bytes) of the memory allocation
+	uint32_t _memid = uint32_t(-1); ///< allocated memory id
+	bool _dedicated = false;        ///< true if memory is a dedicated allocation
+}; // class AllocExternal
+} // namespace arr
+} // namespace vuh
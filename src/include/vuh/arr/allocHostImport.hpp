@@ -0,0 +1,195 @@
+#pragma once
+
+#include "allocDevice.hpp"
+
+#include <vuh/device.h>
+#include <vuh/instance.h>
+#include <vuh/memoryStats.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <cassert>
+
+namespace vuh {
+namespace arr {
+
+/// Helper class to import existing host allocation as the buffer memory
+/// (with VK_EXT_external_memory_host), so that the device accesses the host data in place.
+/// Import is only possible when the host pointer and size are multiples of
+/// Device::hostImportAlignment() and the host allocation may be imported to a memory type
+/// matching Props. Otherwise memory is allocated with AllocDevice<Props> and the array
+/// owning the buffer is expected to copy the host data (see isImported()).
+/// Host allocation is not owned by the allocator and should outlive the buffer.
+/// Binding between memory and buffer is done elsewhere.
+template<class Props>
+class AllocHostImport {
+public:
+	using properties_t = Props;
+	using AllocFallback = AllocDevice<Props>; ///< allocator used when host memory can not be imported
+
+	/// Constructor. Default-constructed allocator never imports anything.
+	explicit AllocHostImport(void* host_ptr=nullptr    ///< beginning of the host allocation to import
+	                         , std::size_t size_bytes=0 ///< size (bytes) of the host allocation
+	                         )
+	   : _host_ptr(host_ptr), _host_size(size_bytes)
+	{}
+
+	/// Create buffer on a device.
+	/// Buffer is made compatible with imported host memory when the device supports the import.
+	/// Transfer usage flags are always added, so that the array can be copied to/from in place.
+	static auto makeBuffer(vuh::Device& device   ///< device to create buffer on
+	                      , size_t size_bytes    ///< desired size in bytes
+	                      , vk::BufferUsageFlags flags ///< additional (to the ones defined in Props) buffer usage flags
+	                      )-> vk::Buffer
+	{
+		const auto flags_combined = flags | vk::BufferUsageFlags(Props::buffer)
+		                            | vk::BufferUsageFlagBits::eTransferSrc
+		                            | vk::BufferUsageFlagBits::eTransferDst;
+		auto info = vk::BufferCreateInfo({}, size_bytes, flags_combined);
+#ifdef VK_EXT_external_memory_host
+		auto external = VkExternalMemoryBufferCreateInfo{};
+		if(device.hostImportAlignment() != 0){
+			external.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+			external.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+			info.pNext = &external;
+		}
+#endif
+		return device.createBuffer(info);
+	}
+
+	/// Import host allocation as the buffer memory.
+	/// Allocate memory with the fallback allocator if that is not possible.
+	auto allocMemory(vuh::Device& device  ///< device to allocate memory
+	                 , vk::Buffer buffer  ///< buffer to allocate memory for
+	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional (to the ones defined in Props) memory property flags
+	                 )-> vk::DeviceMemory
+	{
+		_imported = false;
+		if(_host_ptr == nullptr){ // nothing to import, not a fallback
+			auto mem = _fallback.allocMemory(device, buffer, flags_memory);
+			_memid = _fallback.memId();
+			return mem;
+		}
+		const auto memid = importMemoryType(device, buffer, flags_memory);
+		if(memid != uint32_t(-1)){
+			try {
+				auto mem = device.importHostMemory(_host_ptr, _host_size, memid);
+				_memid = memid;
+				_imported = true;
+				return mem;
+			} catch(vk::Error& e){
+				device.instance().report("AllocHostImport failed to import host memory", e.what()
+				                         , VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT);
+			}
+		}
+		device.instance().report("AllocHostImport could not import host memory, data will be copied"
+		                         , " ", VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT);
+		device.memoryStats().onFallback();
+		auto mem = _fallback.allocMemory(device, buffer, flags_memory);
+		_memid = _fallback.memId();
+		return mem;
+	}
+
+	/// @return memory id on which actual allocation took place.
+	auto memId() const-> uint32_t {
+		assert(_memid != uint32_t(-1)); // should only be called after successful allocMemory() call
+		return _memid;
+	}
+
+	/// @return memory property flags of the memory on which actual allocation took place.
+	auto memoryProperties(vuh::Device& device) const-> vk::MemoryPropertyFlags {
+		return device.memoryProperties(_memid);
+	}
+
+	/// @return offset (bytes) of the buffer memory wrt the beginning of allocated memory chunk.
+	/// Imported memory is not shared between buffers so this is always 0.
+	auto offset() const-> std::size_t { return 0; }
+
+	/// @return true if memory was allocated as dedicated to the buffer.
+	auto isDedicated() const-> bool { return !_imported && _fallback.isDedicated(); }
+
+	/// @return true if host allocation was imported, false if memory was allocated by the fallback.
+	auto isImported() const-> bool { return _imported; }
+
+	/// Noop. Memory is never moved.
+	auto track(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	           , uint64_t&, std::size_t, vk::BufferUsageFlags) noexcept-> void {}
+
+	/// Noop. Memory is never moved.
+	auto retrack(vuh::Device&, vk::Buffer&, vk::DeviceMemory&, vk::MemoryPropertyFlags&, void*&
+	             , uint64_t&) noexcept-> void {}
+
+	/// Noop. Memory is never moved.
+	auto touch(vuh::Device&, vk::DeviceMemory) const-> void {}
+
+	/// Noop. Memory is never moved.
+	auto untrack(vuh::Device&, vk::DeviceMemory) noexcept-> void {}
+
+	/// Release memory previously allocated with allocMemory().
+	/// Imported host allocation itself is left intact.
+	auto freeMemory(vuh::Device& device, vk::DeviceMemory memory) noexcept-> void {
+		device.freeMemory(memory);
+	}
+
+	/// Map the allocated memory to host address space.
+	/// For imported memory that is the original host pointer. Non-coherent imported memory
+	/// is additionally mapped through the device, so that it can be flushed and invalidated.
+	/// @pre memory should be host-visible
+	auto mapMemory(vuh::Device& device, vk::DeviceMemory memory, std::size_t size_bytes
+	               ) const-> void*
+	{
+		if(!_imported){
+			return _fallback.mapMemory(device, memory, size_bytes);
+		}
+		if(!(device.memoryProperties(_memid) & vk::MemoryPropertyFlagBits::eHostCoherent)){
+			device.mapMemory(memory, 0, size_bytes);
+		}
+		return _host_ptr;
+	}
+
+	/// Unmap memory previously mapped with mapMemory().
+	auto unmapMemory(vuh::Device& device, vk::DeviceMemory memory) const noexcept-> void {
+		if(!_imported || !(device.memoryProperties(_memid) & vk::MemoryPropertyFlagBits::eHostCoherent)){
+			device.unmapMemory(memory);
+		}
+	}
+private: // helpers
+	/// @return id of the memory type the host allocation may be imported to for the given buffer,
+	/// -1 if it can not be imported. Host-coherent memory types are preferred.
+	auto importMemoryType(const vuh::Device& device, vk::Buffer buffer
+	                      , vk::MemoryPropertyFlags flags_memory) const-> uint32_t
+	{
+		const auto alignment = device.hostImportAlignment();
+		if(alignment == 0 || _host_size == 0 || _host_size % alignment != 0){
+			return uint32_t(-1);
+		}
+		const auto reqs = device.getBufferMemoryRequirements(buffer);
+		if(reqs.size > _host_size){
+			return uint32_t(-1);
+		}
+		const auto types = reqs.memoryTypeBits & device.hostPointerMemoryTypes(_host_ptr);
+		const auto flags = vk::MemoryPropertyFlags(Props::memory) | flags_memory;
+		auto r = uint32_t(-1);
+		for(uint32_t i = 0; i < device.memoryProperties().memoryTypeCount; ++i){
+			const auto props = device.memoryProperties(i);
+			if(!(types & (1u << i)) || (props & flags) != flags){
+				continue;
+			}
+			if(props & vk::MemoryPropertyFlagBits::eHostCoherent){
+				return i;
+			}
+			if(r == uint32_t(-1)){
+				r = i;
+			}
+		}
+		return r;
+	}
+private: // data
+	void* _host_ptr;                ///< host allocation to import
+	std::size_t _host_size;         ///< size (bytes) of the host allocation
+	AllocFallback _fallback;        ///< allocator used when import is not possible
+	uint32_t _memid = uint32_t(-1); ///< allocated memory id
+	bool _imported = false;         ///< true if host allocation was imported
+}; // class AllocHostImport
+} // namespace arr
+} // namespace vuh
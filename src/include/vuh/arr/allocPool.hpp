@@ -0,0 +1,151 @@
+#pragma once
+
+#include "allocDevice.hpp"
+#include "memoryPool.h"
+
+#include <vuh/device.h>
+#include <vuh/error.h>
+#include <vuh/instance.h>
+#include <vuh/memoryStats.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <cassert>
+
+namespace vuh {
+namespace arr {
+
+/// Helper class to sub-allocate memory from the device memory pool (see MemoryPool)
+/// and initialize the buffer.
+/// Buffers allocated this way share big memory blocks, so that creating and destroying
+/// the array does not normally result in actual device memory (de)allocation.
+/// Huge buffers and the ones the driver prefers to keep in memory of their own
+/// (see Device::useDedicated()) get a dedicated block instead.
+/// Binding between memory and buffer is done elsewhere.
+template<class Props>
+class AllocPool {
+public:
+	using properties_t = Props;
+	using AllocFallback = AllocPool<typename Props::fallback_t>; ///< fallback allocator
+
+	/// Create buffer on a device.
+	static auto makeBuffer(vuh::Device& device   ///< device to create buffer on
+	                      , size_t size_bytes    ///< desired size in bytes
+	                      , vk::BufferUsageFlags flags ///< additional (to the ones defined in Props) buffer usage flags
+	                      )-> vk::Buffer
+	{
+		return AllocDevice<Props>::makeBuffer(device, size_bytes, flags);
+	}
+
+	/// Sub-allocate memory for the buffer from the device memory pool.
+	/// @return handle to memory block the buffer should be bound to (at offset()).
+	auto allocMemory(vuh::Device& device  ///< device to allocate memory
+	                 , vk::Buffer buffer  ///< buffer to allocate memory for
+	                 , vk::MemoryPropertyFlags flags_memory={} ///< additional (to the ones defined in Props) memory property flags
+	                 )-> vk::DeviceMemory
+	{
+		const auto memid = AllocDevice<Props>::findMemory(device, buffer, flags_memory);
+		try{
+			const auto reqs = device.bufferRequirements(buffer);
+			_allocation = device.memoryPool().allocate(device, memid, reqs.memory
+			                                  , device.useDedicated(reqs) ? buffer : vk::Buffer{});
+		} catch (vk::Error& e){
+			auto allocFallback = AllocFallback{};
+			device.instance().report("AllocPool failed to allocate memory, using fallback", e.what()
+			                         , VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT);
+			device.memoryStats().onFallback();
+			allocFallback.allocMemory(device, buffer, flags_memory);
+			_allocation = allocFallback.allocation();
+		}
+		return _allocation.memory;
+	}
+
+	/// @return memory id on which actual allocation took place.
+	auto memId() const-> uint32_t {
+		assert(_allocation); // should only be called after successful allocMemory() call
+		return _allocation.memid;
+	}
+
+	/// @return memory property flags of the memory on which actual allocation took place.
+	auto memoryProperties(vuh::Device& device) const-> vk::MemoryPropertyFlags {
+		return device.memoryProperties(memId());
+	}
+
+	/// @return offset (bytes) of the buffer memory wrt the beginning of the pool memory block.
+	auto offset() const-> std::size_t { return _allocation.offset; }
+
+	/// @return pool allocation record
+	auto allocation() const-> const MemoryPool::Allocation& { return _allocation; }
+
+	/// @return true if buffer got a dedicated block instead of being sub-allocated
+	auto isDedicated() const-> bool { return _allocation.dedicated; }
+
+	/// Register the buffer owner with the pool, so that MemoryPool::defragment() may relocate
+	/// the buffer updating owner's handles.
+	auto track(vuh::Device& device, vk::Buffer& buffer, vk::DeviceMemory& memory
+	           , vk::MemoryPropertyFlags&, void*&, uint64_t& last_use
+	           , std::size_t size_bytes     ///< buffer size in bytes
+	           , vk::BufferUsageFlags flags ///< additional (to the ones defined in Props) buffer usage flags
+	           ) noexcept-> void
+	{
+		if(_allocation){
+			device.memoryPool().track(_allocation, {&buffer, &memory, &_allocation, &last_use}, size_bytes
+			                          , flags | vk::BufferUsageFlags(Props::buffer));
+		}
+	}
+
+	/// Update the owner handles locations registered with track() after the owner was moved.
+	auto retrack(vuh::Device& device, vk::Buffer& buffer, vk::DeviceMemory& memory
+	             , vk::MemoryPropertyFlags&, void*&, uint64_t& last_use) noexcept-> void
+	{
+		if(_allocation){
+			device.memoryPool().retrack(_allocation, {&buffer, &memory, &_allocation, &last_use});
+		}
+	}
+
+	/// Noop. Pool memory is compacted with MemoryPool::defragment() instead of being evicted.
+	auto touch(vuh::Device&, vk::DeviceMemory) const-> void {}
+
+	/// Stop updating the handles registered with track(), so that defragmentation leaves
+	/// the chunk in place till it is released.
+	auto untrack(vuh::Device& device, vk::DeviceMemory) noexcept-> void {
+		if(_allocation){
+			device.memoryPool().retrack(_allocation, {});
+		}
+	}
+
+	/// Return memory to the pool.
+	auto freeMemory(vuh::Device& device, vk::DeviceMemory) noexcept-> void {
+		if(_allocation){
+			device.memoryPool().free(device, _allocation);
+			_allocation = {};
+		}
+	}
+
+	/// @return host pointer to the beginning of buffer memory.
+	/// The whole pool block is mapped (once) and stays mapped while it exists.
+	/// @pre memory should be host-visible
+	auto mapMemory(vuh::Device& device, vk::DeviceMemory, std::size_t) const-> void* {
+		return device.memoryPool().map(device, _allocation);
+	}
+
+	/// Noop. Pool blocks stay mapped during their lifetime.
+	auto unmapMemory(vuh::Device&, vk::DeviceMemory) const noexcept-> void {}
+private: // data
+	MemoryPool::Allocation _allocation; ///< memory chunk sub-allocated from the pool
+}; // class AllocPool
+
+/// Specialize pool allocator for void properties type.
+/// Calls to this class methods basically means all other failed and nothing can be done.
+template<>
+class AllocPool<void>: public AllocDevice<void> {
+public:
+	/// @throw std::logic_error
+	/// Should not normally be called.
+	auto allocation() const-> const MemoryPool::Allocation& {
+		throw std::logic_error("this function is not supposed to be called");
+	}
+}; // class AllocPool<void>
+
+} // namespace arr
+} // namespace vuh
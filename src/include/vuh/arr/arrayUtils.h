@@ -4,13 +4,56 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <cstddef>
+#include <functional>
+#include <vector>
+
 namespace vuh{
+	class MappedFile;
 namespace arr {
+	/// Max size (bytes) of a single region of the buffer copy command.
+	/// Bigger copies are recorded as several consecutive regions (see copyRegions()).
+	constexpr std::size_t max_copy_region = std::size_t(1) << 30;
+
+	auto copyRegions(std::size_t src_offset, std::size_t dst_offset, std::size_t size_bytes
+	                 )-> std::vector<vk::BufferCopy>;
 	auto copyBuf(vuh::Device& device
 	             , vk::Buffer src, vk::Buffer dst
 	             , size_t size_bytes
 	             , size_t src_offset=0
 	             , size_t dst_offset=0
 	             )-> void;
+
+	/// Callable filling the staging memory: (destination pointer, offset of the chunk wrt the
+	/// beginning of transfer (bytes), chunk size (bytes)).
+	using stream_fill_t = std::function<void(void*, std::size_t, std::size_t)>;
+	/// Callable consuming the staging memory: (source pointer, offset of the chunk wrt the
+	/// beginning of transfer (bytes), chunk size (bytes)).
+	using stream_drain_t = std::function<void(const void*, std::size_t, std::size_t)>;
+
+	auto streamChunkSize(const StagingRing& ring, std::size_t granularity)-> std::size_t;
+	auto streamToDevice(vuh::Device& device
+	                    , vk::Buffer dst, std::size_t dst_offset
+	                    , std::size_t size_bytes
+	                    , std::size_t granularity
+	                    , const stream_fill_t& fill
+	                    )-> void;
+	auto streamToHost(vuh::Device& device
+	                  , vk::Buffer src, std::size_t src_offset
+	                  , std::size_t size_bytes
+	                  , std::size_t granularity
+	                  , const stream_drain_t& drain
+	                  )-> void;
+	auto fileToDevice(vuh::Device& device
+	                  , const vuh::MappedFile& src
+	                  , vk::Buffer dst, std::size_t dst_offset
+	                  , std::size_t granularity
+	                  )-> void;
+	auto deviceToFile(vuh::Device& device
+	                  , vk::Buffer src, std::size_t src_offset
+	                  , const vuh::MappedFile& dst
+	                  , std::size_t size_bytes
+	                  , std::size_t granularity
+	                  )-> void;
 } // namespace arr
 } // namespace vuh
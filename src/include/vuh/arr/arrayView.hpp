@@ -20,6 +20,8 @@ namespace vuh {
 
 		/// @return reference to Vulkan buffer of the corresponding array
 		auto buffer()-> vk::Buffer& { return *_array; }
+		/// @return reference to the underlying array
+		auto array()-> Array& { return *_array; }
 		/// @return offset (number of elements) of the beggining of the span wrt to buffer
 		auto offset() const-> std::size_t {return _offset_begin;}
 		/// @return number of elements in the view
@@ -32,6 +34,33 @@ namespace vuh {
 		std::size_t _offset_end;   ///< offset (number of array elements) of the end (one past the last valid elements) of the span.
 	}; // class ArrayView
 
+	/// Host-side view into the continuous mapped memory of some array.
+	/// Does not own the data, and is only valid while the array it was taken from is alive.
+	template<class T>
+	class HostSpan {
+	public:
+		using value_type = T;
+
+		/// Constructor
+		HostSpan(T* data, std::size_t size): _data(data), _size(size) {}
+
+		/// @return pointer to the beginning of the span data
+		auto data() const-> T* { return _data; }
+		/// @return iterator to the beginning of the span
+		auto begin() const-> T* { return _data; }
+		/// @return iterator to the end (one past the last element) of the span
+		auto end() const-> T* { return _data + _size; }
+		/// @return number of elements in the span
+		auto size() const-> std::size_t { return _size; }
+		/// @return number of bytes in the span
+		auto size_bytes() const-> std::size_t { return _size*sizeof(T); }
+		/// Element access operator
+		auto operator[](std::size_t i) const-> T& { assert(i < _size); return _data[i]; }
+	private: // data
+		T* _data;          ///< host pointer to the beginning of the span
+		std::size_t _size; ///< number of elements in the span
+	}; // class HostSpan
+
 	/// Create a ArrayView into given Array.
 	template<class Array>
 	auto array_view(Array& array, std::size_t offset_begin, size_t offset_end)-> ArrayView<Array>{
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "allocDevice.hpp"
+#include "allocExternal.hpp"
+#include "mappedRanges.h"
 
 #include <vuh/device.h>
+#include <vuh/memoryStats.h>
+#include <vuh/releaseQueue.h>
 
 #include <vulkan/vulkan.hpp>
 
 #include <cassert>
+#include <chrono>
+#include <exception>
+#include <stdint.h>
 
 namespace vuh {
 namespace arr {
@@ -14,6 +21,11 @@ namespace arr {
 /// Covers basic array functionality. Wraps the SBO buffer.
 /// Keeps the data, handles initialization, copy/move, common interface,
 /// binding memory to buffer objects, etc...
+/// For arrays in host-visible non-coherent memory keeps track of ranges written by host
+/// but not yet flushed, and of ranges written by device but not yet invalidated,
+/// so that those are made visible with a single call at the sync point.
+/// Array destroyed while still in use by an async submission is released only after that
+/// completes (see ReleaseQueue), so that destruction never blocks.
 template<class Alloc>
 class BasicArray: public vk::Buffer {
 	static constexpr auto descriptor_flags = vk::BufferUsageFlagBits::eStorageBuffer;
@@ -26,14 +38,37 @@ public:
 	           , vk::MemoryPropertyFlags properties={} ///< additional memory property flags. These are 'added' to flags defind by allocator.
 	           , vk::BufferUsageFlags usage={}         ///< additional usage flagsws. These are 'added' to flags defined by allocator.
 	           )
+	   : BasicArray(Alloc(), device, size_bytes, properties, usage)
+	{}
+
+	/// Construct SBO array of given size in memory provided by the given allocator instance.
+	BasicArray(Alloc alloc                             ///< allocator to take memory from
+	           , vuh::Device& device                   ///< device to allocate array
+	           , size_t size_bytes                     ///< desired size in bytes
+	           , vk::MemoryPropertyFlags properties={} ///< additional memory property flags. These are 'added' to flags defind by allocator.
+	           , vk::BufferUsageFlags usage={}         ///< additional usage flagsws. These are 'added' to flags defined by allocator.
+	           )
 	   : vk::Buffer(Alloc::makeBuffer(device, size_bytes, descriptor_flags | usage))
-	   , _dev(device)
+	   , _alloc(std::move(alloc))
+	   , _dev(&device)
    {
       try{
-         auto alloc = Alloc();
-         _mem = alloc.allocMemory(device, *this, properties);
-         _flags = alloc.memoryProperties(device);
-         _dev.bindBufferMemory(*this, _mem, 0);
+         const auto start = std::chrono::steady_clock::now();
+         _mem = _alloc.allocMemory(device, *this, properties);
+         const auto latency = std::chrono::steady_clock::now() - start;
+         _flags = _alloc.memoryProperties(device);
+         _dev->bindBufferMemory(*this, _mem, _alloc.offset());
+         _alloc.track(device, *this, _mem, _flags, _mapped, _last_use, size_bytes
+                      , descriptor_flags | usage);
+         // ranges are rounded to nonCoherentAtomSize. Allocators round non-coherent allocations
+         // to that size, so rounded range never leaves the array's own memory chunk.
+         if(isHostVisible() && !(_flags & vk::MemoryPropertyFlagBits::eHostCoherent)){
+            const auto atom = std::size_t(_dev->mapAlignment(_alloc.memId()));
+            _dirty = MappedRanges(atom);
+            _stale = MappedRanges(atom);
+         }
+         _dev->memoryStats().onAllocate(_alloc.memId(), size_bytes, latency);
+         _size_bytes = size_bytes;
       } catch(std::runtime_error&){ // destroy buffer if memory allocation was not successful
          release();
          throw;
@@ -48,26 +83,75 @@ public:
 
 	/// Move constructor. Passes the underlying buffer ownership.
 	BasicArray(BasicArray&& other) noexcept
-	   : vk::Buffer(other), _mem(other._mem), _flags(other._flags), _dev(other._dev)
+	   : vk::Buffer(other), _mem(other._mem), _flags(other._flags), _alloc(other._alloc), _dev(other._dev)
+	   , _dirty(std::move(other._dirty)), _stale(std::move(other._stale)), _size_bytes(other._size_bytes)
+	   , _last_use(other._last_use), _mapped(other._mapped)
 	{
 		static_cast<vk::Buffer&>(other) = nullptr;
+		other._mapped = nullptr;
+		retrack();
 	}
 
 	/// @return underlying buffer
 	auto buffer()-> vk::Buffer { return *this; }
 
-	/// @return offset of the current buffer from the beginning of associated device memory.
+	/// @return offset (bytes) of the current buffer from the beginning of associated device memory.
 	/// For arrays managing their own memory this is always 0.
-	auto offset() const-> std::size_t { return 0;}
+	auto offset() const-> std::size_t { return _alloc.offset();}
+
+	/// @return true if the buffer has a dedicated memory allocation of its own
+	/// (as opposed to memory shared with other buffers or a plain allocation).
+	auto isDedicated() const-> bool { return _alloc.isDedicated(); }
+
+	/// Export the array memory to be imported by other processes (see AllocExternal).
+	/// Only available with allocators allocating shareable memory.
+	auto exportMemory() const-> ExternalMemory {
+		return _alloc.exportMemory(*_dev, _mem, _size_bytes);
+	}
 
 	/// @return reference to device on which underlying buffer is allocated
-	auto device()-> vuh::Device& { return _dev; }
+	auto device()-> vuh::Device& { return *_dev; }
+
+	/// @return memory property flags of the memory array is allocated in.
+	auto memoryProperties() const-> vk::MemoryPropertyFlags { return _flags; }
 
 	/// @return true if array is host-visible, ie can expose its data via a normal host pointer.
 	auto isHostVisible() const-> bool {
 		return bool(_flags & vk::MemoryPropertyFlagBits::eHostVisible);
 	}
 
+	/// Sync point before the device access to array memory.
+	/// Flushes all host writes recorded since the last sync point with a single call.
+	/// Noop for host-coherent (and not host-visible) memory.
+	auto flushHostWrites() const-> void {
+		if(!_dirty.empty()){
+			_dev->flushMappedMemoryRanges(_dirty.ranges(_mem, _alloc.offset()));
+			_dirty.clear();
+		}
+	}
+
+	/// Record the device write to the byte range of array memory.
+	/// The range is invalidated at the next host access to the array data.
+	/// Noop for host-coherent (and not host-visible) memory.
+	auto markDeviceWrite(std::size_t offset_bytes, std::size_t size_bytes) const-> void {
+		if(!(_flags & vk::MemoryPropertyFlagBits::eHostCoherent) && isHostVisible()){
+			_stale.add(offset_bytes, size_bytes);
+		}
+	}
+
+	/// Mark the array as just used by the device. Array is tagged with the upcoming submission,
+	/// so that its release is postponed till that completes.
+	/// Array evicted by the device residency manager is restored to device memory, which changes
+	/// its buffer handle, so this should be called before the buffer is recorded to commands
+	/// or bound to a kernel. Programs bound to the array touch it on every run, and record their
+	/// commands anew if it was moved since.
+	auto touch() const-> void {
+		if(static_cast<const vk::Buffer&>(*this)){
+			_alloc.touch(*_dev, _mem); // relocation waits for the previous use
+			_last_use = _dev->releaseQueue().nextSerial();
+		}
+	}
+
 	/// Move assignment. 
 	/// Resources associated with current array are released immidiately (and not when moved from
 	/// object goes out of scope).
@@ -75,32 +159,144 @@ public:
 		release();
 		_mem = other._mem;
 		_flags = other._flags;
+		_alloc = other._alloc;
 		_dev = other._dev;
+		_dirty = std::move(other._dirty);
+		_stale = std::move(other._stale);
+		_size_bytes = other._size_bytes;
+		_last_use = other._last_use;
+		_mapped = other._mapped;
 		reinterpret_cast<vk::Buffer&>(*this) = reinterpret_cast<vk::Buffer&>(other);
 		reinterpret_cast<vk::Buffer&>(other) = nullptr;
+		other._mapped = nullptr;
+		retrack();
 		return *this;
 	}
 	
 	/// swap the guts of two basic arrays
 	auto swap(BasicArray& other) noexcept-> void {
 		using std::swap;
-		swap(static_cast<vk::Buffer&>(&this), static_cast<vk::Buffer&>(other));
+		swap(static_cast<vk::Buffer&>(*this), static_cast<vk::Buffer&>(other));
 		swap(_mem, other._mem);
 		swap(_flags, other._flags);
+		swap(_alloc, other._alloc);
 		swap(_dev, other._dev);
+		swap(_dirty, other._dirty);
+		swap(_stale, other._stale);
+		swap(_size_bytes, other._size_bytes);
+		swap(_last_use, other._last_use);
+		swap(_mapped, other._mapped);
+		retrack();
+		other.retrack();
+	}
+protected: // helpers
+	/// @return host pointer to the beginning of array memory.
+	/// Memory is mapped on the first call and stays mapped till unmapMemory() is called,
+	/// the array is released or its memory is moved by the residency manager.
+	/// @pre array memory should be host-visible
+	auto mapMemory(std::size_t size_bytes) const-> void* {
+		assert(isHostVisible());
+		if(!_mapped){
+			_mapped = _alloc.mapMemory(*_dev, _mem, size_bytes);
+		}
+		return _mapped;
+	}
+
+	/// Unmap memory previously mapped with mapMemory(). Noop if memory is not mapped.
+	auto unmapMemory() const noexcept-> void {
+		if(_mapped){
+			_alloc.unmapMemory(*_dev, _mem);
+			_mapped = nullptr;
+		}
+	}
+
+	/// Make host writes to the given byte range of the mapped array memory available to the device.
+	/// Other pending host writes are flushed with the same call.
+	/// Noop for host-coherent memory.
+	auto flushMemory(std::size_t offset_bytes, std::size_t size_bytes) const-> void {
+		markHostWrite(offset_bytes, size_bytes);
+		flushHostWrites();
+	}
+
+	/// Make device writes to the given byte range of the array memory visible to the host.
+	/// Other pending device writes are invalidated with the same call.
+	/// Noop for host-coherent memory.
+	auto invalidateMemory(std::size_t offset_bytes, std::size_t size_bytes) const-> void {
+		markDeviceWrite(offset_bytes, size_bytes);
+		invalidateDeviceWrites();
+	}
+
+	/// Record the host write to the byte range of mapped array memory.
+	/// The range is flushed at the next sync point (see flushHostWrites()).
+	/// Noop for host-coherent memory.
+	auto markHostWrite(std::size_t offset_bytes, std::size_t size_bytes) const-> void {
+		if(!(_flags & vk::MemoryPropertyFlagBits::eHostCoherent)){
+			_dirty.add(offset_bytes, size_bytes);
+		}
+	}
+
+	/// Sync point before the host access to mapped array memory.
+	/// Invalidates all device writes recorded since the last sync point with a single call.
+	/// Noop for host-coherent memory.
+	auto invalidateDeviceWrites() const-> void {
+		if(!_stale.empty()){
+			_dev->invalidateMappedMemoryRanges(_stale.ranges(_mem, _alloc.offset()));
+			_stale.clear();
+		}
 	}
 private: // helpers
-	/// release resources associated with current BasicArray object
+	/// Let the allocator know the new location of the buffer and memory handles.
+	auto retrack() noexcept-> void {
+		if(static_cast<vk::Buffer&>(*this)){
+			_alloc.retrack(*_dev, *this, _mem, _flags, _mapped, _last_use);
+		}
+	}
+
+	/// release resources associated with current BasicArray object.
+	/// If the array is still in use by the device the release is postponed.
 	auto release() noexcept-> void {
 		if(static_cast<vk::Buffer&>(*this)){
-			_dev.freeMemory(_mem);
-			_dev.destroyBuffer(*this);
+			unmapMemory();
+			auto& releases = _dev->releaseQueue();
+			if(!releases.isComplete(_last_use)){
+				try {
+					_alloc.untrack(*_dev, _mem); // memory should not be moved any more
+					releases.defer(_last_use, Release{_alloc, _mem, *this, _size_bytes});
+					return;
+				} catch(std::exception&) { // could not postpone, wait for the device instead
+					releases.wait(*_dev, _last_use);
+				}
+			}
+			Release{_alloc, _mem, *this, _size_bytes}(*_dev);
 		}
 	}
+
+	/// Resources of the array to be released.
+	struct Release {
+		Alloc alloc;             ///< allocator of the array memory
+		vk::DeviceMemory memory; ///< array memory
+		vk::Buffer buffer;       ///< array buffer
+		std::size_t size_bytes;  ///< buffer size accounted in device memory stats, 0 if not accounted
+
+		/// Release the resources.
+		auto operator()(vuh::Device& device) noexcept-> void {
+			if(size_bytes != 0){ // only arrays constructed successfully are accounted
+				device.memoryStats().onFree(alloc.memId(), size_bytes);
+			}
+			alloc.freeMemory(device, memory);
+			device.destroyBuffer(buffer);
+		}
+	}; // struct Release
 protected: // data
 	vk::DeviceMemory _mem;           ///< associated chunk of device memory
 	vk::MemoryPropertyFlags _flags;  ///< actual flags of allocated memory (may differ from those requested)
-	vuh::Device& _dev;               ///< referes underlying logical device
+	Alloc _alloc;                    ///< allocator keeping track of the buffer memory
+	vuh::Device* _dev;               ///< referes underlying logical device
+	mutable MappedRanges _dirty;     ///< host writes pending flush (non-coherent memory only)
+	mutable MappedRanges _stale;     ///< device writes pending invalidation (non-coherent memory only)
+	std::size_t _size_bytes = 0;     ///< buffer size accounted in device memory stats, 0 if not accounted
+	mutable uint64_t _last_use = 0;  ///< release queue number of the last submission using the array, 0 if none
+	mutable void* _mapped = nullptr; ///< host pointer to mapped array memory, nullptr if not mapped (yet)
 }; // class BasicArray
 } // namespace arr
 } // namespace vuh
@@ -1,16 +1,138 @@
 #pragma once
 
 #include "arrayIter.hpp"
+#include "arrayUtils.h"
 #include "deviceArray.hpp"
+#include "mappedCopy.h"
+#include "packedArray.hpp"
+#include "stagingRing.h"
 #include <vuh/delayed.hpp>
+#include <vuh/mappedFile.h>
+#include <vuh/pinnedAllocator.hpp>
 #include <vuh/traits.hpp>
 #include <vuh/resource.hpp>
+#include <vuh/workerPool.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace vuh {
+	/// Tag selecting the copy_async() overloads running the host-side stages of the transfer
+	/// on the device worker pool (see Device::workerPool()).
+	struct host_async_t {};
+	constexpr host_async_t host_async{};
+
+	/// Copies between device arrays to be made with a single submission (see copy_async(CopyBatch&&)).
+	/// All copies are recorded to one command buffer, as a single multi-region copy command
+	/// per pair of buffers, and are waited for with a single fence.
+	/// Copies of the batch are not ordered wrt each other, so destination ranges should not
+	/// overlap with any other range of the batch.
+	/// Arrays should be allocated on the batch device and outlive the batch.
+	class CopyBatch {
+	public:
+		/// Constructor. Makes an empty batch of copies on the given device.
+		explicit CopyBatch(vuh::Device& device): _device(&device) {}
+
+		/// Add copy of the range of one array to another array (may be the same one) to the batch.
+		template<class Array1, class Array2>
+		auto add(ArrayIter<Array1> src_begin, ArrayIter<Array1> src_end
+		         , ArrayIter<Array2> dst_begin
+		         )-> CopyBatch&
+		{
+			using value_type_src = typename ArrayIter<Array1>::value_type;
+			using value_type_dst = typename ArrayIter<Array2>::value_type;
+			static_assert(std::is_same<value_type_src, value_type_dst>::value
+			              , "array value types should be the same");
+			static constexpr auto tsize = sizeof(value_type_src);
+			assert(*_device == src_begin.array().device());
+			assert(*_device == dst_begin.array().device());
+
+			const auto size_bytes = tsize*std::size_t(src_end - src_begin);
+			if(size_bytes == 0){
+				return *this;
+			}
+			const auto& src = src_begin.array();
+			const auto& dst = dst_begin.array();
+			src.flushHostWrites();
+			dst.markDeviceWrite(tsize*dst_begin.offset(), size_bytes);
+			_copies.push_back(Region{&src, &dst, &touch<Array1>, &touch<Array2>
+			                         , tsize*src_begin.offset(), tsize*dst_begin.offset(), size_bytes});
+			return *this;
+		}
+
+		/// @return number of copies in the batch
+		auto size() const-> std::size_t { return _copies.size(); }
+
+		/// @return true if the batch has no copies
+		auto empty() const-> bool { return _copies.empty(); }
+
+		/// @return device the batch copies are made on
+		auto device() const-> vuh::Device& { return *_device; }
+
+		/// Record all copies of the batch to the command buffer.
+		/// Arrays are marked used first, since that may change their buffer handles
+		/// (see BasicArray::touch()), so this should be called right before the submission.
+		auto record(vk::CommandBuffer cmd_buffer) const-> void {
+			for(const auto& c: _copies){
+				c.touch_src(c.src);
+				c.touch_dst(c.dst);
+			}
+			auto order = std::vector<const Region*>{};
+			order.reserve(_copies.size());
+			for(const auto& c: _copies){
+				order.push_back(&c);
+			}
+			const auto less = std::less<VkBuffer>{};
+			std::stable_sort(begin(order), end(order), [&less](const Region* r1, const Region* r2){
+				const auto src1 = static_cast<VkBuffer>(*r1->src);
+				const auto src2 = static_cast<VkBuffer>(*r2->src);
+				return less(src1, src2)
+				       || (src1 == src2 && less(static_cast<VkBuffer>(*r1->dst)
+				                                , static_cast<VkBuffer>(*r2->dst)));
+			});
+
+			auto regions = std::vector<vk::BufferCopy>{};
+			for(auto it = begin(order); it != end(order);){
+				const auto src = *(*it)->src;
+				const auto dst = *(*it)->dst;
+				regions.clear();
+				for(; it != end(order) && *(*it)->src == src && *(*it)->dst == dst; ++it){
+					const auto r = arr::copyRegions((*it)->src_offset, (*it)->dst_offset, (*it)->size_bytes);
+					regions.insert(end(regions), begin(r), end(r));
+				}
+				cmd_buffer.copyBuffer(src, dst, uint32_t(regions.size()), regions.data());
+			}
+		}
+	private: // helpers
+		/// Mark the array as used (see BasicArray::touch()).
+		template<class Array>
+		static auto touch(const vk::Buffer* array)-> void {
+			static_cast<const Array*>(array)->touch();
+		}
+
+		/// Single copy of the batch.
+		struct Region {
+			const vk::Buffer* src;                ///< source array
+			const vk::Buffer* dst;                ///< destination array
+			void (*touch_src)(const vk::Buffer*); ///< marks the source array used
+			void (*touch_dst)(const vk::Buffer*); ///< marks the destination array used
+			std::size_t src_offset;               ///< offset (bytes) of the source range
+			std::size_t dst_offset;               ///< offset (bytes) of the destination range
+			std::size_t size_bytes;               ///< size (bytes) of the copied range
+		}; // struct Region
+	private: // data
+		vuh::Device* _device;         ///< device the copies are made on
+		std::vector<Region> _copies;  ///< copies in the order they were added
+	}; // class CopyBatch
+
 	namespace detail {
 		/// Command buffer data packed with allocation and deallocation methods.
 		struct _CmdBuffer {
@@ -51,6 +173,9 @@ namespace vuh {
 			/// delayed operation is a noop
 			constexpr auto operator()() const-> void {}
 
+			/// Transfer resources are only to be released, so the copy need not be waited for.
+			constexpr auto releasesOnly() const noexcept-> bool { return true; }
+
 			template<class Array1, class Array2>
 			auto copy_async(ArrayIter<Array1> src_begin, ArrayIter<Array1> src_end
 			                , ArrayIter<Array2> dst_begin
@@ -64,12 +189,72 @@ namespace vuh {
 				              , "array value types should be the same");
 				static constexpr auto tsize = sizeof(value_type_src);
 
+				src_begin.array().touch();
+				dst_begin.array().touch();
+				src_begin.array().flushHostWrites();
+				dst_begin.array().markDeviceWrite(tsize*dst_begin.offset(), tsize*(src_end - src_begin));
+				return copy_async(src_begin.array(), tsize*src_begin.offset()
+				                  , dst_begin.array(), tsize*dst_begin.offset()
+				                  , tsize*(src_end - src_begin));
+			}
+
+			/// Async copy of the range of bytes between two buffers.
+			auto copy_async(vk::Buffer src, std::size_t src_offset
+			                , vk::Buffer dst, std::size_t dst_offset
+			                , std::size_t size_bytes
+			                )-> Delayed<>
+			{
+				assert(device);
 				cmd_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-				auto region = vk::BufferCopy(tsize*src_begin.offset(), tsize*dst_begin.offset()
-				                            , tsize*(src_end - src_begin));
-				cmd_buffer.copyBuffer(src_begin.array(), dst_begin.array(), 1, &region);
+				const auto regions = arr::copyRegions(src_offset, dst_offset, size_bytes);
+				cmd_buffer.copyBuffer(src, dst, uint32_t(regions.size()), regions.data());
 				cmd_buffer.end();
+				return submit();
+			}
+
+			/// Async copy of the range of bytes between two buffers, made once the event is set
+			/// on the host. Host writes made before setting the event are visible to the copy.
+			auto copy_async(vk::Event event
+			                , vk::Buffer src, std::size_t src_offset
+			                , vk::Buffer dst, std::size_t dst_offset
+			                , std::size_t size_bytes
+			                )-> Delayed<>
+			{
+				assert(device);
+				cmd_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+				const auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eHostWrite
+				                                       , vk::AccessFlagBits::eTransferRead);
+				cmd_buffer.waitEvents({event}, vk::PipelineStageFlagBits::eHost
+				                      , vk::PipelineStageFlagBits::eTransfer, {barrier}, nullptr, nullptr);
+				const auto regions = arr::copyRegions(src_offset, dst_offset, size_bytes);
+				cmd_buffer.copyBuffer(src, dst, uint32_t(regions.size()), regions.data());
+				cmd_buffer.end();
+				return submit();
+			}
 
+			/// Async copy of several ranges between two buffers with a single copy command.
+			auto copy_async(vk::Buffer src, vk::Buffer dst, const std::vector<vk::BufferCopy>& regions
+			                )-> Delayed<>
+			{
+				assert(device);
+				cmd_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+				cmd_buffer.copyBuffer(src, dst, uint32_t(regions.size()), regions.data());
+				cmd_buffer.end();
+				return submit();
+			}
+
+			/// Async copy of all ranges of the batch with a single submission.
+			auto copy_async(const CopyBatch& batch)-> Delayed<> {
+				assert(device);
+				assert(*device == batch.device());
+				cmd_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+				batch.record(cmd_buffer);
+				cmd_buffer.end();
+				return submit();
+			}
+		private: // helpers
+			/// Submit the recorded command buffer to the transfer queue.
+			auto submit()-> Delayed<> {
 				auto queue = device->transferQueue();
 				auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmd_buffer);
 				auto fence = device->createFence(vk::FenceCreateInfo());
@@ -79,43 +264,215 @@ namespace vuh {
 			}
 		}; // struct CopyDevice
 
-		/// Keeps the staging array and transfer command buffer alive till async copy completes.
+		/// Keeps the staging chunk and transfer command buffer alive till async copy completes.
+		/// Staging chunk is taken from the upload ring of the device.
 		/// Delayed action is a noop.
-		/// At construction copies the data from host to the staging buffer.
+		/// At construction copies the data from host to the staging chunk.
 		template<class T>
 		struct CopyStageFromHost: public CopyDevice {
-			using StageArray = arr::HostArray<T, arr::AllocDevice<arr::properties::HostCoherent>>;
-			StageArray array; ///< staging buffer
+			arr::StagingRing::Chunk stage; ///< staging memory
 
-			/// Constructor. Copies data from host to the internal staging buffer.
+			/// Constructor. Copies data from host to the staging chunk.
 			template<class Iter1, class Iter2>
 			CopyStageFromHost(vuh::Device& device, Iter1 src_begin, Iter2 src_end)
-				: CopyDevice(device), array(device, src_begin, src_end)
-			{}
+				: CopyDevice(device)
+				, stage(device.uploadRing().acquire(device, std::size_t(src_end - src_begin)*sizeof(T)))
+			{
+				arr::copyToMapped(src_begin, std::size_t(src_end - src_begin), static_cast<T*>(stage.data())
+				                  , stage.memoryProperties());
+				stage.flush();
+			}
+
+			/// Initiate async copy from staging chunk to the device array.
+			template<class Array>
+			auto copy_async(ArrayIter<Array> dst_begin)-> Delayed<> {
+				dst_begin.array().touch();
+				return CopyDevice::copy_async(stage.buffer(), stage.offset(), dst_begin.array()
+				                              , dst_begin.offset()*sizeof(T), stage.size());
+			}
 		}; // struct CopyStageFromHost
 
-		/// Keeps the staging buffer and the transfer command buffer alive till async copy completes.
-		/// Delayed action copies data from staging buffer to the host.
+		/// Keeps the staging chunk and the transfer command buffer alive till async copy completes.
+		/// Staging chunk is taken from the readback ring of the device.
+		/// Delayed action copies data from staging chunk to the host.
 		template<class T, class IterDst>
 		struct CopyStageToHost: CopyDevice {
-			using StageArray = arr::HostArray<T, arr::AllocDevice<arr::properties::HostCached>>;
-			StageArray array;      ///< staging buffer
-			IterDst    dst_begin;  ///< iterator to beginning of the host destination range
+			arr::StagingRing::Chunk stage; ///< staging memory
+			IterDst dst_begin;             ///< iterator to beginning of the host destination range
 
 			/// Constructor.
 			explicit CopyStageToHost(vuh::Device& device, std::size_t array_size, IterDst dst_begin)
-			   : CopyDevice(device), array(device, array_size), dst_begin(dst_begin)
+			   : CopyDevice(device)
+			   , stage(device.readbackRing().acquire(device, array_size*sizeof(T)))
+			   , dst_begin(dst_begin)
 			{}
 
-			/// Delayed action. Copies data from staging buffer to the host.
+			/// Initiate async copy from the device array to staging chunk.
+			template<class Array>
+			auto copy_async(ArrayIter<Array> src_begin, ArrayIter<Array> src_end)-> Delayed<> {
+				src_begin.array().touch();
+				return CopyDevice::copy_async(src_begin.array(), src_begin.offset()*sizeof(T)
+				                              , stage.buffer(), stage.offset()
+				                              , std::size_t(src_end - src_begin)*sizeof(T));
+			}
+
+			/// Data is copied to host at the sync point, so the copy should be waited for.
+			constexpr auto releasesOnly() const noexcept-> bool { return false; }
+
+			/// Delayed action. Copies data from staging chunk to the host.
 			auto operator()() const-> void {
-				using std::begin; using std::end;
-				std::copy(begin(array), end(array), dst_begin);
+				stage.invalidate();
+				arr::copyFromMapped(static_cast<const T*>(stage.data()), stage.size()/sizeof(T), dst_begin
+				                    , stage.memoryProperties());
 			}
 		}; // struct StagedCopy
 
-		/// Delayed action copies data from host-visible device buffer to host.
-		/// Buffer is expected to exist till the copy is complete.
+		/// Keeps the staging chunk and the transfer command buffer of the gathered upload alive
+		/// till async copy completes. Staging chunk is taken from the upload ring of the device,
+		/// and holds the host pieces packed back to back. Delayed action is a noop.
+		struct CopyGather: public CopyDevice {
+			arr::StagingRing::Chunk stage; ///< staging memory
+
+			/// Constructor.
+			CopyGather(vuh::Device& device, std::size_t size_bytes)
+			   : CopyDevice(device), stage(device.uploadRing().acquire(device, size_bytes))
+			{}
+		}; // struct CopyGather
+
+		/// Keeps the staging chunk and the transfer command buffer of the scattered readback alive
+		/// till async copy completes. Staging chunk is taken from the readback ring of the device.
+		/// Delayed action copies the pieces packed back to back in the staging chunk to their
+		/// host destinations.
+		template<class T>
+		struct CopyScatter: public CopyDevice {
+			arr::StagingRing::Chunk stage; ///< staging memory
+			std::vector<HostSpan<T>> dst;  ///< host destinations of the pieces, in staging order
+
+			/// Constructor.
+			CopyScatter(vuh::Device& device, std::size_t size_bytes, std::vector<HostSpan<T>>&& dst)
+			   : CopyDevice(device)
+			   , stage(device.readbackRing().acquire(device, size_bytes))
+			   , dst(std::move(dst))
+			{}
+
+			/// Data is copied to host at the sync point, so the copy should be waited for.
+			constexpr auto releasesOnly() const noexcept-> bool { return false; }
+
+			/// Delayed action. Copies data from staging chunk to the host pieces.
+			auto operator()() const-> void {
+				stage.invalidate();
+				const auto props = stage.memoryProperties();
+				auto src = static_cast<const T*>(stage.data());
+				for(const auto& d: dst){
+					arr::copyFromMapped(src, d.size(), d.data(), props);
+					src += d.size();
+				}
+			}
+		}; // struct CopyScatter
+
+		/// Host stage of the transfer run on the device worker pool (see copy_async() with host_async).
+		/// Kept at a stable address, since the worker refers to it till the stage is complete.
+		/// Destructor waits for the host stage, so that the staging memory and the event are never
+		/// released under the worker.
+		/// Worker never throws, the first error it runs into is kept to be reported at the sync point.
+		struct HostJob {
+			arr::StagingRing::Chunk stage; ///< staging memory
+			vk::Device device;             ///< device the event and the transfer fence belong to
+			vk::Event event;               ///< set on the host once staging memory is filled, empty for transfers to host
+			std::future<void> done;        ///< completion of the host stage
+			std::exception_ptr error;      ///< first exception the host stage ran into, empty if none
+
+			/// Constructor.
+			HostJob(vuh::Device& device, arr::StagingRing::Chunk&& stage)
+			   : stage(std::move(stage)), device(device)
+			{}
+
+			HostJob(const HostJob&) = delete;
+			auto operator= (const HostJob&)-> HostJob& = delete;
+
+			/// Run the step of the host stage on the worker, keeping the exception it may throw.
+			template<class F>
+			auto run(F&& f) noexcept-> void {
+				try {
+					f();
+				} catch(...) {
+					if(!error){
+						error = std::current_exception();
+					}
+				}
+			}
+
+			/// Destructor. Waits for the host stage to complete.
+			~HostJob() noexcept {
+				if(done.valid()){
+					done.wait();
+				}
+				if(event){
+					device.destroyEvent(event);
+				}
+			}
+		}; // struct HostJob
+
+		/// Keeps the transfer command buffer and the host stage of the transfer alive till
+		/// the whole transfer completes. Delayed action waits for the host stage to complete,
+		/// the exception it may have ended with is reported by error() (see Delayed::get()).
+		struct CopyHostAsync: public CopyDevice {
+			std::unique_ptr<HostJob> job; ///< host stage of the transfer
+
+			/// Constructor.
+			CopyHostAsync(vuh::Device& device, arr::StagingRing::Chunk&& stage)
+			   : CopyDevice(device), job(std::make_unique<HostJob>(device, std::move(stage)))
+			{}
+
+			/// Host stage should be complete at the sync point, so the copy should be waited for.
+			constexpr auto releasesOnly() const noexcept-> bool { return false; }
+
+			/// Delayed action. Waits for the host stage to complete.
+			auto operator()() const-> void { job->done.wait(); }
+
+			/// @return exception the host stage ended with, empty if none.
+			/// Waits for the host stage to complete.
+			auto error() const-> std::exception_ptr {
+				if(!job){ // moved from
+					return nullptr;
+				}
+				job->done.wait();
+				return job->error;
+			}
+		}; // struct CopyHostAsync
+
+		/// Element type of the host pieces container (see gather_async(), scatter_async()).
+		template<class Pieces>
+		using piece_value_t = std::remove_const_t<std::remove_pointer_t<
+		                      decltype(std::declval<typename Pieces::value_type&>().data())>>;
+
+		/// Keeps the staging image of the packed array and the transfer command buffer alive
+		/// till async copy completes. Delayed action is a noop.
+		struct CopyPacked: public CopyDevice {
+			std::unique_ptr<arr::StagingRing::Chunk> stage; ///< staging memory
+
+			/// Constructor. Takes over the staging memory.
+			CopyPacked(vuh::Device& device, std::unique_ptr<arr::StagingRing::Chunk>&& stage)
+			   : CopyDevice(device), stage(std::move(stage))
+			{}
+		}; // struct CopyPacked
+
+		/// Delayed action copies data from the packed sub-array to host (with PackedArray::toHost()).
+		/// Array is expected to exist till the copy is complete.
+		template<class T, class Alloc, class IterDst>
+		struct PackedToHost {
+			arr::PackedView<T, Alloc> src;
+			IterDst dst_begin;
+
+			PackedToHost(arr::PackedView<T, Alloc> src, IterDst dst_begin)
+			   : src(src), dst_begin(dst_begin)
+			{}
+
+			auto operator()() const-> void { src.array().toHost(src, dst_begin); }
+		}; // struct PackedToHost
+
+		/// Delayed action copies data from device array to host (with rangeToHost()).
+		/// Array is expected to exist till the copy is complete.
 		template<class IterSrc, class IterDst>
 		struct StdCopy {
 			IterSrc src_begin, src_end;
@@ -135,6 +492,8 @@ namespace vuh {
 		class ICopy{
 		public:
 			virtual auto operator()() const-> void = 0;
+			virtual auto releasesOnly() const-> bool = 0;
+			virtual auto error() const-> std::exception_ptr = 0;
 			virtual ~ICopy() = default;
 		};
 
@@ -145,6 +504,8 @@ namespace vuh {
 		public:
 			CopyWrapper(T&& t): T(std::move(t)) {}
 			auto operator()() const-> void override { return T::operator()();}
+			auto releasesOnly() const-> bool override { return releases_only(static_cast<const T&>(*this), 0); }
+			auto error() const-> std::exception_ptr override { return action_error(static_cast<const T&>(*this), 0); }
 			~CopyWrapper() override = default;
 		};
 	} // namespace detail
@@ -167,6 +528,12 @@ namespace vuh {
 			assert(_obj);
 			(*_obj)();
 		}
+
+		/// @return true if the underlying object only releases resources at the sync point.
+		auto releasesOnly() const-> bool { return _obj && _obj->releasesOnly(); }
+
+		/// @return exception the underlying object ended with, empty if none (see Delayed::get()).
+		auto error() const-> std::exception_ptr { return _obj ? _obj->error() : nullptr; }
 	private:
 		explicit Copy(std::unique_ptr<detail::ICopy>&& ptr): _obj(std::move(ptr)) {}
 	private:
@@ -185,11 +552,176 @@ namespace vuh {
 		                    , Copy::wrap(std::move(copyDevice))};
 	}
 
+	/// Async copy of all ranges of the batch with a single command buffer submission
+	/// and a single fence. Empty batch is a noop.
+	inline auto copy_async(CopyBatch&& batch)-> vuh::Delayed<Copy> {
+		auto& device = batch.device();
+		if(batch.empty()){
+			return Delayed<Copy>{device, Copy::wrap(detail::Noop{})};
+		}
+		auto copyDevice = detail::CopyDevice(device);
+		return Delayed<Copy>{copyDevice.copy_async(batch), Copy::wrap(std::move(copyDevice))};
+	}
+
+	/// Async copy from the memory allocated with pinned_allocator to the array.
+	/// Device reads the pinned memory directly, no staging copy is made.
+	/// Pinned memory should not be modified till the copy is complete.
+	template<class T, class Array>
+	auto copy_async(PinnedSpan<T> src, ArrayIter<Array> dst_begin)-> vuh::Delayed<Copy> {
+		static_assert(std::is_same<T, typename ArrayIter<Array>::value_type>::value
+		              , "array value types should be the same");
+		auto& array = dst_begin.array();
+		array.touch();
+		auto copyDevice = detail::CopyDevice(array.device());
+		array.markDeviceWrite(sizeof(T)*dst_begin.offset(), src.size_bytes());
+		return Delayed<Copy>{copyDevice.copy_async(src.buffer(), src.offset_bytes()
+		                                           , array, sizeof(T)*dst_begin.offset()
+		                                           , src.size_bytes())
+		                    , Copy::wrap(std::move(copyDevice))};
+	}
+
+	/// Async copy from the array to the memory allocated with pinned_allocator.
+	/// Device writes the pinned memory directly, no staging copy is made.
+	/// Data is available on the host as soon as the copy is complete.
+	template<class Array, class T>
+	auto copy_async(ArrayIter<Array> src_begin, ArrayIter<Array> src_end, PinnedSpan<T> dst
+	                )-> vuh::Delayed<Copy>
+	{
+		static_assert(std::is_same<T, typename ArrayIter<Array>::value_type>::value
+		              , "array value types should be the same");
+		assert(std::size_t(src_end - src_begin) <= dst.size());
+		auto& array = src_begin.array();
+		array.touch();
+		array.flushHostWrites();
+		auto copyDevice = detail::CopyDevice(array.device());
+		return Delayed<Copy>{copyDevice.copy_async(array, sizeof(T)*src_begin.offset()
+		                                           , dst.buffer(), dst.offset_bytes()
+		                                           , sizeof(T)*std::size_t(src_end - src_begin))
+		                    , Copy::wrap(std::move(copyDevice))};
+	}
+
+	/// Upload all sub-arrays written to the staging image of the packed array
+	/// with a single transfer command.
+	/// If the packed array is host-visible the data is already there, and nothing is done.
+	template<class Alloc>
+	auto copy_async(arr::PackedStage<Alloc>&& stage)-> vuh::Delayed<Copy> {
+		auto& array = stage.array();
+		const auto offset = stage.offset_begin();
+		const auto size_bytes = stage.offset_end() - offset;
+		if(!stage.stage() || size_bytes == 0){
+			return Delayed<Copy>{array.device(), Copy::wrap(detail::Noop{})};
+		}
+		array.touch();
+		auto cpy = detail::CopyPacked(array.device(), std::move(stage.stage()));
+		cpy.stage->flush();
+		array.markDeviceWrite(offset, size_bytes);
+		auto fence = cpy.copy_async(cpy.stage->buffer(), cpy.stage->offset() + offset
+		                            , array, offset, size_bytes);
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(cpy))};
+	}
+
+	/// Async copy data from host memory to the sub-array of the packed array.
+	/// Same as the copy to device array: only the transfer from the staging memory is async,
+	/// copies to host-visible memory and streamed copies are fully blocking.
+	template<class SrcIter1, class SrcIter2, class T, class Alloc>
+	auto copy_async(SrcIter1 src_begin, SrcIter2 src_end, arr::PackedView<T, Alloc> dst
+	                )-> std::enable_if_t<traits::are_comparable_host_iterators<SrcIter1, SrcIter2>::value
+	                                    , vuh::Delayed<Copy>
+	                                    >
+	{
+		auto& array = dst.array();
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		if(array.isHostVisible() || size_bytes > arr::streamChunkSize(array.device().uploadRing(), sizeof(T))){
+			array.fromHost(dst, src_begin, src_end);
+			return Delayed<Copy>{array.device(), Copy::wrap(detail::Noop{})};
+		}
+		auto stage = detail::CopyStageFromHost<T>(array.device(), src_begin, src_end);
+		array.touch();
+		array.markDeviceWrite(dst.offset_bytes(), size_bytes);
+		auto fence = stage.CopyDevice::copy_async(stage.stage.buffer(), stage.stage.offset()
+		                                          , array, dst.offset_bytes(), size_bytes);
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(stage))};
+	}
+
+	/// Async copy data from the sub-array of the packed array to host.
+	/// Same as the copy from device array: the copy from staging memory to host takes place
+	/// at the synchronization point.
+	template<class T, class Alloc, class DstIter>
+	auto copy_async(arr::PackedView<T, Alloc> src, DstIter dst_begin
+	                )-> std::enable_if_t<traits::is_host_iterator<DstIter>::value, vuh::Delayed<Copy>>
+	{
+		auto& array = src.array();
+		if(array.isHostVisible() || src.size_bytes() > arr::streamChunkSize(array.device().readbackRing(), sizeof(T))){
+			return Delayed<Copy>{array.device()
+			                    , Copy::wrap(detail::PackedToHost<T, Alloc, DstIter>(src, dst_begin))};
+		}
+		array.touch();
+		array.flushHostWrites();
+		auto stage = detail::CopyStageToHost<T, DstIter>(array.device(), src.size(), dst_begin);
+		auto fence = stage.CopyDevice::copy_async(array, src.offset_bytes()
+		                                          , stage.stage.buffer(), stage.stage.offset()
+		                                          , src.size_bytes());
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(stage))};
+	}
+
+	/// Copy data from the memory-mapped file range to the device array.
+	/// File pages are copied straight to the staging memory (or to the array memory if that is
+	/// host-visible) with read-ahead, no intermediate host buffer is involved (see arr::fileToDevice()).
+	/// Fully blocking, same as the streaming copy from host.
+	template<class T, class Alloc>
+	auto copy_async(const MappedFile& src, ArrayIter<arr::DeviceArray<T, Alloc>> dst_begin
+	                )-> vuh::Delayed<Copy>
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "array values should be trivially copyable");
+		auto& array = dst_begin.array();
+		assert(src.size() % sizeof(T) == 0);
+		assert(dst_begin.offset() + src.size()/sizeof(T) <= array.size());
+		if(array.isHostVisible()){
+			auto span = array.hostSpan();
+			arr::memcpyToMapped(span.data() + dst_begin.offset(), src.data(), src.size()
+			                    , array.memoryProperties());
+			array.flush(dst_begin.offset(), dst_begin.offset() + src.size()/sizeof(T));
+		} else {
+			array.touch();
+			arr::fileToDevice(array.device(), src, array, dst_begin.offset()*sizeof(T), sizeof(T));
+		}
+		return Delayed<Copy>{array.device(), Copy::wrap(detail::Noop{})};
+	}
+
+	/// Copy data from the device array to the writable memory-mapped file range.
+	/// Staging memory (or the array memory if that is host-visible) is copied straight to the file
+	/// pages, no intermediate host buffer is involved (see arr::deviceToFile()).
+	/// Fully blocking, so that the mapping may be a temporary.
+	template<class T, class Alloc>
+	auto copy_async(ArrayIter<arr::DeviceArray<T, Alloc>> src_begin
+	                , ArrayIter<arr::DeviceArray<T, Alloc>> src_end
+	                , const MappedFile& dst
+	                )-> vuh::Delayed<Copy>
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "array values should be trivially copyable");
+		const auto& array = src_begin.array();
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		assert(dst.mode() == MappedFile::Mode::Write);
+		assert(size_bytes <= dst.size());
+		if(array.isHostVisible()){
+			auto span = array.hostSpan();
+			arr::memcpyFromMapped(dst.data(), span.data() + src_begin.offset(), size_bytes
+			                      , array.memoryProperties());
+		} else {
+			array.touch();
+			arr::deviceToFile(src_begin.array().device(), array, src_begin.offset()*sizeof(T), dst
+			                  , size_bytes, sizeof(T));
+		}
+		return Delayed<Copy>{src_begin.array().device(), Copy::wrap(detail::Noop{})};
+	}
+
 	/// Async copy data from host memory to device-local array.
 	/// Blocks while for the duration of initial copy from host memory to host-visible
 	/// staging array.
 	/// Only the memory transfer between staging buffer and device memory is actually async.
 	/// If device array is host-visible the operation is fully blocking.
+	/// Transfers too big to be staged in a single piece are streamed in chunks
+	/// (see arr::streamToDevice()), this is also fully blocking.
 	template<class SrcIter1, class SrcIter2, class T, class Alloc>
 	auto copy_async(SrcIter1 src_begin, SrcIter2 src_end
 	           , vuh::ArrayIter<arr::DeviceArray<T, Alloc>> dst_begin
@@ -198,12 +730,15 @@ namespace vuh {
 	                               >
 	{
 		auto& array = dst_begin.array();
-		if(array.isHostVisible()){ // normal copy, the function blocks till the copying is complete
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		if(array.isHostVisible() // normal copy, the function blocks till the copying is complete
+		   || size_bytes > arr::streamChunkSize(array.device().uploadRing(), sizeof(T))) // streaming copy, same
+		{
 			array.fromHost(src_begin, src_end, dst_begin.offset());
 			return Delayed<Copy>{array.device(), Copy::wrap(detail::Noop{})};
 		} else { // copy first to staging buffer and then async copy from staging buffer to device
 			auto stage = detail::CopyStageFromHost<T>(array.device(), src_begin, src_end);
-			auto cpy = stage.copy_async(device_begin(stage.array), device_end(stage.array), dst_begin);
+			auto cpy = stage.copy_async(dst_begin);
 			return Delayed<Copy>{std::move(cpy), Copy::wrap(std::move(stage))};
 		}
 	}
@@ -214,6 +749,8 @@ namespace vuh {
 	/// The copy between staging buffer and host is only triggered at the synchronization point
 	/// (Delayed<Copy>::wait() or destructor) and it blocks till the complete operation is finished.
 	/// If device array is host-visible it just makes the blocking call to std::copy().
+	/// Transfers too big to be staged in a single piece are streamed in chunks
+	/// (see arr::streamToHost()) at the synchronization point.
 	template<class T, class Alloc, class DstIter>
 	auto copy_async(ArrayIter<arr::DeviceArray<T, Alloc>> src_begin
 	               , ArrayIter<arr::DeviceArray<T, Alloc>> src_end
@@ -223,14 +760,213 @@ namespace vuh {
 	                                   >
 	{
 		auto& array = src_begin.array();
-		if(!array.isHostVisible()){ // device array is not host-visible
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		if(!array.isHostVisible()
+		   && size_bytes <= arr::streamChunkSize(array.device().readbackRing(), sizeof(T))) // staged copy
+		{
 			auto stage = detail::CopyStageToHost<T, DstIter>(array.device(), src_end - src_begin, dst_begin);
-			return Delayed<Copy>{ stage.copy_async(src_begin, src_end, device_begin(stage.array))
+			return Delayed<Copy>{ stage.copy_async(src_begin, src_end)
 			                    , Copy::wrap(std::move(stage))};
-		} else { // array is host visible
+		} else { // array is host visible or transfer is streamed
 			using SrcIter = ArrayIter<arr::DeviceArray<T, Alloc>>;
 			return Delayed<Copy>{ array.device()
 			                    , Copy::wrap(detail::StdCopy<SrcIter, DstIter>(src_begin, src_end, dst_begin))};
 		}
 	}
+
+	/// Async copy data from host memory to device-local array, with the copy to staging memory
+	/// made on the device worker pool (see Device::workerPool()) instead of the calling thread.
+	/// The call returns right after the submission, device copy from the staging memory waits
+	/// for the host stage on the event set by the worker. The transfer queue is stalled on that
+	/// event for up to the duration of the host copy (the time blocking copy_async() would keep
+	/// the calling thread), so work submitted to that queue meanwhile is delayed.
+	/// The submission can not be made by the worker instead, since the device queues are not
+	/// thread-safe.
+	/// Host data should not be modified or destroyed till the sync point.
+	/// Errors of the host stage are reported by Delayed::get().
+	/// Transfers are never streamed: one too big for the free space of the upload ring is staged
+	/// in a transient buffer of the transfer size (see arr::StagingRing::acquire()), so that it
+	/// stays off the calling thread as well.
+	/// Host-visible arrays are fully blocking, same as with copy_async() without the tag.
+	template<class SrcIter1, class SrcIter2, class T, class Alloc>
+	auto copy_async(SrcIter1 src_begin, SrcIter2 src_end
+	                , vuh::ArrayIter<arr::DeviceArray<T, Alloc>> dst_begin, host_async_t
+	                )-> std::enable_if_t<traits::are_comparable_host_iterators<SrcIter1, SrcIter2>::value
+	                                    , vuh::Delayed<Copy>
+	                                    >
+	{
+		auto& array = dst_begin.array();
+		auto& device = array.device();
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		if(array.isHostVisible()){
+			return copy_async(src_begin, src_end, dst_begin);
+		}
+		auto cpy = detail::CopyHostAsync(device, device.uploadRing().acquire(device, size_bytes));
+		auto job = cpy.job.get();
+		job->event = device.createEvent(vk::EventCreateInfo());
+		array.touch();
+		array.markDeviceWrite(sizeof(T)*dst_begin.offset(), size_bytes);
+		job->done = device.workerPool().submit([job, src_begin, size_bytes]{
+			job->run([&]{
+				arr::copyToMapped(src_begin, size_bytes/sizeof(T), static_cast<T*>(job->stage.data())
+				                  , job->stage.memoryProperties());
+				job->stage.flush();
+			});
+			job->run([&]{ job->device.setEvent(job->event); }); // let the device go on anyway
+		});
+		auto fence = cpy.copy_async(job->event, job->stage.buffer(), job->stage.offset()
+		                            , array, sizeof(T)*dst_begin.offset(), size_bytes);
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(cpy))};
+	}
+
+	/// Async copy data from device-local array to host, with the copy from staging memory to host
+	/// made on the device worker pool (see Device::workerPool()) as soon as the device is done,
+	/// instead of at the synchronization point in the calling thread.
+	/// Host destination should not be accessed or destroyed till the sync point.
+	/// Errors of the host stage are reported by Delayed::get().
+	/// Transfers are never streamed: one too big for the free space of the readback ring is staged
+	/// in a transient buffer of the transfer size (see arr::StagingRing::acquire()).
+	/// Host-visible arrays are copied at the sync point, same as with copy_async() without the tag.
+	template<class T, class Alloc, class DstIter>
+	auto copy_async(ArrayIter<arr::DeviceArray<T, Alloc>> src_begin
+	                , ArrayIter<arr::DeviceArray<T, Alloc>> src_end
+	                , DstIter dst_begin, host_async_t
+	                )-> std::enable_if_t<traits::is_host_iterator<DstIter>::value, vuh::Delayed<Copy>>
+	{
+		auto& array = src_begin.array();
+		auto& device = array.device();
+		const auto size_bytes = std::size_t(src_end - src_begin)*sizeof(T);
+		if(array.isHostVisible()){
+			return copy_async(src_begin, src_end, dst_begin);
+		}
+		auto cpy = detail::CopyHostAsync(device, device.readbackRing().acquire(device, size_bytes));
+		auto job = cpy.job.get();
+		array.touch();
+		array.flushHostWrites();
+		auto fence = cpy.copy_async(array, sizeof(T)*src_begin.offset()
+		                            , job->stage.buffer(), job->stage.offset(), size_bytes);
+		const auto transfer_done = vk::Fence(fence);
+		job->done = device.workerPool().submit([job, transfer_done, dst_begin, size_bytes]{
+			job->run([&]{
+				job->device.waitForFences({transfer_done}, true, uint64_t(-1));
+				job->stage.invalidate();
+				arr::copyFromMapped(static_cast<const T*>(job->stage.data()), size_bytes/sizeof(T)
+				                    , dst_begin, job->stage.memoryProperties());
+			});
+		});
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(cpy))};
+	}
+
+	/// Gather many pieces of host data to the device-local array with a single staging upload.
+	/// Pieces (anything with data() and size(), such as std::vector<std::vector<T>> or
+	/// std::vector<HostSpan<const T>>) are packed back to back to one staging chunk and copied
+	/// to the given array offsets (elements, one per piece) with a single multi-region copy command,
+	/// one submission and one fence.
+	/// Blocks for the duration of the host copy to staging memory, same as copy_async() from host.
+	/// Staging chunk too big for the upload ring is a transient buffer.
+	/// If device array is host-visible the pieces are copied directly and the call is fully blocking.
+	/// Destination ranges should not overlap.
+	template<class Pieces, class T, class Alloc>
+	auto gather_async(const Pieces& src, const std::vector<std::size_t>& dst_offsets
+	                  , arr::DeviceArray<T, Alloc>& dst
+	                  )-> vuh::Delayed<Copy>
+	{
+		using std::begin; using std::end;
+		static_assert(std::is_same<detail::piece_value_t<Pieces>, T>::value
+		              , "host pieces and array value types should be the same");
+		assert(std::size_t(std::distance(begin(src), end(src))) == dst_offsets.size());
+		auto& device = dst.device();
+		auto size_bytes = std::size_t(0);
+		for(const auto& piece: src){
+			size_bytes += piece.size()*sizeof(T);
+		}
+		if(size_bytes == 0){
+			return Delayed<Copy>{device, Copy::wrap(detail::Noop{})};
+		}
+		auto offset = begin(dst_offsets);
+		if(dst.isHostVisible()){
+			for(const auto& piece: src){
+				assert(*offset + piece.size() <= dst.size());
+				dst.fromHost(piece.data(), piece.data() + piece.size(), *offset++);
+			}
+			return Delayed<Copy>{device, Copy::wrap(detail::Noop{})};
+		}
+
+		auto cpy = detail::CopyGather(device, size_bytes);
+		auto stage_data = static_cast<T*>(cpy.stage.data());
+		auto stage_offset = cpy.stage.offset();
+		const auto stage_props = cpy.stage.memoryProperties();
+		auto regions = std::vector<vk::BufferCopy>{};
+		regions.reserve(dst_offsets.size());
+		for(const auto& piece: src){
+			assert(*offset + piece.size() <= dst.size());
+			const auto r = arr::copyRegions(stage_offset, sizeof(T)*(*offset), sizeof(T)*piece.size());
+			regions.insert(end(regions), begin(r), end(r));
+			dst.markDeviceWrite(sizeof(T)*(*offset), sizeof(T)*piece.size());
+			arr::copyToMapped(piece.data(), piece.size(), stage_data, stage_props);
+			stage_data += piece.size();
+			stage_offset += sizeof(T)*piece.size();
+			++offset;
+		}
+		cpy.stage.flush();
+		dst.touch();
+		auto fence = cpy.copy_async(cpy.stage.buffer(), dst, regions);
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(cpy))};
+	}
+
+	/// Scatter ranges of the device-local array to many pieces of host memory with a single
+	/// staging readback. Ranges starting at the given array offsets (elements, one per piece)
+	/// and sized as the pieces are copied to one staging chunk with a single multi-region copy
+	/// command, one submission and one fence. Pieces (anything with data() and size(), such as
+	/// std::vector<std::vector<T>> or std::vector<HostSpan<T>>) are filled from the staging memory
+	/// at the sync point, same as with copy_async() to host. Pieces should not be resized or
+	/// destroyed till then.
+	/// Staging chunk too big for the readback ring is a transient buffer.
+	/// If device array is host-visible the pieces are copied directly and the call is fully blocking.
+	template<class T, class Alloc, class Pieces>
+	auto scatter_async(arr::DeviceArray<T, Alloc>& src, const std::vector<std::size_t>& src_offsets
+	                   , Pieces& dst
+	                   )-> vuh::Delayed<Copy>
+	{
+		using std::begin; using std::end;
+		static_assert(std::is_same<detail::piece_value_t<Pieces>, T>::value
+		              , "host pieces and array value types should be the same");
+		assert(std::size_t(std::distance(begin(dst), end(dst))) == src_offsets.size());
+		auto& device = src.device();
+		auto pieces = std::vector<HostSpan<T>>{};
+		pieces.reserve(src_offsets.size());
+		auto size_bytes = std::size_t(0);
+		for(auto& piece: dst){
+			pieces.emplace_back(piece.data(), piece.size());
+			size_bytes += piece.size()*sizeof(T);
+		}
+		if(size_bytes == 0){
+			return Delayed<Copy>{device, Copy::wrap(detail::Noop{})};
+		}
+		auto offset = begin(src_offsets);
+		if(src.isHostVisible()){
+			for(const auto& piece: pieces){
+				assert(*offset + piece.size() <= src.size());
+				src.rangeToHost(*offset, *offset + piece.size(), piece.begin());
+				++offset;
+			}
+			return Delayed<Copy>{device, Copy::wrap(detail::Noop{})};
+		}
+
+		auto regions = std::vector<vk::BufferCopy>{};
+		regions.reserve(pieces.size());
+		auto cpy = detail::CopyScatter<T>(device, size_bytes, std::move(pieces));
+		auto stage_offset = cpy.stage.offset();
+		for(const auto& piece: cpy.dst){
+			assert(*offset + piece.size() <= src.size());
+			const auto r = arr::copyRegions(sizeof(T)*(*offset), stage_offset, piece.size_bytes());
+			regions.insert(end(regions), begin(r), end(r));
+			stage_offset += piece.size_bytes();
+			++offset;
+		}
+		src.touch();
+		src.flushHostWrites();
+		auto fence = cpy.copy_async(src, cpy.stage.buffer(), regions);
+		return Delayed<Copy>{std::move(fence), Copy::wrap(std::move(cpy))};
+	}
 } // namespace vuh
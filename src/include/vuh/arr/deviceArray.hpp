@@ -3,9 +3,13 @@
 #include "arrayProperties.h"
 #include "arrayIter.hpp"
 #include "arrayUtils.h"
+#include "arrayView.hpp"
+#include "allocArena.hpp"
 #include "allocDevice.hpp"
 #include "basicArray.hpp"
 #include "hostArray.hpp"
+#include "mappedCopy.h"
+#include "stagingRing.h"
 
 #include <vuh/traits.hpp>
 
@@ -33,10 +37,34 @@ public:
 	   , _size(n_elements)
 	{}
 
+	/// Constructs object of the class in memory taken from the arena.
+	/// Memory is left unintitialized.
+	template<class Props>
+	DeviceOnlyArray( Arena<Props>& arena  ///< arena to take memory from
+	               , size_t n_elements     ///< number of elements
+	               , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	               , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : BasicArray<Alloc>(Alloc(arena), arena.device(), n_elements*sizeof(T), flags_memory, flags_buffer)
+	   , _size(n_elements)
+	{}
+
+	/// Constructs object of the class over the memory exported by other process
+	/// (see BasicArray::exportMemory()). Only available with allocators importing shared memory.
+	DeviceOnlyArray( vuh::Device& device              ///< device to create array on
+	               , const ExternalMemory& external    ///< memory to import
+	               , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	               , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : BasicArray<Alloc>(Alloc(external), device, external.size_bytes, flags_memory, flags_buffer)
+	   , _size(external.size_bytes/sizeof(T))
+	{}
+
+	/// @return number of elements
+	auto size() const-> size_t { return _size; }
+
 	/// @return size of array in bytes.
-	auto size_bytes() const-> uint32_t { return _size*sizeof(T); }
+	auto size_bytes() const-> size_t { return _size*sizeof(T); }
 private:
-	uint32_t  _size; ///< number of elements
+	size_t _size; ///< number of elements
 }; // class DeviceOnlyArray
 
 /// Array with host data exchange interface suitable for memory allocated in device-local space.
@@ -45,7 +73,9 @@ private:
 /// for host access. However actual allocation may take place in a host-visible memory.
 /// Some functions (like toHost(), fromHost()) switch to using the simplified data exchange methods
 /// in that case. Some do not. In case all memory is host-visible (like on integrated GPUs) using this class
-/// may result in performance penalty.
+/// with device-local only allocator may result in performance penalty, mem::Auto allocator
+/// picks host-visible memory on such devices (see AllocAuto).
+/// Host-visible memory is mapped on first access and remains mapped till the array is destroyed.
 template<class T, class Alloc>
 class DeviceArray: public BasicArray<Alloc>{
 	using Base = BasicArray<Alloc>;
@@ -60,6 +90,28 @@ public:
 	   , _size(n_elements)
 	{}
 
+	/// Create an instance of DeviceArray with given number of elements in memory taken from the arena.
+	/// Memory is uninitialized.
+	template<class Props>
+	DeviceArray( Arena<Props>& arena   ///< arena to take memory from
+	           , size_t n_elements     ///< number of elements
+	           , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	           , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : Base(Alloc(arena), arena.device(), n_elements*sizeof(T), flags_memory, flags_buffer)
+	   , _size(n_elements)
+	{}
+
+	/// Create an instance of DeviceArray over the memory exported by other process
+	/// (see BasicArray::exportMemory()). Array data is the one written by the exporter.
+	/// Only available with allocators importing shared memory (such as AllocExternal).
+	DeviceArray( vuh::Device& device              ///< device to create array on
+	           , const ExternalMemory& external    ///< memory to import
+	           , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	           , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : Base(Alloc(external), device, external.size_bytes, flags_memory, flags_buffer)
+	   , _size(external.size_bytes/sizeof(T))
+	{}
+
 	/// Create an instance of DeviceArray and initialize memory by content of some host iterable.
 	template<class C, class=typename std::enable_if_t<vuh::traits::is_iterable<C>::value>>
 	DeviceArray(vuh::Device& device  ///< device to create array on
@@ -68,8 +120,7 @@ public:
 	           , vk::BufferUsageFlags flags_buffer={})	  ///< additional (to defined by allocator) buffer usage flags
 	   : DeviceArray(device, c.size(), flags_memory, flags_buffer)
 	{
-		using std::begin; using std::end;
-		fromHost(begin(c), end(c));
+		fromHost(hostBegin(c), hostEnd(c));
 	}
 
 	/// Create an instance of DeviceArray and initialize it from a range of values.
@@ -93,24 +144,39 @@ public:
 	           , vk::BufferUsageFlags flags_buffer={})	  ///< additional (to defined by allocator) buffer usage flags
 	   : DeviceArray(device, n_elements, flags_memory, flags_buffer)
 	{
-		using std::begin;
-		auto stage_buffer = HostArray<T, AllocDevice<properties::HostCoherent>>(Base::_dev, n_elements);
-		auto stage_it = begin(stage_buffer);
-		for(size_t i = 0; i < n_elements; ++i, ++stage_it){
-			*stage_it = fun(i);
-		}
-		copyBuf(Base::_dev, stage_buffer, *this, size_bytes());
+		auto i = size_t(0);
+		stageFromHost(0, n_elements, [&](T* dst, size_t n){
+			for(auto dst_end = dst + n; dst != dst_end; ++dst, ++i){
+				*dst = fun(i);
+			}
+		});
+	}
+
+	/// Move constructor.
+	DeviceArray(DeviceArray&& o) noexcept: Base(std::move(o)), _size(o._size) {}
+	/// Move operator.
+	/// Resources associated with current array are released immediately (see BasicArray).
+	auto operator=(DeviceArray&& o) noexcept-> DeviceArray& {
+		Base::operator=(std::move(o));
+		_size = o._size;
+		return *this;
+	}
+
+	/// Swap the guts of two arrays.
+	auto swap(DeviceArray& o) noexcept-> void {
+		using std::swap;
+		swap(static_cast<Base&>(*this), static_cast<Base&>(o));
+		swap(_size, o._size);
 	}
    
 	/// Copy data from host range to array memory.
 	template<class It1, class It2>
 	auto fromHost(It1 begin, It2 end)-> void {
 		if(Base::isHostVisible()){
-			std::copy(begin, end, host_data());
-			Base::_dev.unmapMemory(Base::_mem);
+			copyToMapped(begin, size_t(end - begin), host_data(), Base::memoryProperties());
+			Base::flushMemory(0, (end - begin)*sizeof(T));
 		} else { // memory is not host visible, use staging buffer
-			auto stage_buf = HostArray<T, AllocDevice<properties::HostCoherent>>(Base::_dev, begin, end);
-			copyBuf(Base::_dev, stage_buf, *this, (end - begin) * sizeof(T));
+			stageFromHost(begin, end, 0);
 		}
 	}
    
@@ -118,11 +184,10 @@ public:
 	template<class It1, class It2>
 	auto fromHost(It1 begin, It2 end, size_t offset)-> void {
 		if(Base::isHostVisible()){
-			std::copy(begin, end, host_data() + offset);
-			Base::_dev.unmapMemory(Base::_mem);
+			copyToMapped(begin, size_t(end - begin), host_data() + offset, Base::memoryProperties());
+			Base::flushMemory(offset*sizeof(T), (end - begin)*sizeof(T));
 		} else { // memory is not host visible, use staging buffer
-			auto stage_buf = HostArray<T, AllocDevice<properties::HostCoherent>>(Base::_dev, begin, end);
-			copyBuf(Base::_dev, stage_buf, *this, (end - begin) * sizeof(T), 0u, offset*sizeof(T));
+			stageFromHost(begin, end, offset);
 		}
 	}
 
@@ -131,13 +196,11 @@ public:
    template<class It>
    auto toHost(It copy_to) const-> void {
       if(Base::isHostVisible()){
-         std::copy_n(host_data(), size(), copy_to);
-         Base::_dev.unmapMemory(Base::_mem);
+         auto copy_from = host_data();
+         Base::invalidateMemory(0, size_bytes());
+         copyFromMapped(copy_from, size(), copy_to, Base::memoryProperties());
       } else {
-         using std::begin; using std::end;
-         auto stage_buf = HostArray<T, AllocDevice<properties::HostCached>>(Base::_dev, size());
-         copyBuf(Base::_dev, *this, stage_buf, size_bytes());
-         std::copy(begin(stage_buf), end(stage_buf), copy_to);
+         stageRangeToHost(0, size(), copy_to);
       }
    }
    
@@ -147,13 +210,12 @@ public:
    auto toHost(It copy_to, F&& fun) const-> void {
       if(Base::isHostVisible()){
          auto copy_from = host_data();
+         Base::invalidateMemory(0, size_bytes());
          std::transform(copy_from, copy_from + size(), copy_to, std::forward<F>(fun));
-         Base::_dev.unmapMemory(Base::_mem);
       } else {
-         using std::begin; using std::end;
-         auto stage_buf = HostArray<T, AllocDevice<properties::HostCached>>(Base::_dev, size());
-         copyBuf(Base::_dev, *this, stage_buf, size_bytes());
-         std::transform(begin(stage_buf), end(stage_buf), copy_to, std::forward<F>(fun));
+         stageToHost(0, size(), [&](const T* src, size_t n){
+            copy_to = std::transform(src, src + n, copy_to, fun);
+         });
       }
    }
    
@@ -166,13 +228,12 @@ public:
 	{
 		if(Base::isHostVisible()){
 			auto copy_from = host_data();
+			Base::invalidateMemory(0, size*sizeof(T));
 			std::transform(copy_from, copy_from + size, copy_to, std::forward<F>(fun));
-			Base::_dev.unmapMemory(Base::_mem);
 		} else {
-			using std::begin; using std::end;
-			auto stage_buf = HostArray<T, AllocDevice<properties::HostCached>>(Base::_dev, size);
-			copyBuf(Base::_dev, *this, stage_buf, size_bytes());
-			std::transform(begin(stage_buf), end(stage_buf), copy_to, std::forward<F>(fun));
+			stageToHost(0, size, [&](const T* src, size_t n){
+				copy_to = std::transform(src, src + n, copy_to, fun);
+			});
 		}
 	}
 
@@ -181,14 +242,11 @@ public:
 	auto rangeToHost(size_t offset_begin, size_t offset_end, DstIter dst_begin) const-> void {
 		if(Base::isHostVisible()){
 			auto copy_from = host_data();
-			std::copy(copy_from + offset_begin, copy_from + offset_end, dst_begin);
-			Base::_dev.unmapMemory(Base::_mem);
+			Base::invalidateMemory(offset_begin*sizeof(T), (offset_end - offset_begin)*sizeof(T));
+			copyFromMapped(copy_from + offset_begin, offset_end - offset_begin, dst_begin
+			               , Base::memoryProperties());
 		} else {
-			using std::begin; using std::end;
-			auto stage_buf = HostArray<T, AllocDevice<properties::HostCached>>(Base::_dev
-			                                                          , offset_end - offset_begin);
-			copyBuf(Base::_dev, *this, stage_buf, (offset_end - offset_begin) * sizeof(T), offset_begin * sizeof(T), 0u);
-			std::copy(begin(stage_buf), end(stage_buf), dst_begin);
+			stageRangeToHost(offset_begin, offset_end - offset_begin, dst_begin);
 		}
 	}
 	
@@ -196,17 +254,45 @@ public:
 	template<class C, typename=typename std::enable_if_t<vuh::traits::is_iterable<C>::value>>
 	auto toHost() const-> C {
 		auto ret = C(size());
-		using std::begin;
-		toHost(begin(ret));
+		toHost(hostBegin(ret));
 		return ret;
 	}
 
+	/// @return host span over the array data.
+	/// Memory is made visible to the host before return. Writes through the span should be
+	/// followed by flush() if memory is not host-coherent.
+	/// @pre array memory should be host-visible (see isHostVisible()).
+	auto hostSpan()-> HostSpan<T> {
+		auto data = host_data();
+		Base::invalidateMemory(0, size_bytes());
+		return HostSpan<T>(data, _size);
+	}
+
+	/// @return read-only host span over the array data.
+	/// @pre array memory should be host-visible (see isHostVisible()).
+	auto hostSpan() const-> HostSpan<const T> {
+		auto data = host_data();
+		Base::invalidateMemory(0, size_bytes());
+		return HostSpan<const T>(data, _size);
+	}
+
+	/// Make host writes to the elements in range [offset_begin, offset_end) available to the device.
+	/// Noop for host-coherent memory.
+	/// @pre array memory should be host-visible (see isHostVisible()).
+	auto flush(size_t offset_begin, size_t offset_end)-> void {
+		host_data();
+		Base::flushMemory(offset_begin*sizeof(T), (offset_end - offset_begin)*sizeof(T));
+	}
+
+	/// Make host writes to the array memory available to the device.
+	auto flush()-> void { flush(0, _size); }
+
 	/// @return number of elements
 	auto size() const-> size_t {return _size;}
 
 	/// @return size of a memory chunk occupied by array elements
 	/// (not the size of actually allocated chunk, which may be a bit bigger).
-	auto size_bytes() const-> uint32_t {return _size*sizeof(T);}
+	auto size_bytes() const-> size_t {return _size*sizeof(T);}
 
 	/// doc me
 	auto device_begin()-> ArrayIter<DeviceArray> { return ArrayIter<DeviceArray>(*this, 0); }
@@ -216,14 +302,72 @@ public:
 	auto device_end()-> ArrayIter<DeviceArray> {return ArrayIter<DeviceArray>(*this, _size);}
 	auto device_end() const-> ArrayIter<DeviceArray> {return ArrayIter<DeviceArray>(*this, _size);}
 private: // helpers
-	auto host_data()-> T* {
-		assert(Base::isHostVisible());
-		return static_cast<T*>(Base::_dev.mapMemory(Base::_mem, 0, size_bytes()));
+	/// Copy host range to the array memory (starting at given element offset) through
+	/// the upload staging ring of the device.
+	template<class It1, class It2>
+	auto stageFromHost(It1 begin, It2 end, size_t offset)-> void {
+		const auto props = Base::_dev->uploadRing().memoryProperties(*Base::_dev);
+		stageFromHost(offset, size_t(end - begin), [&](T* dst, size_t n){
+			begin = copyToMapped(begin, n, dst, props);
+		});
+	}
+
+	/// Fill given number of array elements (starting at given offset) through the upload staging
+	/// ring of the device. Transfers bigger than streamChunkSize() are streamed in chunks.
+	/// Filler is called for consecutive chunks: fill(T* stage, size_t n) should write
+	/// next n values to the staging memory.
+	template<class F>
+	auto stageFromHost(size_t offset, size_t n_elements, F&& fill)-> void {
+		Base::touch();
+		const auto n_bytes = n_elements*sizeof(T);
+		if(n_bytes > streamChunkSize(Base::_dev->uploadRing(), sizeof(T))){
+			streamToDevice(*Base::_dev, *this, offset*sizeof(T), n_bytes, sizeof(T)
+			               , [&](void* dst, size_t, size_t size){
+			                    fill(static_cast<T*>(dst), size/sizeof(T));
+			                 });
+		} else {
+			auto stage = Base::_dev->uploadRing().acquire(*Base::_dev, n_bytes);
+			fill(static_cast<T*>(stage.data()), n_elements);
+			stage.flush();
+			copyBuf(*Base::_dev, stage.buffer(), *this, n_bytes, stage.offset(), offset*sizeof(T));
+		}
+	}
+
+	/// Copy given number of array elements (starting at given offset) to host through
+	/// the readback staging ring of the device. Transfers bigger than streamChunkSize()
+	/// are streamed in chunks.
+	/// Consumer is called for consecutive chunks: consume(const T* stage, size_t n) should read
+	/// next n values from the staging memory.
+	template<class F>
+	auto stageToHost(size_t offset, size_t n_elements, F&& consume) const-> void {
+		Base::touch();
+		const auto n_bytes = n_elements*sizeof(T);
+		if(n_bytes > streamChunkSize(Base::_dev->readbackRing(), sizeof(T))){
+			streamToHost(*Base::_dev, *this, offset*sizeof(T), n_bytes, sizeof(T)
+			             , [&](const void* src, size_t, size_t size){
+			                  consume(static_cast<const T*>(src), size/sizeof(T));
+			               });
+		} else {
+			auto stage = Base::_dev->readbackRing().acquire(*Base::_dev, n_bytes);
+			copyBuf(*Base::_dev, *this, stage.buffer(), n_bytes, offset*sizeof(T), stage.offset());
+			stage.invalidate();
+			consume(static_cast<const T*>(stage.data()), n_elements);
+		}
+	}
+
+	/// Copy given number of array elements (starting at given offset) to host location indicated
+	/// by iterator through the readback staging ring of the device.
+	template<class DstIter>
+	auto stageRangeToHost(size_t offset, size_t n_elements, DstIter dst_begin) const-> void {
+		const auto props = Base::_dev->readbackRing().memoryProperties(*Base::_dev);
+		stageToHost(offset, n_elements, [&](const T* src, size_t n){
+			dst_begin = copyFromMapped(src, n, dst_begin, props);
+		});
 	}
 
-	auto host_data() const-> const T* {
-		assert(Base::isHostVisible());
-		return static_cast<const T*>(Base::_dev.mapMemory(Base::_mem, 0, size_bytes()));
+	/// @return host pointer to the array data. Memory is mapped on the first call.
+	auto host_data() const-> T* {
+		return static_cast<T*>(Base::mapMemory(size_bytes()));
 	}
 private: // data
 	size_t _size; ///< number of elements. Actual allocated memory may be a bit bigger than necessary.
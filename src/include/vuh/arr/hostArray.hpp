@@ -1,9 +1,13 @@
 #pragma once
 
+#include "allocArena.hpp"
 #include "basicArray.hpp"
 #include "arrayIter.hpp"
+#include "arrayView.hpp"
+#include "mappedCopy.h"
 
 #include <algorithm>
+#include <cassert>
 
 namespace vuh {
 namespace arr {
@@ -14,6 +18,10 @@ namespace arr {
 /// for host access.
 /// Provides Forward iterator + random-access interface.
 /// Memory remains mapped during the whole lifetime of an object of this type.
+/// For non-coherent memory (such as properties::HostCached) host access through non-const
+/// interface records the touched range as written by host. Those ranges are flushed at once
+/// when the array is passed to a kernel or copied from on a device (or explicitly with flush()).
+/// Ranges written by the device are invalidated at once on the next host access.
 template<class T, class Alloc>
 class HostArray: public BasicArray<Alloc> {
 	using Base = BasicArray<Alloc>;
@@ -27,7 +35,20 @@ public:
 	          , vk::BufferUsageFlags flags_buffer={}    ///< additional (to defined by allocator) buffer usage flags
 	          )
 	   : BasicArray<Alloc>(device, n_elements*sizeof(T), flags_memory, flags_buffer)
-	   , _data(static_cast<T*>(Base::_dev.mapMemory(Base::_mem, 0, n_elements*sizeof(T))))
+	   , _data(static_cast<T*>(Base::mapMemory(n_elements*sizeof(T))))
+	   , _size(n_elements)
+	{}
+
+	/// Construct object of the class in memory taken from the arena.
+	/// Memory is not initialized with any data.
+	template<class Props>
+	HostArray(Arena<Props>& arena  ///< arena to take memory from
+	          , size_t n_elements  ///< number of elements
+	          , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	          , vk::BufferUsageFlags flags_buffer={}    ///< additional (to defined by allocator) buffer usage flags
+	          )
+	   : BasicArray<Alloc>(Alloc(arena), arena.device(), n_elements*sizeof(T), flags_memory, flags_buffer)
+	   , _data(static_cast<T*>(Base::mapMemory(n_elements*sizeof(T))))
 	   , _size(n_elements)
 	{}
 
@@ -53,7 +74,28 @@ public:
 	         )
 	   : HostArray(device, std::distance(begin, end), flags_memory, flags_buffer)
 	{
-		std::copy(begin, end, this->begin());
+		copyToMapped(begin, _size, data(), Base::memoryProperties());
+	}
+
+	/// Construct array over the existing host data.
+	/// With allocator importing host memory (such as AllocHostImport) the device accesses
+	/// the host data in place, and no copy is made. When import is not possible (see isImported())
+	/// the data is copied to the newly allocated memory instead, and updates done on a device
+	/// are only visible through the array.
+	/// Host data should outlive the array.
+	HostArray(vuh::Device& device  ///< device to create array on
+	          , HostSpan<T> host_data ///< host data to import (or copy)
+	          , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	          , vk::BufferUsageFlags flags_buffer={}    ///< additional (to defined by allocator) buffer usage flags
+	          )
+	   : BasicArray<Alloc>(Alloc(host_data.data(), host_data.size_bytes()), device
+	                       , host_data.size_bytes(), flags_memory, flags_buffer)
+	   , _data(static_cast<T*>(Base::mapMemory(host_data.size_bytes())))
+	   , _size(host_data.size())
+	{
+		if(!isImported()){
+			copyToMapped(host_data.data(), _size, data(), Base::memoryProperties());
+		}
 	}
 
    /// Move constructor.
@@ -67,7 +109,7 @@ public:
    /// Destroy array, and release all associated resources.
    ~HostArray() noexcept {
       if(_data) {
-         Base::_dev.unmapMemory(Base::_mem);
+         Base::unmapMemory();
       }
    }
 
@@ -80,12 +122,55 @@ public:
 	}
    
    /// Host-accesible iterator to beginning of array data
-	auto begin()-> value_type* { return _data; }
-	auto begin() const-> const value_type* { return _data; }
+	auto begin()-> value_type* { return data(); }
+	auto begin() const-> const value_type* { return data(); }
    
-	/// Pointer (host) to beginning of array data
-	auto data()-> T* {return _data;}
-	auto data() const-> const T* {return _data;}
+	/// Pointer (host) to beginning of array data.
+	/// The whole array is considered written by host.
+	auto data()-> T* {
+		Base::invalidateDeviceWrites();
+		Base::markHostWrite(0, size_bytes());
+		return _data;
+	}
+	auto data() const-> const T* {
+		Base::invalidateDeviceWrites();
+		return _data;
+	}
+
+	/// Copy data from host range to the array memory starting at given offset.
+	/// Uses the copy routine suited to the array memory type (see copyToMapped()), which for
+	/// the write-combined memory is much faster than writing through the array iterators.
+	template<class It1, class It2>
+	auto fromHost(It1 begin, It2 end, size_t offset=0)-> void {
+		const auto n = size_t(end - begin);
+		assert(offset + n <= _size);
+		Base::invalidateDeviceWrites();
+		copyToMapped(begin, n, _data + offset, Base::memoryProperties());
+		Base::markHostWrite(offset*sizeof(T), n*sizeof(T));
+	}
+
+	/// Copy the array data to host location indicated by iterator.
+	/// Uses the copy routine suited to the array memory type (see copyFromMapped()), which for
+	/// the uncached memory is much faster than reading through the array iterators.
+	template<class It>
+	auto toHost(It copy_to) const-> void {
+		copyFromMapped(data(), _size, copy_to, Base::memoryProperties());
+	}
+
+	/// @return true if array memory is the imported host data (see HostArray(vuh::Device&, HostSpan<T>))
+	/// Only available with allocators importing host memory.
+	auto isImported() const-> bool { return Base::_alloc.isImported(); }
+
+	/// Make host writes to the array visible to the device.
+	/// Normally this is done automatically before the array is used on a device.
+	auto flush() const-> void { Base::flushHostWrites(); }
+
+	/// Make writes to array memory done on a device outside of vuh visible to the host.
+	/// Writes done by vuh kernels and copies are tracked automatically.
+	auto invalidate() const-> void {
+		Base::markDeviceWrite(0, size_bytes());
+		Base::invalidateDeviceWrites();
+	}
 
    /// Host-accessible iterator to the end (one past the last element) of array data.
 	auto end()-> value_type* { return begin() + size(); }
@@ -102,7 +187,12 @@ public:
 	friend auto device_end(HostArray& a)-> ArrayIter<HostArray> {return a.device_end();}
 
    /// Element access operator (host-side).
-   auto operator[](size_t i)-> T& { return *(begin() + i);}
+   /// Only the accessed element is considered written by host.
+   auto operator[](size_t i)-> T& {
+      Base::invalidateDeviceWrites();
+      Base::markHostWrite(i*sizeof(T), sizeof(T));
+      return _data[i];
+   }
    auto operator[](size_t i) const-> T { return *(begin() + i);}
    
    /// @return number of elements
@@ -110,7 +200,7 @@ public:
    
    /// @return size of a memory chunk occupied by array elements
    /// (not the size of actually allocated chunk, which may be a bit bigger).
-   auto size_bytes() const-> uint32_t {return _size*sizeof(T);}
+   auto size_bytes() const-> size_t {return _size*sizeof(T);}
 private: // data
    T* _data;       ///< host accessible pointer to the beginning of corresponding memory chunk.
    size_t _size;  ///< Number of elements. Actual allocated memory may be a bit bigger then necessary.
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vuh/traits.hpp>
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+namespace vuh {
+namespace arr {
+	/// Smallest piece (bytes) of the mapped memory copy given to a separate thread.
+	/// Copies at least twice as big are split between the copy threads.
+	constexpr std::size_t min_parallel_copy = std::size_t(4) << 20; ///< 4MB
+
+	auto memcpyToMapped(void* dst, const void* src, std::size_t size_bytes
+	                    , vk::MemoryPropertyFlags dst_props)-> void;
+	auto memcpyFromMapped(void* dst, const void* src, std::size_t size_bytes
+	                      , vk::MemoryPropertyFlags src_props)-> void;
+
+	namespace detail {
+		/// True if the host iterator points to contiguous storage (see traits::is_contiguous_iterator)
+		/// of trivially copyable values of type T, so that the range can be copied bytewise.
+		template<class It, class T>
+		using is_bulk_copyable = std::integral_constant<bool
+		      , traits::is_contiguous_iterator<It>::value
+		        && std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(*std::declval<It&>())>>
+		                        , T>::value
+		        && std::is_trivially_copyable<T>::value>;
+
+		/// Element-wise copy from arbitrary host iterator to mapped memory.
+		template<class SrcIter, class T>
+		auto copyToMapped(SrcIter src, std::size_t n, T* dst, vk::MemoryPropertyFlags, std::false_type
+		                  )-> SrcIter
+		{
+			for(auto dst_end = dst + n; dst != dst_end; ++dst, ++src){
+				*dst = *src;
+			}
+			return src;
+		}
+
+		/// Bulk copy from contiguous host range to mapped memory.
+		template<class SrcIter, class T>
+		auto copyToMapped(SrcIter src, std::size_t n, T* dst, vk::MemoryPropertyFlags props, std::true_type
+		                  )-> SrcIter
+		{
+			if(n != 0){ // end iterator may not be dereferenced
+				memcpyToMapped(dst, std::addressof(*src), n*sizeof(T), props);
+			}
+			return src + n;
+		}
+
+		/// Element-wise copy from mapped memory to arbitrary host iterator.
+		template<class T, class DstIter>
+		auto copyFromMapped(const T* src, std::size_t n, DstIter dst, vk::MemoryPropertyFlags, std::false_type
+		                    )-> DstIter
+		{
+			for(auto src_end = src + n; src != src_end; ++src, ++dst){
+				*dst = *src;
+			}
+			return dst;
+		}
+
+		/// Bulk copy from mapped memory to contiguous host range.
+		template<class T, class DstIter>
+		auto copyFromMapped(const T* src, std::size_t n, DstIter dst, vk::MemoryPropertyFlags props, std::true_type
+		                    )-> DstIter
+		{
+			if(n != 0){ // end iterator may not be dereferenced
+				memcpyFromMapped(std::addressof(*dst), src, n*sizeof(T), props);
+			}
+			return dst + n;
+		}
+
+		/// Contiguous container data is accessed through the pointer.
+		template<class C>
+		auto hostBegin(C& c, std::true_type)-> decltype(c.data()) { return c.data(); }
+
+		/// Other containers through the iterator.
+		template<class C>
+		auto hostBegin(C& c, std::false_type) {
+			using std::begin;
+			return begin(c);
+		}
+
+		template<class C>
+		auto hostEnd(C& c, std::true_type)-> decltype(c.data()) { return c.data() + c.size(); }
+
+		template<class C>
+		auto hostEnd(C& c, std::false_type) {
+			using std::end;
+			return end(c);
+		}
+	} // namespace detail
+
+	/// @return iterator to the beginning of host container data. That is the data() pointer
+	/// for contiguous containers (see traits::is_contiguous_iterable), so that the copies from/to
+	/// the container take the bulk path whatever its iterator type is.
+	template<class C>
+	auto hostBegin(C& c) { return detail::hostBegin(c, traits::is_contiguous_iterable<C>{}); }
+
+	/// @return iterator to the end of host container data, matching hostBegin().
+	template<class C>
+	auto hostEnd(C& c) { return detail::hostEnd(c, traits::is_contiguous_iterable<C>{}); }
+
+	/// Copy n values from host to mapped device memory with given memory properties.
+	/// Contiguous ranges (see traits::is_contiguous_iterator) of trivially copyable values are
+	/// copied with memcpyToMapped() over the exact byte range, other iterators element by element.
+	/// @return source iterator past the last copied value
+	template<class SrcIter, class T>
+	auto copyToMapped(SrcIter src, std::size_t n, T* dst, vk::MemoryPropertyFlags dst_props)-> SrcIter {
+		return detail::copyToMapped(src, n, dst, dst_props, detail::is_bulk_copyable<SrcIter, T>{});
+	}
+
+	/// Copy n values from mapped device memory with given memory properties to host.
+	/// Contiguous ranges (see traits::is_contiguous_iterator) of trivially copyable values are
+	/// copied with memcpyFromMapped() over the exact byte range, other iterators element by element.
+	/// @return destination iterator past the last copied value
+	template<class T, class DstIter>
+	auto copyFromMapped(const T* src, std::size_t n, DstIter dst, vk::MemoryPropertyFlags src_props)-> DstIter {
+		return detail::copyFromMapped(src, n, dst, src_props, detail::is_bulk_copyable<DstIter, T>{});
+	}
+} // namespace arr
+} // namespace vuh
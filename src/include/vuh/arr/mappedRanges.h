@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace vuh {
+namespace arr {
+	/// Set of byte ranges of the mapped memory chunk pending flush or invalidation.
+	/// Ranges are rounded to the atom size (nonCoherentAtomSize) when added, and
+	/// overlapping or adjacent ones are merged, so that a single vkFlushMappedMemoryRanges
+	/// (or vkInvalidateMappedMemoryRanges) call with a minimal number of ranges is enough
+	/// at a sync point.
+	/// Offsets are relative to the beginning of the chunk, which is expected to be atom-aligned.
+	class MappedRanges {
+	public:
+		explicit MappedRanges(std::size_t atom=1);
+
+		auto add(std::size_t offset, std::size_t size)-> void;
+		auto ranges(vk::DeviceMemory memory, std::size_t base_offset
+		            ) const-> std::vector<vk::MappedMemoryRange>;
+
+		/// Forget all ranges.
+		auto clear() noexcept-> void { _ranges.clear(); }
+		/// @return true if there are no pending ranges
+		auto empty() const-> bool { return _ranges.empty(); }
+		/// @return number of disjoint ranges
+		auto size() const-> std::size_t { return _ranges.size(); }
+	private: // data
+		std::size_t _atom;                                        ///< ranges bounds granularity
+		std::vector<std::pair<std::size_t, std::size_t>> _ranges; ///< disjoint ranges [begin, end) ordered by offset
+	}; // class MappedRanges
+} // namespace arr
+} // namespace vuh
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace vuh {
+	class Device;
+namespace arr {
+	/// Sub-allocating memory pool.
+	/// Keeps a list of big memory blocks per memory type and carves chunks for buffers out of those.
+	/// Free space in each block is tracked by a free-list indexed both by offset (for coalescing
+	/// of neighbouring chunks on release) and by size (for best-fit search on allocation).
+	/// Allocations bigger than the block size, and the ones requested to be dedicated,
+	/// get a block of their own.
+	/// At most one empty block per memory type is kept around for reuse, others are returned
+	/// to the device as soon as they are drained.
+	/// Chunks whose owners are registered with track() can be moved by defragment() to compact
+	/// the sparsely used blocks, so that those can be returned to the device. Chunks still in use
+	/// by async submissions (see ReleaseQueue) are left in place.
+	/// Pool does not keep a reference to the device it allocates memory on, the device is passed
+	/// to every call instead, so that the pool remains valid when owning vuh::Device is moved.
+	/// Not thread-safe, same as the vuh::Device it belongs to.
+	class MemoryPool {
+		struct Block;
+	public:
+		static constexpr std::size_t default_block_size = std::size_t(64) << 20; ///< 64MB
+
+		/// Chunk of memory sub-allocated from a pool.
+		struct Allocation {
+			vk::DeviceMemory memory;               ///< memory block the chunk belongs to
+			std::size_t offset = 0;                ///< offset (bytes) of the chunk wrt the beginning of the block
+			std::size_t size = 0;                  ///< size (bytes) of the chunk
+			uint32_t memid = uint32_t(-1);         ///< memory type id
+			Block* block = nullptr;                ///< owning block
+			bool dedicated = false;                ///< true if the chunk has a dedicated allocation of its own
+
+			/// @return true if allocation refers to a valid chunk
+			explicit operator bool() const { return block != nullptr; }
+		}; // struct Allocation
+
+		/// Locations of the handles kept by the owner (normally an array) of the allocation.
+		/// These are updated when the allocation is moved by defragment().
+		struct Owner {
+			vk::Buffer* buffer = nullptr;           ///< buffer bound to the allocated chunk
+			vk::DeviceMemory* memory = nullptr;     ///< memory handle the buffer is bound to
+			Allocation* allocation = nullptr;       ///< allocation record
+			uint64_t* last_use = nullptr;           ///< release queue number of the last submission using the buffer
+		}; // struct Owner
+
+		explicit MemoryPool(std::size_t block_size=default_block_size);
+		~MemoryPool() noexcept;
+
+		MemoryPool(const MemoryPool&) = delete;
+		auto operator= (const MemoryPool&)-> MemoryPool& = delete;
+
+		auto allocate(vuh::Device& device, uint32_t memid, const vk::MemoryRequirements& requirements
+		              , vk::Buffer dedicated={})-> Allocation;
+		auto free(vuh::Device& device, const Allocation& allocation) noexcept-> void;
+		auto map(vuh::Device& device, const Allocation& allocation)-> void*;
+		auto track(const Allocation& allocation, const Owner& owner
+		           , std::size_t size_bytes, vk::BufferUsageFlags usage) noexcept-> void;
+		auto retrack(const Allocation& allocation, const Owner& owner) noexcept-> void;
+		auto defragment(vuh::Device& device, std::size_t max_bytes
+		                , std::chrono::nanoseconds max_time=std::chrono::nanoseconds::max()
+		                )-> std::size_t;
+
+		auto blockSize() const-> std::size_t { return _block_size; }
+		auto numBlocks() const-> std::size_t;
+		auto release(vuh::Device& device) noexcept-> void;
+	private: // helpers
+		auto newBlock(vuh::Device& device, uint32_t memid, std::size_t size
+		              , vk::Buffer dedicated={})-> Block&;
+		auto freeBlock(vuh::Device& device, Block& block) noexcept-> void;
+		auto trimBlock(vuh::Device& device, Block& block) noexcept-> void;
+		auto evacuate(vuh::Device& device, Block& block, std::size_t max_bytes
+		              , std::chrono::steady_clock::time_point deadline)-> std::size_t;
+	private: // data
+		std::size_t _block_size;                  ///< default size of the newly allocated block
+		std::vector<std::unique_ptr<Block>> _blocks; ///< all allocated blocks (of all memory types)
+	}; // class MemoryPool
+} // namespace arr
+} // namespace vuh
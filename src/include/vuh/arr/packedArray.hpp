@@ -0,0 +1,271 @@
+#pragma once
+
+#include "allocDevice.hpp"
+#include "arrayProperties.h"
+#include "arrayUtils.h"
+#include "basicArray.hpp"
+#include "mappedCopy.h"
+#include "stagingRing.h"
+
+#include <vuh/device.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <type_traits>
+
+namespace vuh {
+namespace arr {
+
+template<class Alloc> class PackedArray;
+
+/// Layout of the typed sub-arrays packed into a single buffer (see PackedArray).
+/// Each sub-array starts at the offset aligned to minStorageBufferOffsetAlignment of the device,
+/// so that it can be bound to a kernel on its own.
+class PackedLayout {
+public:
+	/// Typed handle of the sub-array in the layout.
+	template<class T>
+	struct Slot {
+		std::size_t offset_bytes; ///< offset (bytes) of the sub-array wrt the beginning of the buffer
+		std::size_t size;         ///< number of elements in the sub-array
+	};
+
+	/// Constructor. Empty layout with sub-arrays alignment suitable for the given device.
+	explicit PackedLayout(const vuh::Device& device)
+	   : _alignment(std::max(std::size_t(device.properties().limits.minStorageBufferOffsetAlignment)
+	                         , std::size_t(1)))
+	{}
+
+	/// Append the sub-array of given number of elements to the layout.
+	/// @return handle to get the view of the sub-array from the array created with the layout.
+	template<class T>
+	auto add(std::size_t n_elements)-> Slot<T> {
+		static_assert(std::is_trivially_copyable<T>::value, "array values should be trivially copyable");
+		const auto alignment = std::max(_alignment, alignof(T));
+		const auto offset = (_size_bytes + alignment - 1)/alignment*alignment;
+		_size_bytes = offset + n_elements*sizeof(T);
+		return Slot<T>{offset, n_elements};
+	}
+
+	/// @return size (bytes) of the buffer holding all sub-arrays
+	auto size_bytes() const-> std::size_t { return _size_bytes; }
+	/// @return alignment (bytes) of the sub-arrays offsets
+	auto alignment() const-> std::size_t { return _alignment; }
+private: // data
+	std::size_t _alignment;      ///< alignment (bytes) of the sub-arrays offsets
+	std::size_t _size_bytes = 0; ///< size (bytes) of the buffer holding all sub-arrays
+}; // class PackedLayout
+
+/// View into the typed sub-array of the PackedArray.
+/// Can be bound to a kernel in place of an array, or passed to copy_async().
+/// Does not own the data, and is only valid while the packed array is alive.
+template<class T, class Alloc>
+class PackedView {
+public:
+	using value_type = T;
+	using array_type = PackedArray<Alloc>;
+	static constexpr auto descriptor_class = vk::DescriptorType::eStorageBuffer;
+
+	/// Constructor
+	PackedView(PackedArray<Alloc>& array, std::size_t offset_bytes, std::size_t size)
+	   : _array(&array), _offset(offset_bytes), _size(size)
+	{}
+
+	/// @return buffer of the packed array
+	auto buffer() const-> vk::Buffer { return *_array; }
+	/// @return packed array the view belongs to
+	auto array() const-> PackedArray<Alloc>& { return *_array; }
+	/// @return device the packed array is allocated on
+	auto device() const-> vuh::Device& { return _array->device(); }
+	/// @return offset (bytes) of the sub-array wrt the beginning of the buffer
+	auto offset_bytes() const-> std::size_t { return _offset; }
+	/// @return number of elements in the sub-array
+	auto size() const-> std::size_t { return _size; }
+	/// @return number of bytes in the sub-array
+	auto size_bytes() const-> std::size_t { return _size*sizeof(T); }
+private: // data
+	PackedArray<Alloc>* _array; ///< packed array the view belongs to
+	std::size_t _offset;        ///< offset (bytes) of the sub-array wrt the beginning of the buffer
+	std::size_t _size;          ///< number of elements in the sub-array
+}; // class PackedView
+
+/// Many small typed arrays packed into a single buffer with a single memory allocation.
+/// Sub-arrays are defined by the PackedLayout and accessed through PackedView handles,
+/// which bind to kernels and take part in copy_async() same as arrays do.
+/// All sub-arrays can be uploaded at once with a single transfer (see PackedStage).
+/// Host-visible memory is mapped on first access and remains mapped till the array is destroyed.
+template<class Alloc=AllocDevice<properties::Device>>
+class PackedArray: public BasicArray<Alloc> {
+	using Base = BasicArray<Alloc>;
+public:
+	/// Create the buffer holding all sub-arrays of the layout. Memory is uninitialized.
+	PackedArray(vuh::Device& device           ///< device to create array on
+	            , const PackedLayout& layout  ///< layout of the sub-arrays
+	            , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	            , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : Base(device, layout.size_bytes(), flags_memory, flags_buffer)
+	   , _size_bytes(layout.size_bytes())
+	{
+		assert(layout.size_bytes() != 0);
+	}
+
+	/// Move constructor.
+	PackedArray(PackedArray&& o) noexcept: Base(std::move(o)), _size_bytes(o._size_bytes) {}
+	/// Move operator.
+	/// Resources associated with current array are released immediately (see BasicArray).
+	auto operator=(PackedArray&& o) noexcept-> PackedArray& {
+		Base::operator=(std::move(o));
+		_size_bytes = o._size_bytes;
+		return *this;
+	}
+
+	/// Swap the guts of two arrays.
+	auto swap(PackedArray& o) noexcept-> void {
+		using std::swap;
+		swap(static_cast<Base&>(*this), static_cast<Base&>(o));
+		swap(_size_bytes, o._size_bytes);
+	}
+
+	/// @return view into the sub-array
+	template<class T>
+	auto view(const PackedLayout::Slot<T>& slot)-> PackedView<T, Alloc> {
+		assert(slot.offset_bytes + slot.size*sizeof(T) <= _size_bytes);
+		return PackedView<T, Alloc>(*this, slot.offset_bytes, slot.size);
+	}
+
+	/// Copy data from host range to the sub-array. Blocks till the copy is complete.
+	template<class T, class It1, class It2>
+	auto fromHost(const PackedView<T, Alloc>& dst, It1 begin, It2 end)-> void {
+		assert(&dst.array() == this);
+		const auto n_bytes = std::size_t(end - begin)*sizeof(T);
+		assert(n_bytes <= dst.size_bytes());
+		auto& device = *Base::_dev;
+		Base::touch();
+		if(Base::isHostVisible()){
+			copyToMapped(begin, n_bytes/sizeof(T), static_cast<T*>(host_data(dst.offset_bytes()))
+			             , Base::memoryProperties());
+			Base::flushMemory(dst.offset_bytes(), n_bytes);
+		} else if(n_bytes > streamChunkSize(device.uploadRing(), sizeof(T))){
+			const auto props = device.uploadRing().memoryProperties(device);
+			streamToDevice(device, *this, dst.offset_bytes(), n_bytes, sizeof(T)
+			               , [&](void* stage, std::size_t, std::size_t size){
+			                    begin = copyToMapped(begin, size/sizeof(T), static_cast<T*>(stage), props);
+			                 });
+		} else {
+			auto stage = device.uploadRing().acquire(device, n_bytes);
+			copyToMapped(begin, n_bytes/sizeof(T), static_cast<T*>(stage.data()), stage.memoryProperties());
+			stage.flush();
+			copyBuf(device, stage.buffer(), *this, n_bytes, stage.offset(), dst.offset_bytes());
+		}
+	}
+
+	/// Copy data from the sub-array to host location indicated by iterator.
+	/// Blocks till the copy is complete.
+	template<class T, class DstIter>
+	auto toHost(const PackedView<T, Alloc>& src, DstIter dst_begin) const-> void {
+		assert(&src.array() == this);
+		auto& device = *Base::_dev;
+		Base::touch();
+		if(Base::isHostVisible()){
+			const auto data = static_cast<const T*>(host_data(src.offset_bytes())); // maps memory
+			Base::invalidateMemory(src.offset_bytes(), src.size_bytes());
+			copyFromMapped(data, src.size(), dst_begin, Base::memoryProperties());
+		} else if(src.size_bytes() > streamChunkSize(device.readbackRing(), sizeof(T))){
+			const auto props = device.readbackRing().memoryProperties(device);
+			streamToHost(device, *this, src.offset_bytes(), src.size_bytes(), sizeof(T)
+			             , [&](const void* stage, std::size_t, std::size_t size){
+			                  dst_begin = copyFromMapped(static_cast<const T*>(stage), size/sizeof(T)
+			                                             , dst_begin, props);
+			               });
+		} else {
+			auto stage = device.readbackRing().acquire(device, src.size_bytes());
+			copyBuf(device, *this, stage.buffer(), src.size_bytes(), src.offset_bytes(), stage.offset());
+			stage.invalidate();
+			copyFromMapped(static_cast<const T*>(stage.data()), src.size(), dst_begin
+			               , stage.memoryProperties());
+		}
+	}
+
+	/// @return host pointer to the array memory at given offset (bytes). Memory is mapped on the first call.
+	/// Writes through the pointer should be followed by flush() if memory is not host-coherent.
+	/// @pre array memory should be host-visible (see isHostVisible()).
+	auto host_data(std::size_t offset_bytes=0) const-> void* {
+		return static_cast<char*>(Base::mapMemory(_size_bytes)) + offset_bytes;
+	}
+
+	/// Make host writes to the byte range of the array memory available to the device.
+	/// Noop for host-coherent memory.
+	/// @pre array memory should be host-visible (see isHostVisible()).
+	auto flush(std::size_t offset_bytes, std::size_t size_bytes) const-> void {
+		Base::flushMemory(offset_bytes, size_bytes);
+	}
+
+	/// @return size (bytes) of the buffer holding all sub-arrays
+	auto size_bytes() const-> std::size_t { return _size_bytes; }
+private: // data
+	std::size_t _size_bytes;        ///< size (bytes) of the buffer holding all sub-arrays
+}; // class PackedArray
+
+/// Image of the PackedArray memory in the staging memory of the device upload ring
+/// (or the array memory itself if that is host-visible).
+/// Sub-arrays data is written with write(), and then uploaded to the device all at once
+/// with a single transfer command by copy_async().
+template<class Alloc>
+class PackedStage {
+public:
+	/// Constructor. Takes staging memory for the whole packed array.
+	explicit PackedStage(PackedArray<Alloc>& array): _array(&array) {
+		if(array.isHostVisible()){
+			_data = array.host_data();
+		} else {
+			auto& device = array.device();
+			_stage = std::make_unique<StagingRing::Chunk>(device.uploadRing().acquire(device
+			                                                                          , array.size_bytes()));
+			_data = _stage->data();
+		}
+	}
+
+	/// Write data from host range to the sub-array image.
+	/// Goes straight to the array memory if that is host-visible.
+	template<class T, class It1, class It2>
+	auto write(const PackedView<T, Alloc>& dst, It1 begin, It2 end)-> void {
+		assert(&dst.array() == _array);
+		const auto n_bytes = std::size_t(end - begin)*sizeof(T);
+		assert(n_bytes <= dst.size_bytes());
+		copyToMapped(begin, n_bytes/sizeof(T)
+		             , reinterpret_cast<T*>(static_cast<char*>(_data) + dst.offset_bytes())
+		             , _stage ? _stage->memoryProperties() : _array->memoryProperties());
+		if(!_stage){
+			_array->flush(dst.offset_bytes(), n_bytes);
+		}
+		_begin = std::min(_begin, dst.offset_bytes());
+		_end = std::max(_end, dst.offset_bytes() + n_bytes);
+	}
+
+	/// @return packed array the stage belongs to
+	auto array() const-> PackedArray<Alloc>& { return *_array; }
+	/// @return staging memory, nullptr if array memory is written directly
+	auto stage()-> std::unique_ptr<StagingRing::Chunk>& { return _stage; }
+	/// @return offset (bytes) of the beginning of the written range wrt the beginning of array
+	auto offset_begin() const-> std::size_t { return _begin; }
+	/// @return offset (bytes) of the end of the written range wrt the beginning of array
+	auto offset_end() const-> std::size_t { return std::max(_begin, _end); }
+private: // data
+	PackedArray<Alloc>* _array;                 ///< packed array the stage belongs to
+	std::unique_ptr<StagingRing::Chunk> _stage; ///< staging memory, nullptr if array is host-visible
+	void* _data = nullptr;                      ///< host pointer to the image of array memory
+	std::size_t _begin = std::size_t(-1);       ///< offset (bytes) of the beginning of the written range
+	std::size_t _end = 0;                       ///< offset (bytes) of the end of the written range
+}; // class PackedStage
+
+/// @return staging image of the packed array to upload all sub-arrays at once
+template<class Alloc>
+auto packed_stage(PackedArray<Alloc>& array)-> PackedStage<Alloc> {
+	return PackedStage<Alloc>(array);
+}
+
+} // namespace arr
+} // namespace vuh
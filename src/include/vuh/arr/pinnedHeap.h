@@ -0,0 +1,52 @@
+#pragma once
+
+#include "memoryPool.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <map>
+
+namespace vuh {
+	class Device;
+namespace arr {
+	/// Host-coherent persistently mapped memory handed out to host containers
+	/// (see vuh::pinned_allocator).
+	/// Each allocation is a buffer of its own, sub-allocated from the device memory pool,
+	/// so that it can be used as a transfer source/destination or bound to a kernel directly.
+	/// Blocks of the pool holding such memory are mapped and so are never moved by defragmentation.
+	/// Heap does not keep a reference to the device, same as MemoryPool.
+	/// Not thread-safe, same as the vuh::Device it belongs to.
+	class PinnedHeap {
+	public:
+		/// Location of the host pointer in pinned buffer.
+		struct Range {
+			vk::Buffer buffer;       ///< buffer the pointer belongs to, null if pointer is not pinned
+			std::size_t offset = 0;  ///< offset (bytes) of the pointer wrt the beginning of the buffer
+			std::size_t size = 0;    ///< number of bytes from the pointer to the end of the buffer
+		};
+
+		PinnedHeap() = default;
+		~PinnedHeap() noexcept;
+
+		PinnedHeap(const PinnedHeap&) = delete;
+		auto operator= (const PinnedHeap&)-> PinnedHeap& = delete;
+
+		auto allocate(vuh::Device& device, std::size_t size_bytes)-> void*;
+		auto deallocate(vuh::Device& device, void* ptr) noexcept-> void;
+		auto find(const void* ptr) const-> Range;
+		auto release(vuh::Device& device) noexcept-> void;
+
+		/// @return number of live allocations
+		auto size() const-> std::size_t { return _chunks.size(); }
+	private: // data
+		/// Memory handed out to the host.
+		struct Chunk {
+			vk::Buffer buffer;                ///< buffer covering the chunk
+			MemoryPool::Allocation allocation; ///< chunk of the pool memory
+			std::size_t size_bytes;           ///< requested size
+		};
+		std::map<const char*, Chunk> _chunks; ///< live allocations by host pointer
+	}; // class PinnedHeap
+} // namespace arr
+} // namespace vuh
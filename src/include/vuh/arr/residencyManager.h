@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vuh {
+	class Device;
+namespace arr {
+	/// Keeps device-local arrays memory resident on a best-effort basis.
+	/// Tracks when each registered array was last used (bound to a Program or taking part in a copy).
+	/// When a new device-local allocation does not fit in the heap budget the least recently used
+	/// arrays are evicted to host-visible memory, so that the new array gets the device memory
+	/// instead of falling back to the host. Evicted arrays are restored to their original memory
+	/// type on their next use if there is room for them (possibly evicting other arrays).
+	/// Arrays remain fully functional while evicted, just slower to access from the device.
+	/// Evicted memory is host-visible and host-coherent, array memoryProperties() reflect that.
+	/// Only arrays in device-local memory not visible to host and capable of transfers are
+	/// managed, that is arrays allocated by AllocDevice<properties::Device> (pool sub-allocated
+	/// arrays are compacted by MemoryPool::defragment() instead).
+	/// Evicted or restored memory is copied with a single transfer submission per batch.
+	/// Relocation first waits for the async submissions that last used the moved arrays
+	/// (see ReleaseQueue), and then for the copy itself, since the arrays may be used by the device
+	/// right after the relocation, and the next use is not otherwise ordered after the copy.
+	/// Buffers of the moved arrays are recreated and Device::onRelocate() is called, so programs
+	/// bound to the arrays earlier touch them and record their commands anew on the next run.
+	/// Manager does not keep a reference to the device, the device is passed to every call instead,
+	/// so that the manager remains valid when owning vuh::Device is moved.
+	/// Not thread-safe, same as the vuh::Device it belongs to.
+	class ResidencyManager {
+	public:
+		/// Locations of the handles kept by the owner (normally an array and its allocator)
+		/// of the tracked memory. These are updated when the memory is moved.
+		struct Owner {
+			vk::Buffer* buffer = nullptr;       ///< buffer bound to the tracked memory
+			vk::DeviceMemory* memory = nullptr; ///< tracked memory
+			uint32_t* memid = nullptr;          ///< memory type id of the tracked memory
+			bool* dedicated = nullptr;          ///< true if the memory is a dedicated allocation
+			vk::MemoryPropertyFlags* flags = nullptr; ///< memory property flags of the tracked memory
+			void** mapped = nullptr;            ///< host pointer to the mapped memory, nullptr if not mapped
+			uint64_t* last_use = nullptr;       ///< release queue number of the last submission using the memory
+		}; // struct Owner
+
+		ResidencyManager() = default;
+
+		ResidencyManager(const ResidencyManager&) = delete;
+		auto operator= (const ResidencyManager&)-> ResidencyManager& = delete;
+
+		auto track(const vuh::Device& device, const Owner& owner
+		           , std::size_t size_bytes, vk::BufferUsageFlags usage) noexcept-> void;
+		auto retrack(const Owner& owner) noexcept-> void;
+		auto untrack(vk::DeviceMemory memory) noexcept-> void;
+		auto touch(vuh::Device& device, vk::DeviceMemory memory)-> void;
+		auto makeRoom(vuh::Device& device, vk::Buffer buffer, vk::MemoryPropertyFlags flags)-> void;
+		auto evict(vuh::Device& device, uint32_t heap_id, std::size_t size_bytes
+		           , vk::DeviceMemory keep={})-> std::size_t;
+
+		auto isTracked(vk::DeviceMemory memory) const-> bool;
+		auto isResident(vk::DeviceMemory memory) const-> bool;
+		auto numTracked() const-> std::size_t { return _entries.size(); }
+		auto numEvicted() const-> std::size_t;
+	private: // helpers
+		/// Tracked memory record.
+		struct Entry {
+			Owner owner;                ///< handles of the owner
+			std::size_t size_bytes;     ///< buffer size
+			vk::BufferUsageFlags usage; ///< buffer usage flags
+			uint32_t home;              ///< memory type id the memory was originally allocated in
+			uint64_t last_use;          ///< logical time of the last use
+		}; // struct Entry
+
+		auto relocate(vuh::Device& device, const std::vector<std::pair<Entry*, uint32_t>>& moves
+		              )-> std::size_t;
+	private: // data
+		std::unordered_map<VkDeviceMemory, Entry> _entries; ///< tracked memory
+		uint64_t _clock = 0;                                ///< logical time of the last use
+	}; // class ResidencyManager
+} // namespace arr
+} // namespace vuh
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <stdint.h>
+
+namespace vuh {
+	class Device;
+namespace arr {
+	/// Ring of host-visible staging memory used for host<->device transfers.
+	/// Single buffer (persistently mapped) is split to consecutive chunks handed out to transfers
+	/// in FIFO order. Chunk is recycled when its handle is destroyed, which for async transfers
+	/// happens only after the corresponding fence is signalled. Out-of-order releases are fine,
+	/// space is only reclaimed up to the oldest chunk still in use though.
+	/// When the request does not fit the free space of the ring, the chunk gets a transient
+	/// buffer of its own, so transfers never block on the ring.
+	/// Ring does not keep a reference to the device, same as MemoryPool.
+	/// Not thread-safe, same as the vuh::Device it belongs to.
+	class StagingRing {
+	public:
+		static constexpr std::size_t default_size = std::size_t(16) << 20; ///< 16MB
+
+		/// Transfer direction defines the kind of memory the ring is allocated in.
+		enum class Direction {
+			Upload,  ///< host to device, host-coherent memory
+			Readback ///< device to host, host-cached memory
+		};
+
+		/// Staging memory chunk of the ring (or a transient buffer if ring was full).
+		/// Movable handle, the chunk is given back to the ring on destruction.
+		class Chunk {
+		public:
+			Chunk(Chunk&& other) noexcept;
+			auto operator= (Chunk&& other) noexcept-> Chunk&;
+			~Chunk() noexcept;
+
+			Chunk(const Chunk&) = delete;
+			auto operator= (const Chunk&)-> Chunk& = delete;
+
+			/// @return buffer the chunk belongs to
+			auto buffer() const-> vk::Buffer { return _buffer; }
+			/// @return offset (bytes) of the chunk wrt the beginning of the buffer
+			auto offset() const-> std::size_t { return _offset; }
+			/// @return size (bytes) of the chunk
+			auto size() const-> std::size_t { return _size; }
+			/// @return host pointer to the beginning of the chunk
+			auto data() const-> void* { return _data; }
+			/// @return true if chunk has its own transient buffer instead of being a part of the ring
+			auto isTransient() const-> bool { return _ring == nullptr; }
+
+			auto memoryProperties() const-> vk::MemoryPropertyFlags;
+			auto flush() const-> void;
+			auto invalidate() const-> void;
+		private: // helpers
+			friend class StagingRing;
+			Chunk(vuh::Device& device, StagingRing* ring, vk::Buffer buffer, vk::DeviceMemory memory
+			      , uint32_t memid, std::size_t offset, std::size_t size, void* data);
+			auto mappedRange() const-> vk::MappedMemoryRange;
+			auto release() noexcept-> void;
+		private: // data
+			vuh::Device* _device;     ///< device staging memory belongs to
+			StagingRing* _ring;       ///< ring the chunk was taken from, nullptr for transient chunks
+			vk::Buffer _buffer;       ///< staging buffer
+			vk::DeviceMemory _memory; ///< memory bound to the staging buffer
+			uint32_t _memid;          ///< memory type id
+			std::size_t _offset;      ///< chunk offset wrt the beginning of the buffer (bytes)
+			std::size_t _size;        ///< chunk size (bytes)
+			void* _data;              ///< host pointer to the beginning of the chunk
+		}; // class Chunk
+
+		StagingRing(vuh::Device& device, Direction direction, std::size_t size=default_size);
+		~StagingRing() noexcept;
+
+		StagingRing(const StagingRing&) = delete;
+		auto operator= (const StagingRing&)-> StagingRing& = delete;
+
+		auto acquire(vuh::Device& device, std::size_t size_bytes)-> Chunk;
+		auto release(vuh::Device& device) noexcept-> void;
+		auto memoryProperties(const vuh::Device& device) const-> vk::MemoryPropertyFlags;
+
+		/// @return ring capacity (bytes)
+		auto size() const-> std::size_t { return _size; }
+		/// @return transfer direction the ring is used for
+		auto direction() const-> Direction { return _direction; }
+		/// @return number of chunks currently in use
+		auto numChunks() const-> std::size_t { return _segments.size(); }
+	private: // helpers
+		/// Range of the ring memory taken by a chunk.
+		struct Segment {
+			std::size_t offset;  ///< offset of the range (bytes)
+			bool released;       ///< true if chunk is released but the range is not yet reclaimed
+		};
+
+		auto reserve(std::size_t size)-> std::size_t;
+		auto recycle(std::size_t offset) noexcept-> void;
+	private: // data
+		Direction _direction;           ///< transfer direction
+		vk::Buffer _buffer;             ///< ring buffer
+		vk::DeviceMemory _memory;       ///< ring memory
+		uint32_t _memid;                ///< memory type id
+		std::size_t _size;              ///< ring capacity (bytes)
+		std::size_t _alignment;         ///< alignment of chunks offsets and sizes
+		void* _mapped = nullptr;        ///< host pointer to the beginning of ring memory
+		std::size_t _head = 0;          ///< offset of the first byte past the most recent chunk
+		std::deque<Segment> _segments;  ///< chunks in use ordered by the time of acquisition
+	}; // class StagingRing
+} // namespace arr
+} // namespace vuh
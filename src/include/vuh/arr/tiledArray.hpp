@@ -0,0 +1,265 @@
+#pragma once
+
+#include "allocDevice.hpp"
+#include "arrayProperties.h"
+#include "arrayView.hpp"
+#include "copy_async.hpp"
+#include "deviceArray.hpp"
+
+#include <vuh/delayed.hpp>
+#include <vuh/device.h>
+#include <vuh/mappedFile.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+namespace vuh {
+namespace arr {
+
+/// Out-of-core array. The full data set is kept in the host store (host memory or a memory-mapped
+/// file range), while only a fixed number of its tiles are resident in the device memory at a time.
+/// Tiles are paged in on access (see tile()), least recently used tile being evicted when all
+/// device slots are taken. Tiles accessed for writing are written back to the store on eviction
+/// and on writeBack().
+/// Loading of the next tile may be started with prefetch() while the current one is being processed,
+/// so that the transfer overlaps with computation:
+/// @code
+/// for(size_t i = 0; i < data.numTiles(); ++i){
+///    auto tile = data.tile(i);
+///    auto fence = program.run_async(tile);
+///    data.prefetch(i + 1);
+///    fence.wait();
+/// }
+/// data.writeBack();
+/// @endcode
+/// Eviction does not synchronize with kernels. With n device slots the n - 1 most recently
+/// accessed tiles are never evicted by prefetch(), older ones should not be in use by the device
+/// when a tile is accessed or prefetched.
+/// Staging rings of the device are grown to take at least two tiles (see Device::setStagingRingSize()),
+/// so that the tile loads are staged in one piece instead of being streamed (which blocks).
+/// Destruction waits for the pending tile loads, dirty tiles are NOT written back.
+/// Store is not owned by the array and should outlive it.
+template<class T, class Alloc=AllocDevice<properties::Device>>
+class TiledArray {
+	using Array = DeviceArray<T, Alloc>;
+public:
+	using value_type = T;
+	using array_type = Array;
+	static constexpr auto no_tile = std::size_t(-1); ///< tile id of the empty slot
+
+	/// How the tile is going to be accessed by the device.
+	enum class Access {
+		Read,      ///< tile is loaded from the store, never written back
+		Write,     ///< tile is not loaded (content is undefined), written back to the store
+		ReadWrite  ///< tile is loaded from the store and written back to it
+	};
+
+	/// Constructor. Tiles are paged between the host memory range and the device.
+	/// Tile size is rounded down to the number of elements in the whole store.
+	TiledArray(vuh::Device& device      ///< device to keep resident tiles on
+	          , HostSpan<T> store       ///< host memory holding the full data set
+	          , std::size_t tile_size   ///< number of elements in a tile (last tile may be shorter)
+	          , std::size_t num_slots=2 ///< number of tiles resident in device memory at a time
+	          , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	          , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : _store(store)
+	   , _tile_size(std::max(std::min(tile_size, store.size()), std::size_t(1)))
+	   , _tiles(device, _tile_size*std::max(num_slots, std::size_t(1)), flags_memory, flags_buffer)
+	   , _slots(std::max(num_slots, std::size_t(1)))
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "array values should be trivially copyable");
+		reserveStaging(device);
+	}
+
+	/// Constructor. Tiles are paged between the memory-mapped file range and the device.
+	/// File pages of the prefetched tiles are requested from the OS ahead of time.
+	/// Tiles of the read-only mapping can only be accessed for reading.
+	/// Written back tiles reach the file on writeBack().
+	TiledArray(vuh::Device& device       ///< device to keep resident tiles on
+	          , const MappedFile& store  ///< mapping of the file range holding the full data set
+	          , std::size_t tile_size    ///< number of elements in a tile (last tile may be shorter)
+	          , std::size_t num_slots=2  ///< number of tiles resident in device memory at a time
+	          , vk::MemoryPropertyFlags flags_memory={} ///< additional (to defined by allocator) memory usage flags
+	          , vk::BufferUsageFlags flags_buffer={})   ///< additional (to defined by allocator) buffer usage flags
+	   : TiledArray(device, HostSpan<T>(static_cast<T*>(store.data()), store.size()/sizeof(T))
+	                , tile_size, num_slots, flags_memory, flags_buffer)
+	{
+		_file = &store;
+	}
+
+	TiledArray(TiledArray&&) = default;
+	auto operator= (TiledArray&&)-> TiledArray& = default;
+
+	/// @return view into the device memory holding the tile, for binding to a Program or use in copies.
+	/// Tile is loaded from the store if it is not resident yet (unless accessed only for writing),
+	/// or the pending prefetch is waited for. The view is valid till the tile is evicted.
+	auto tile(std::size_t i, Access access=Access::ReadWrite)-> ArrayView<Array> {
+		assert(i < numTiles());
+		assert(access == Access::Read || _file == nullptr || _file->mode() == MappedFile::Mode::Write);
+		auto s = findSlot(i);
+		if(s == no_tile){
+			s = evict();
+			if(access != Access::Write){
+				load(s, i);
+			}
+			_slots[s].tile = i;
+		}
+		auto& slot = _slots[s];
+		if(slot.pending){
+			slot.pending->wait();
+			slot.pending.reset();
+		}
+		slot.dirty = slot.dirty || access != Access::Read;
+		slot.last_use = ++_clock;
+		return array_view(_tiles, s*_tile_size, s*_tile_size + tileSize(i));
+	}
+
+	/// Start loading the tile to device memory in the background, so that the subsequent
+	/// tile() call does not block on the transfer.
+	/// Only the device side of the transfer is async (see copy_async()), the tile is copied
+	/// to the staging memory before the call returns.
+	/// Noop if the tile is already resident or index is past the last tile.
+	auto prefetch(std::size_t i)-> void {
+		if(i >= numTiles() || findSlot(i) != no_tile){
+			return;
+		}
+		const auto s = evict();
+		load(s, i);
+		_slots[s].tile = i;
+		_slots[s].last_use = ++_clock;
+	}
+
+	/// Copy the tiles accessed for writing back to the store. Writable file mappings are then
+	/// synced to the file.
+	/// Device should be done writing to the resident tiles.
+	/// @throws vuh::FileWriteFailure if syncing the file fails
+	auto writeBack()-> void {
+		for(std::size_t s = 0; s < _slots.size(); ++s){
+			store(s);
+		}
+		if(_file){
+			_file->sync();
+		}
+	}
+
+	/// @return true if the tile is resident in device memory (possibly still being loaded)
+	auto isResident(std::size_t i) const-> bool { return findSlot(i) != no_tile; }
+
+	/// @return number of elements in the whole data set
+	auto size() const-> std::size_t { return _store.size(); }
+	/// @return number of tiles the data set is split to
+	auto numTiles() const-> std::size_t { return (_store.size() + _tile_size - 1)/_tile_size; }
+	/// @return number of elements in a (full) tile
+	auto tileSize() const-> std::size_t { return _tile_size; }
+	/// @return number of elements in the given tile
+	auto tileSize(std::size_t i) const-> std::size_t {
+		return std::min(_tile_size, _store.size() - i*_tile_size);
+	}
+	/// @return number of tiles resident in device memory at a time
+	auto numSlots() const-> std::size_t { return _slots.size(); }
+	/// @return device array holding the resident tiles
+	auto array()-> Array& { return _tiles; }
+	/// @return device the tiles are resident on
+	auto device()-> vuh::Device& { return _tiles.device(); }
+private: // helpers
+	/// Device slot holding a tile.
+	struct Slot {
+		std::size_t tile = no_tile;              ///< tile id held by the slot
+		uint64_t last_use = 0;                   ///< logical time of the last access
+		bool dirty = false;                      ///< true if tile should be written back on eviction
+		std::unique_ptr<Delayed<Copy>> pending;  ///< tile load in progress, nullptr if none
+	};
+
+	/// Grow the device staging rings to take two tiles, if those are smaller and tiles are not
+	/// host-visible, so that a tile load fits in a single staging chunk (see arr::streamChunkSize()).
+	/// Rings with chunks in use are left as they are, loads of the big tiles are then streamed.
+	auto reserveStaging(vuh::Device& device)-> void {
+		if(_tiles.isHostVisible()){
+			return;
+		}
+		const auto atom = std::max(std::size_t(device.properties().limits.nonCoherentAtomSize)
+		                           , alignof(std::max_align_t));
+		const auto size_bytes = 2*(_tile_size*sizeof(T) + atom); // ring size is rounded down to the atom
+		if(device.stagingRingSize() < size_bytes){
+			try {
+				device.setStagingRingSize(size_bytes);
+			} catch(std::logic_error&) {
+			}
+		}
+	}
+
+	/// @return index of the slot holding given tile, no_tile if tile is not resident
+	auto findSlot(std::size_t i) const-> std::size_t {
+		for(std::size_t s = 0; s < _slots.size(); ++s){
+			if(_slots[s].tile == i){
+				return s;
+			}
+		}
+		return no_tile;
+	}
+
+	/// Free the slot to hold another tile. Empty slots are taken first, then the least recently used.
+	/// Dirty tile is written back before the slot is reused.
+	/// @return index of the freed slot
+	auto evict()-> std::size_t {
+		auto r = std::size_t(0);
+		for(std::size_t s = 0; s < _slots.size(); ++s){
+			if(_slots[s].tile == no_tile){
+				return s;
+			}
+			if(_slots[s].last_use < _slots[r].last_use){
+				r = s;
+			}
+		}
+		store(r);
+		_slots[r].pending.reset();
+		_slots[r].tile = no_tile;
+		return r;
+	}
+
+	/// Start async copy of the tile from the store to the slot.
+	auto load(std::size_t s, std::size_t i)-> void {
+		const auto begin = i*_tile_size;
+		const auto size = tileSize(i);
+		if(_file){
+			_file->prefetch(begin*sizeof(T), size*sizeof(T));
+		}
+		auto src = _store.data() + begin;
+		_slots[s].pending = std::make_unique<Delayed<Copy>>(
+		                       copy_async(src, src + size, device_begin(_tiles) + s*_tile_size));
+		_slots[s].dirty = false;
+	}
+
+	/// Copy the tile held by the slot back to the store if that was accessed for writing.
+	auto store(std::size_t s)-> void {
+		auto& slot = _slots[s];
+		if(slot.pending){
+			slot.pending->wait();
+			slot.pending.reset();
+		}
+		if(slot.tile == no_tile || !slot.dirty){
+			return;
+		}
+		const auto offset = s*_tile_size;
+		_tiles.rangeToHost(offset, offset + tileSize(slot.tile), _store.data() + slot.tile*_tile_size);
+		slot.dirty = false;
+	}
+private: // data
+	HostSpan<T> _store;                ///< host memory holding the full data set
+	const MappedFile* _file = nullptr; ///< file mapping of the store, nullptr if store is not a file
+	std::size_t _tile_size;            ///< number of elements in a (full) tile
+	Array _tiles;                      ///< device memory holding resident tiles, tile size per slot
+	std::vector<Slot> _slots;          ///< device slots, destroyed first so that pending loads complete
+	uint64_t _clock = 0;               ///< logical time of the last tile access
+}; // class TiledArray
+
+} // namespace arr
+} // namespace vuh
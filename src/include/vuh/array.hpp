@@ -1,11 +1,19 @@
 #pragma once
 
+#include "arr/allocArena.hpp"
+#include "arr/allocAuto.hpp"
+#include "arr/allocExternal.hpp"
+#include "arr/allocHostImport.hpp"
+#include "arr/allocPool.hpp"
 #include "arr/arrayProperties.h"
 #include "arr/arrayIter.hpp"
 #include "arr/arrayView.hpp"
 #include "arr/copy_async.hpp"
 #include "arr/deviceArray.hpp"
 #include "arr/hostArray.hpp"
+#include "arr/packedArray.hpp"
+#include "arr/tiledArray.hpp"
+#include "pinnedAllocator.hpp"
 
 namespace vuh {
 namespace detail {
@@ -38,8 +46,30 @@ namespace mem {
 	using Host = arr::AllocDevice<arr::properties::Host>;
 	using HostCached = arr::AllocDevice<arr::properties::HostCached>;
 	using HostCoherent = arr::AllocDevice<arr::properties::HostCoherent>;
+	using HostImport = arr::AllocHostImport<arr::properties::Host>;
+	using Auto = arr::AllocAuto<arr::AllocDevice<arr::properties::Device>>; ///< unified memory if device has it, device-local otherwise
+	using External = arr::AllocExternal<arr::properties::Device>; ///< device-local memory shared with other processes
 } // namespace mem
 
+/// defines shortcut allocator types sub-allocating memory from the device memory pool
+namespace pool {
+	using DeviceOnly = arr::AllocPool<arr::properties::DeviceOnly>;
+	using Device = arr::AllocPool<arr::properties::Device>;
+	using Unified = arr::AllocPool<arr::properties::Unified>;
+	using Host = arr::AllocPool<arr::properties::Host>;
+	using HostCached = arr::AllocPool<arr::properties::HostCached>;
+	using HostCoherent = arr::AllocPool<arr::properties::HostCoherent>;
+	using Auto = arr::AllocAuto<arr::AllocPool<arr::properties::Device>>; ///< unified memory if device has it, device-local otherwise
+} // namespace pool
+
+/// defines shortcut allocator types taking memory from arr::Arena.
+/// Arrays with these allocators are constructed on the arena object in place of device.
+namespace arena {
+	using DeviceOnly = arr::AllocArena<arr::properties::DeviceOnly>;
+	using Device = arr::AllocArena<arr::properties::Device>;
+	using Host = arr::AllocArena<arr::properties::Host>;
+} // namespace arena
+
 /// Maps Array classes with different data exchange interfaces, to a single templated type.
 /// This enables std::vector-like type declarations of Arrays with different allocators.
 /// Althogh in this case resulting classes have different data exchange interfaces,
@@ -47,4 +77,17 @@ namespace mem {
 template<class T, class Alloc=arr::AllocDevice<arr::properties::Device>>
 using Array = typename detail::ArrayClass<typename Alloc::properties_t>::template type<T, Alloc>;
 
+/// Many small typed arrays packed into a single buffer.
+template<class Alloc=arr::AllocDevice<arr::properties::Device>>
+using PackedArray = arr::PackedArray<Alloc>;
+using arr::PackedLayout;
+using arr::packed_stage;
+
+/// Array memory shared with other processes (see mem::External).
+using arr::ExternalMemory;
+
+/// Out-of-core array paging the tiles of the host-side data set to the device memory.
+template<class T, class Alloc=arr::AllocDevice<arr::properties::Device>>
+using TiledArray = arr::TiledArray<T, Alloc>;
+
 } // namespace vuh
@@ -2,14 +2,44 @@
 
 #include <vulkan/vulkan.hpp>
 #include <vuh/device.h>
+#include <vuh/releaseQueue.h>
 #include <vuh/resource.hpp>
 
 #include <cassert>
+#include <exception>
 
 namespace vuh {
 	namespace detail{
 		/// No action. Runnable with operator()() doing nothing.
-		struct Noop{ constexpr auto operator()() const noexcept-> void{}; };
+		struct Noop{
+			constexpr auto operator()() const noexcept-> void{};
+			/// Nothing to do at the sync point, so waiting is not needed.
+			constexpr auto releasesOnly() const noexcept-> bool { return true; }
+		};
+
+		/// @return true if the action only releases resources (and does nothing observable
+		/// by the caller), so that it may be postponed instead of waiting for it.
+		/// Actions opt-in by providing releasesOnly() member function.
+		template<class Action>
+		auto releases_only(const Action& action, int)-> decltype(action.releasesOnly()) {
+			return action.releasesOnly();
+		}
+
+		/// Actions not providing releasesOnly() are waited for.
+		template<class Action>
+		auto releases_only(const Action&, long)-> bool { return false; }
+
+		/// @return exception the action ended with, empty if none.
+		/// Actions doing the work that may fail outside of the calling thread opt-in by providing
+		/// error() member function.
+		template<class Action>
+		auto action_error(const Action& action, int)-> decltype(action.error()) {
+			return action.error();
+		}
+
+		/// Actions not providing error() report nothing.
+		template<class Action>
+		auto action_error(const Action&, long)-> std::exception_ptr { return nullptr; }
 	}
 
 	/// Class used for synchronization with host.
@@ -24,18 +54,24 @@ namespace vuh {
 	/// is signalled.
 	/// If no fence is passed to the contructor of Delayed object the fence in signalled
 	/// state is created under the hood.
+	/// Fences of the submissions are handed over to the device release queue (see ReleaseQueue).
+	/// When the action only releases resources (as that of async computation or a copy not
+	/// involving host) the object may be detach()-ed instead of waited for. That does not block,
+	/// and resources are released by the queue after the submission completes.
 	/// The corresponding action will necessarily take place once and only once, whether
 	/// it is at the explicit wait() call or at object destruction.
 	template<class Action=detail::Noop>
 	class Delayed: public vk::Fence, private Action {
 		template<class> friend class Delayed;
 	public:
-		/// Constructor. Takes ownership of the fence.
-		/// It is assumed that the fence belongs to the same device that is passed together with it.
+		/// Constructor. Fence is handed over to the release queue of the device.
+		/// It is assumed that the fence belongs to the same device that is passed together with it,
+		/// and is signalled on completion of the submission just made.
 		Delayed(vk::Fence fence, vuh::Device& device, Action action={})
 		   : vk::Fence(fence)
 		   , Action(std::move(action))
 		   , _device(&device)
+		   , _serial(device.releaseQueue().track(device, fence))
 		{}
 
 		/// Constructor. Creates the fence in a signalled state.
@@ -50,6 +86,7 @@ namespace vuh {
 		/// Mostly substitute its own action in place of Noop.
 		explicit Delayed(Delayed<detail::Noop>&& noop, Action action={})
 		   : vk::Fence(std::move(noop)), Action(std::move(action)), _device(std::move(noop._device))
+		   , _serial(noop._serial)
 		{}
 
 		/// Destructor. Blocks till the undelying fence is signalled (waits forever).
@@ -69,6 +106,7 @@ namespace vuh {
 			static_cast<vk::Fence&>(*this) = std::move(static_cast<vk::Fence&>(other));
 			static_cast<Action&>(*this) = std::move(static_cast<Action&>(other));
 			_device = std::move(other._device);
+			_serial = other._serial;
 			return *this;
 		}
 
@@ -76,6 +114,8 @@ namespace vuh {
 		/// given time period has elapsed.
 		/// If the fence was signalled - triggers the Action and releases vulkan resources
 		/// associated with the object (not waiting for destructor actually).
+		/// The fence is released only after the Action, which may still be waiting for it
+		/// on another thread (see copy_async() with vuh::host_async).
 		/// If exits by the timer event - no action is taken.
 		/// All is postponed till another wait() call or destructor.
 		/// The function can be safely called arbitrary number of times.
@@ -86,14 +126,53 @@ namespace vuh {
 			if(_device){
 				_device->waitForFences({*this}, true, period);
 				if(_device->getFenceStatus(*this) == vk::Result::eSuccess){
-					_device->destroyFence(*this);
-					static_cast<Action&>(*this)(); // exercise action
+					static_cast<Action&>(*this)(); // exercise action, it may still refer the fence
+					if(_serial != 0){ // fence is owned by the release queue
+						_device->releaseQueue().detach(*_device, _serial);
+					} else {
+						_device->destroyFence(*this);
+					}
 					_device.release();
 				}
 			}
 		}
+
+		/// Give up the synchronization with the submission without blocking.
+		/// Resources kept alive by the action are released by the device release queue after
+		/// the submission completes. Actions doing more than releasing resources (like copying data
+		/// to host) can not be postponed, and are waited for same as with wait().
+		/// The object is not associated with any submission after the call.
+		auto detach() noexcept-> void {
+			if(_device && _serial != 0 && detail::releases_only(static_cast<const Action&>(*this), 0)){
+				try {
+					auto& releases = _device->releaseQueue();
+					releases.defer(_serial, std::move(static_cast<Action&>(*this)));
+					releases.detach(*_device, _serial);
+					_device.release();
+					return;
+				} catch(std::exception&) { // could not postpone (action is intact), just wait
+				}
+			}
+			wait();
+		}
+
+		/// Wait for the submission and the action to complete (same as wait() with no time limit),
+		/// and rethrow the exception the action ended with, if any.
+		/// Only actions doing their work outside of the calling thread report errors this way
+		/// (see copy_async() with vuh::host_async). wait() and destructor never throw, errors
+		/// are lost if get() is not called.
+		auto get()-> void {
+			wait();
+			if(const auto error = detail::action_error(static_cast<const Action&>(*this), 0)){
+				std::rethrow_exception(error);
+			}
+		}
+
+		/// @return number given to the submission by the device release queue, 0 if there is none.
+		auto serial() const-> uint64_t { return _serial; }
 	private: // data
 		std::unique_ptr<Device, util::NoopDeleter<Device>> _device; ///< refers to the device owning corresponding the underlying fence.
+		uint64_t _serial = 0; ///< submission number in the device release queue, 0 if fence is not tracked
 	}; // class Delayed
 
 	/// Delayed No-Action. Just a synchronization point.
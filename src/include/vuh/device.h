@@ -2,10 +2,19 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <array>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace vuh {
 	class Instance;
+	class MemoryStats;
+	class ReleaseQueue;
+	class WorkerPool;
+	namespace arr { class MemoryPool; class PinnedHeap; class ResidencyManager; class StagingRing; }
 
 	/// Logical device packed with associated command pools and buffers.
 	/// Holds the pool(s) for transfer and compute operations as well as command
@@ -15,8 +24,37 @@ namespace vuh {
 	/// to the same physical device. Such that copying the Device object might be
 	/// a convenient (although somewhat resource consuming) way to use device from
 	/// different threads.
+	/// Physical device properties and memory types are read once at construction.
+	/// Device memory allocated through this class (and not the vk::Device base) is accounted
+	/// per memory heap, so that memory types can be selected based on the available capacity.
+	/// Memory taken by arrays is additionally reported by memoryStats().
+	/// With residency management enabled (see enableResidency()) least recently used device-local
+	/// arrays are evicted to host memory to make room for the new ones.
+	/// Resources destroyed while still in use by async submissions are released later
+	/// (see releaseQueue()).
+	/// With VK_EXT_external_memory_host supported existing host allocations can be imported
+	/// as device memory (see importHostMemory()).
+	/// With VK_KHR_external_memory_fd supported device memory can be shared with other processes
+	/// through file descriptors (see exportMemoryFd(), importMemoryFd()).
+	/// Host-side stages of async transfers may be offloaded to the device worker threads
+	/// (see workerPool()).
 	class Device: public vk::Device {
 	public:
+		/// Memory heap budget.
+		struct HeapBudget {
+			vk::DeviceSize usage;  ///< bytes currently allocated in the heap
+			vk::DeviceSize budget; ///< estimate of how many bytes may be allocated in the heap without failure
+		};
+
+		/// Buffer memory requirements together with the driver preference for dedicated allocation.
+		struct BufferRequirements {
+			vk::MemoryRequirements memory; ///< memory requirements
+			bool prefers_dedicated;        ///< driver prefers dedicated allocation for the buffer
+			bool requires_dedicated;       ///< driver requires dedicated allocation for the buffer
+		};
+
+		static constexpr std::size_t default_dedicated_threshold = std::size_t(256) << 20; ///< 256MB
+
 		explicit Device(vuh::Instance& instance, vk::PhysicalDevice physdevice);
 		~Device() noexcept;
 
@@ -26,17 +64,40 @@ namespace vuh {
 		auto operator=(Device&&) noexcept-> Device&;
 		friend auto swap(Device& d1, Device& d2)-> void;
 
-		auto properties() const-> vk::PhysicalDeviceProperties;
+		auto properties() const-> const vk::PhysicalDeviceProperties& { return _properties; }
 		auto numComputeQueues() const-> uint32_t { return 1u;}
 		auto numTransferQueues() const-> uint32_t { return 1u;}
+		auto memoryProperties() const-> const vk::PhysicalDeviceMemoryProperties& { return _memprops; }
 		auto memoryProperties(uint32_t id) const-> vk::MemoryPropertyFlags;
+		auto mapAlignment(uint32_t id) const-> vk::DeviceSize;
 		auto selectMemory(vk::Buffer buffer, vk::MemoryPropertyFlags properties) const-> uint32_t;
 		auto instance() const-> const vuh::Instance& {return _instance;}
 		auto hasSeparateQueues() const-> bool;
+		auto hasUnifiedMemory() const-> bool;
+		auto hasExtension(const char* name) const-> bool;
+		auto heapBudget(uint32_t heap_id) const-> HeapBudget;
+		auto heapAvailable(uint32_t heap_id) const-> vk::DeviceSize;
+		auto limitHeap(uint32_t heap_id, vk::DeviceSize available)-> void;
 
 		auto computeQueue(uint32_t i = 0)-> vk::Queue;
 		auto transferQueue(uint32_t i = 0)-> vk::Queue;
 		auto alloc(vk::Buffer buf, uint32_t memory_id)-> vk::DeviceMemory;
+		auto allocateMemory(const vk::MemoryAllocateInfo& info)-> vk::DeviceMemory;
+		auto allocateDedicated(vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id)-> vk::DeviceMemory;
+		auto bufferRequirements(vk::Buffer buffer) const-> BufferRequirements;
+		auto useDedicated(const BufferRequirements& requirements) const-> bool;
+		auto dedicatedThreshold() const-> std::size_t { return _dedicated_threshold; }
+		auto setDedicatedThreshold(std::size_t size_bytes)-> void { _dedicated_threshold = size_bytes; }
+		auto hostImportAlignment() const-> vk::DeviceSize { return _host_import_alignment; }
+		auto hostPointerMemoryTypes(const void* ptr) const-> uint32_t;
+		auto importHostMemory(void* ptr, vk::DeviceSize size, uint32_t memory_id)-> vk::DeviceMemory;
+		auto canExportMemory() const-> bool { return _fn_getmemfd != nullptr; }
+		auto allocateExportable(vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id
+		                        , bool dedicated)-> vk::DeviceMemory;
+		auto exportMemoryFd(vk::DeviceMemory memory)-> int;
+		auto importMemoryFd(int fd, vk::Buffer buffer, vk::DeviceSize size, uint32_t memory_id
+		                    , bool dedicated)-> vk::DeviceMemory;
+		auto freeMemory(vk::DeviceMemory memory) noexcept-> void;
 		auto computeCmdPool()-> vk::CommandPool {return _cmdpool_compute;}
 		auto computeCmdBuffer()-> vk::CommandBuffer& {return _cmdbuf_compute;}
 		auto transferCmdPool()-> vk::CommandPool;
@@ -48,13 +109,35 @@ namespace vuh {
 		                    )-> vk::Pipeline;
 		auto instance()-> vuh::Instance& { return _instance; }
 		auto releaseComputeCmdBuffer()-> vk::CommandBuffer;
-		
+		auto memoryPool()-> arr::MemoryPool&;
+		auto pinnedHeap()-> arr::PinnedHeap&;
+		auto uploadRing()-> arr::StagingRing&;
+		auto readbackRing()-> arr::StagingRing&;
+		auto setStagingRingSize(std::size_t size_bytes)-> void;
+		auto stagingRingSize() const-> std::size_t { return _ring_size; }
+		auto memoryStats() const-> MemoryStats&;
+		auto releaseQueue()-> ReleaseQueue&;
+		auto workerPool()-> WorkerPool&;
+		auto enableResidency()-> arr::ResidencyManager&;
+		auto residency()-> arr::ResidencyManager* { return _residency.get(); }
+
+		/// @return number of times the buffers of arrays were recreated in the new memory
+		/// (see arr::MemoryPool::defragment()). Programs compare it to the value at the time their
+		/// commands were recorded, and record those anew if arrays could have been moved since.
+		auto numRelocations() const-> uint64_t { return _relocations; }
+		/// Record that buffers of some arrays were recreated in the new memory.
+		auto onRelocate() noexcept-> void { ++_relocations; }
+
 	private: // helpers
 		explicit Device(vuh::Instance& instance, vk::PhysicalDevice physdevice
 		                , const std::vector<vk::QueueFamilyProperties>& families);
 		explicit Device(vuh::Instance& instance, vk::PhysicalDevice physdevice
 	                   , uint32_t computeFamilyId, uint32_t transferFamilyId);
+		explicit Device(vuh::Instance& instance, vk::PhysicalDevice physdevice
+		                , uint32_t computeFamilyId, uint32_t transferFamilyId
+		                , std::vector<const char*> extensions);
 		auto release() noexcept-> void;
+		auto updateBudget() const-> void;
 	private: // data
 		vuh::Instance&     _instance;           ///< refer to Instance object used to create device
 		vk::PhysicalDevice _physdev;            ///< handle to associated physical device
@@ -64,5 +147,29 @@ namespace vuh {
 		vk::CommandBuffer  _cmdbuf_transfer;    ///< primary command buffer associated with transfer command pool. Initialized on first transfer request.
 		uint32_t _cmp_family_id = uint32_t(-1); ///< compute queue family id. -1 if device does not have compute-capable queues.
 		uint32_t _tfr_family_id = uint32_t(-1); ///< transfer queue family id, maybe the same as compute queue id.
+		std::unique_ptr<arr::MemoryPool> _mempool; ///< pool for sub-allocated arrays memory. Initialized on first request.
+		std::unique_ptr<arr::PinnedHeap> _pinned; ///< host-coherent memory of pinned allocators. Initialized on first request.
+		std::unique_ptr<arr::StagingRing> _ring_upload;   ///< staging memory for transfers to device. Initialized on first request.
+		std::unique_ptr<arr::StagingRing> _ring_readback; ///< staging memory for transfers to host. Initialized on first request.
+		std::size_t _ring_size;                           ///< capacity (bytes) of each of staging rings
+		vk::PhysicalDeviceProperties _properties;     ///< physical device properties and limits
+		vk::PhysicalDeviceMemoryProperties _memprops; ///< memory types and heaps of physical device
+		std::vector<const char*> _extensions;         ///< optional device extensions enabled on the device
+		PFN_vkVoidFunction _fn_memprops2 = nullptr;   ///< vkGetPhysicalDeviceMemoryProperties2KHR if memory budget can be queried, nullptr otherwise
+		PFN_vkVoidFunction _fn_memreqs2 = nullptr;    ///< vkGetBufferMemoryRequirements2KHR if dedicated allocations are supported, nullptr otherwise
+		PFN_vkVoidFunction _fn_hostptrprops = nullptr; ///< vkGetMemoryHostPointerPropertiesEXT if host memory can be imported, nullptr otherwise
+		vk::DeviceSize _host_import_alignment = 0;    ///< minImportedHostPointerAlignment, 0 if host memory can not be imported
+		PFN_vkVoidFunction _fn_getmemfd = nullptr;    ///< vkGetMemoryFdKHR if memory can be shared through file descriptors, nullptr otherwise
+		std::size_t _dedicated_threshold = default_dedicated_threshold; ///< buffers of this size and bigger get dedicated allocations
+		std::unordered_map<VkDeviceMemory, std::pair<uint32_t, vk::DeviceSize>> _allocations; ///< heap id and size of each allocation made through this device
+		std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> _heap_usage{}; ///< bytes allocated through this device per heap
+		mutable std::array<HeapBudget, VK_MAX_MEMORY_HEAPS> _heap_budget{}; ///< cached heap budgets
+		mutable bool _budget_dirty = true;            ///< true if cached heap budgets need to be updated
+		std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> _heap_limit; ///< max bytes allocated through this device per heap, VK_WHOLE_SIZE if not limited
+		std::unique_ptr<MemoryStats> _stats;          ///< arrays memory usage counters
+		std::unique_ptr<arr::ResidencyManager> _residency; ///< residency manager of device-local arrays, nullptr unless enabled
+		std::unique_ptr<ReleaseQueue> _releases;      ///< resources waiting for the async submissions to complete
+		std::unique_ptr<WorkerPool> _workers;         ///< threads running host stages of async transfers. Initialized on first request.
+		uint64_t _relocations = 0;                    ///< number of times array buffers were recreated in the new memory
 	}; // class Device
 }
@@ -17,4 +17,11 @@ namespace vuh {
 		FileReadFailure(const std::string& message);
 		FileReadFailure(const char* message);
 	};
+
+	/// Exception indicating failure to write a file.
+	class FileWriteFailure: public std::runtime_error {
+	public:
+		FileWriteFailure(const std::string& message);
+		FileWriteFailure(const char* message);
+	};
 } // namespace vuh
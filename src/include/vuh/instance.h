@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <string>
 #include <vector>
 
 namespace vuh {
@@ -33,9 +34,12 @@ namespace vuh {
 		auto devices()-> std::vector<vuh::Device>;
 		auto report(const char* prefix, const char* message
 		            , VkDebugReportFlagsEXT flags=VK_DEBUG_REPORT_INFORMATION_BIT_EXT) const-> void;
+		auto hasExtension(const char* name) const-> bool;
+		auto procAddr(const char* name) const-> PFN_vkVoidFunction;
 	private: // helpers
 		auto clear() noexcept-> void;
 	private: // data
+		std::vector<std::string> _extensions; ///< names of extensions enabled on the instance
 		vk::Instance _instance;     ///< vulkan instance
 		debug_reporter_t _reporter; ///< points to actual reporting function. This pointer is registered with a reporter callback but can also be used directly.
 		VkDebugReportCallbackEXT _reporter_cbk; ///< report callback. Only used to release the handle in the end.
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace vuh {
+	/// Memory mapping of the byte range of a file.
+	/// Read-only mapping is advised for sequential access, so that the OS reads ahead aggressively.
+	/// Writable mapping is shared, writes through it reach the file (extended to hold the range
+	/// if necessary) when pages are written back by the OS, or on sync().
+	/// Used as a source or sink of transfers to/from device arrays (see copy_async()),
+	/// such that file pages go straight to the staging memory with no intermediate host buffer.
+	class MappedFile {
+	public:
+		static constexpr std::size_t whole_file = std::size_t(-1); ///< map till the end of file
+
+		/// Access mode.
+		enum class Mode {
+			Read, ///< read-only mapping of existing file
+			Write ///< writable mapping, file is created and extended as needed
+		};
+
+		MappedFile(const std::string& path, std::size_t offset=0, std::size_t size=whole_file
+		           , Mode mode=Mode::Read);
+		~MappedFile() noexcept;
+
+		MappedFile(MappedFile&& other) noexcept;
+		auto operator= (MappedFile&& other) noexcept-> MappedFile&;
+		MappedFile(const MappedFile&) = delete;
+		auto operator= (const MappedFile&)-> MappedFile& = delete;
+
+		/// @return pointer to the beginning of the mapped range
+		auto data() const-> void* { return _data; }
+		/// @return size (bytes) of the mapped range
+		auto size() const-> std::size_t { return _size; }
+		/// @return access mode of the mapping
+		auto mode() const-> Mode { return _mode; }
+
+		auto prefetch(std::size_t offset, std::size_t size) const noexcept-> void;
+		auto discard(std::size_t offset, std::size_t size) const noexcept-> void;
+		auto sync() const-> void;
+	private: // helpers
+		auto release() noexcept-> void;
+		auto pages(std::size_t offset, std::size_t size) const noexcept-> std::pair<char*, std::size_t>;
+	private: // data
+		void* _map = nullptr;      ///< beginning of the mapping (aligned to the mapping granularity)
+		std::size_t _map_size = 0; ///< size of the mapping (bytes)
+		char* _data = nullptr;     ///< beginning of the mapped range
+		std::size_t _size = 0;     ///< size of the mapped range (bytes)
+		Mode _mode;                ///< access mode
+	}; // class MappedFile
+
+	/// @return mapping of the byte range of a file
+	inline auto mapped_file(const std::string& path ///< file path
+	                        , std::size_t offset=0  ///< offset (bytes) of the range wrt the beginning of file
+	                        , std::size_t size=MappedFile::whole_file ///< size (bytes) of the range
+	                        , MappedFile::Mode mode=MappedFile::Mode::Read ///< access mode
+	                        )-> MappedFile
+	{
+		return MappedFile(path, offset, size, mode);
+	}
+} // namespace vuh
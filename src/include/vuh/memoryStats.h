@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace vuh {
+	/// Live counters of the memory taken by arrays created on a device.
+	/// Updated on array construction and release, on allocator fall-backs,
+	/// and when arrays memory is evicted or restored by the residency manager.
+	/// Counters are relaxed atomics, so those are cheap to update and may be read at any time
+	/// from any thread (values read concurrently with the updates are not mutually consistent).
+	class MemoryStats {
+	public:
+		/// Number of allocation latency histogram buckets. Bucket i counts allocations which took
+		/// [2^(i-1), 2^i) microseconds (bucket 0 - less than a microsecond), last bucket is open-ended.
+		static constexpr std::size_t num_latency_buckets = 24;
+
+		/// Snapshot of the usage counters of memory type, heap or the whole device.
+		struct Usage {
+			uint64_t count = 0;       ///< number of live allocations
+			uint64_t total = 0;       ///< number of allocations made
+			uint64_t bytes = 0;       ///< bytes currently allocated
+			uint64_t peak_bytes = 0;  ///< high watermark of allocated bytes
+		};
+
+		explicit MemoryStats(const vk::PhysicalDeviceMemoryProperties& properties);
+
+		MemoryStats(const MemoryStats&) = delete;
+		auto operator= (const MemoryStats&)-> MemoryStats& = delete;
+
+		auto onAllocate(uint32_t memory_id, std::size_t size_bytes
+		                , std::chrono::steady_clock::duration latency) noexcept-> void;
+		auto onFree(uint32_t memory_id, std::size_t size_bytes) noexcept-> void;
+		auto onMove(uint32_t from_id, uint32_t to_id, std::size_t size_bytes) noexcept-> void;
+		auto onFallback() noexcept-> void;
+
+		auto memoryType(uint32_t memory_id) const-> Usage;
+		auto heap(uint32_t heap_id) const-> Usage;
+		auto total() const-> Usage;
+		auto fallbacks() const-> uint64_t;
+		auto latencyHistogram() const-> std::array<uint64_t, num_latency_buckets>;
+		auto resetPeaks() noexcept-> void;
+		auto toJson() const-> std::string;
+	private: // helpers
+		/// Atomic counterpart of Usage.
+		struct Counters {
+			std::atomic<uint64_t> count{0};
+			std::atomic<uint64_t> total{0};
+			std::atomic<uint64_t> bytes{0};
+			std::atomic<uint64_t> peak_bytes{0};
+
+			auto add(std::size_t size_bytes, bool is_new=true) noexcept-> void;
+			auto remove(std::size_t size_bytes) noexcept-> void;
+			auto snapshot() const-> Usage;
+		};
+	private: // data
+		uint32_t _num_types;                                     ///< number of memory types of the device
+		uint32_t _num_heaps;                                     ///< number of memory heaps of the device
+		std::array<uint32_t, VK_MAX_MEMORY_TYPES> _type_heap{};  ///< heap index of each memory type
+		std::array<Counters, VK_MAX_MEMORY_TYPES> _types;        ///< per memory type counters
+		std::array<Counters, VK_MAX_MEMORY_HEAPS> _heaps;        ///< per memory heap counters
+		Counters _total;                                         ///< device-wide counters
+		std::atomic<uint64_t> _fallbacks{0};                     ///< number of allocator fall-backs
+		std::array<std::atomic<uint64_t>, num_latency_buckets> _latency; ///< allocation latency histogram
+	}; // class MemoryStats
+} // namespace vuh
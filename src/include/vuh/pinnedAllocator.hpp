@@ -0,0 +1,126 @@
+#pragma once
+
+#include "device.h"
+#include "arr/pinnedHeap.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+namespace vuh {
+	/// Standard allocator handing out persistently mapped host-coherent memory of the device
+	/// (see arr::PinnedHeap).
+	/// Containers using it (std::vector<T, vuh::pinned_allocator<T>>) keep their data in memory
+	/// the device can access directly, so that data can be passed to copy_async() or bound
+	/// to a kernel (see pinned_span()) without an intermediate copy.
+	/// The device should outlive the containers using the allocator.
+	template<class T>
+	class pinned_allocator {
+	public:
+		using value_type = T;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		template<class U> struct rebind { using other = pinned_allocator<U>; };
+
+		/// Constructor. Memory is taken from the pinned heap of the given device.
+		explicit pinned_allocator(vuh::Device& device) noexcept: _device(&device) {}
+
+		/// Converting constructor. Resulting allocator uses the same device.
+		template<class U>
+		pinned_allocator(const pinned_allocator<U>& other) noexcept: _device(&other.device()) {}
+
+		/// Allocate memory for n objects of type T.
+		/// @throws vuh::NoSuitableMemoryFound, vk::OutOfDeviceMemoryError if allocation fails
+		auto allocate(std::size_t n)-> T* {
+			if(n == 0){
+				return nullptr;
+			}
+			return static_cast<T*>(_device->pinnedHeap().allocate(*_device, n*sizeof(T)));
+		}
+
+		/// Return memory previously allocated with allocate().
+		auto deallocate(T* p, std::size_t) noexcept-> void {
+			_device->pinnedHeap().deallocate(*_device, p);
+		}
+
+		/// @return device the memory is allocated on
+		auto device() const-> vuh::Device& { return *_device; }
+
+		/// Allocators are equal if they take memory from the same device.
+		template<class U>
+		friend auto operator== (const pinned_allocator& a1, const pinned_allocator<U>& a2)-> bool {
+			return &a1.device() == &a2.device();
+		}
+		template<class U>
+		friend auto operator!= (const pinned_allocator& a1, const pinned_allocator<U>& a2)-> bool {
+			return !(a1 == a2);
+		}
+	private: // data
+		vuh::Device* _device; ///< device to allocate memory on
+	}; // class pinned_allocator
+
+	/// View into the memory allocated with pinned_allocator.
+	/// Can be passed as a transfer source/destination to copy_async(), or bound to a kernel
+	/// in place of an array. Memory is host-coherent so no flushes are ever needed.
+	/// Does not own the data, and is only valid while the container it was taken from is alive
+	/// and not reallocated.
+	template<class T>
+	class PinnedSpan {
+	public:
+		using value_type = T;
+		static constexpr auto descriptor_class = vk::DescriptorType::eStorageBuffer;
+
+		/// Constructor.
+		/// @throws std::invalid_argument if data is not allocated with pinned_allocator
+		/// or the range exceeds the allocation.
+		PinnedSpan(vuh::Device& device, T* data, std::size_t size)
+		   : _device(&device), _data(data), _size(size)
+		{
+			const auto range = device.pinnedHeap().find(data);
+			if(!range.buffer || range.size < size*sizeof(T)){
+				throw std::invalid_argument("range is not allocated with vuh::pinned_allocator");
+			}
+			_buffer = range.buffer;
+			_offset = range.offset;
+		}
+
+		/// @return buffer the span belongs to
+		auto buffer() const-> vk::Buffer { return _buffer; }
+		/// @return offset (bytes) of the span wrt the beginning of the buffer
+		auto offset_bytes() const-> std::size_t { return _offset; }
+		/// @return device the span memory is allocated on
+		auto device() const-> vuh::Device& { return *_device; }
+		/// @return pointer to the beginning of the span data
+		auto data() const-> T* { return _data; }
+		/// @return number of elements in the span
+		auto size() const-> std::size_t { return _size; }
+		/// @return number of bytes in the span
+		auto size_bytes() const-> std::size_t { return _size*sizeof(T); }
+	private: // data
+		vuh::Device* _device;    ///< device the memory is allocated on
+		T* _data;                ///< host pointer to the beginning of the span
+		std::size_t _size;       ///< number of elements in the span
+		vk::Buffer _buffer;      ///< buffer the span belongs to
+		std::size_t _offset = 0; ///< offset (bytes) of the span wrt the beginning of the buffer
+	}; // class PinnedSpan
+
+	/// @return span over the whole data of the container using pinned_allocator.
+	template<class Container>
+	auto pinned_span(Container& c)-> PinnedSpan<typename Container::value_type> {
+		using T = typename Container::value_type;
+		return PinnedSpan<T>(c.get_allocator().device(), c.data(), c.size());
+	}
+
+	/// @return span over the range of elements of the container using pinned_allocator.
+	template<class Container>
+	auto pinned_span(Container& c, std::size_t offset_begin, std::size_t offset_end
+	                 )-> PinnedSpan<typename Container::value_type>
+	{
+		using T = typename Container::value_type;
+		return PinnedSpan<T>(c.get_allocator().device(), c.data() + offset_begin
+		                     , offset_end - offset_begin);
+	}
+} // namespace vuh
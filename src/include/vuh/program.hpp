@@ -7,7 +7,12 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <exception>
+#include <functional>
+#include <stdexcept>
 #include <stdint.h>
 #include <tuple>
 #include <utility>
@@ -20,6 +25,139 @@ namespace vuh {
 			static constexpr auto value = T::descriptor_class;
 		};
 
+		/// @return offset (bytes) of the data bound to kernel wrt the beginning of the array view buffer
+		template<class Array>
+		auto buffer_offset(const ArrayView<Array>& view)-> std::size_t {
+			return view.offset()*sizeof(typename Array::value_type);
+		}
+
+		/// @return offset (bytes) of the data bound to kernel wrt the beginning of the array buffer.
+		/// Arrays are always bound as a whole.
+		template<class Array>
+		auto buffer_offset(const Array&)-> std::size_t { return 0; }
+
+		/// @return offset (bytes) of the pinned memory bound to kernel wrt the beginning of its buffer
+		template<class T>
+		auto buffer_offset(const PinnedSpan<T>& span)-> std::size_t { return span.offset_bytes(); }
+
+		/// Noop. Pinned memory is host-coherent.
+		template<class T>
+		auto sync_bound(PinnedSpan<T>&)-> void {}
+
+		/// Noop. Pinned memory is never evicted.
+		template<class T>
+		auto touch_bound(PinnedSpan<T>&)-> void {}
+
+		/// Mark the packed array holding the sub-array as used (see BasicArray::touch()).
+		template<class T, class Alloc>
+		auto touch_bound(arr::PackedView<T, Alloc>& view)-> void { view.array().touch(); }
+
+		/// Mark the array underlying the view as used (see BasicArray::touch()).
+		template<class Array>
+		auto touch_bound(ArrayView<Array>& view)-> void { view.array().touch(); }
+
+		/// Mark the array as used (see BasicArray::touch()).
+		template<class Array>
+		auto touch_bound(Array& array)-> void { array.touch(); }
+
+		/// @return the array view argument as kept by the program between the runs (by value).
+		template<class Array>
+		auto keep_bound(ArrayView<Array>& view)-> ArrayView<Array> { return view; }
+
+		/// @return the packed sub-array argument as kept by the program between the runs (by value).
+		template<class T, class Alloc>
+		auto keep_bound(arr::PackedView<T, Alloc>& view)-> arr::PackedView<T, Alloc> { return view; }
+
+		/// @return the pinned memory argument as kept by the program between the runs (by value).
+		template<class T>
+		auto keep_bound(PinnedSpan<T>& span)-> PinnedSpan<T> { return span; }
+
+		/// @return the array argument as kept by the program between the runs (by reference).
+		template<class Array>
+		auto keep_bound(Array& array)-> std::reference_wrapper<Array> { return array; }
+
+		/// @return array referred by the kept argument
+		template<class Array>
+		auto unwrap_bound(std::reference_wrapper<Array>& ref)-> Array& { return ref.get(); }
+
+		/// @return kept view argument
+		template<class View>
+		auto unwrap_bound(View& view)-> View& { return view; }
+
+		/// @return offset (bytes) of the packed sub-array bound to kernel wrt the beginning of its buffer
+		template<class T, class Alloc>
+		auto buffer_offset(const arr::PackedView<T, Alloc>& view)-> std::size_t {
+			return view.offset_bytes();
+		}
+
+		/// Sync the host-side state of the packed sub-array before it is bound to a kernel.
+		/// Pending host writes are flushed, and the sub-array is considered written by device.
+		template<class T, class Alloc>
+		auto sync_bound(arr::PackedView<T, Alloc>& view)-> void {
+			view.array().flushHostWrites();
+			view.array().markDeviceWrite(view.offset_bytes(), view.size_bytes());
+		}
+
+		/// Sync the host-side state of the array view memory before it is bound to a kernel.
+		/// Pending host writes are flushed, and the view range is considered written by device.
+		template<class Array>
+		auto sync_bound(ArrayView<Array>& view)-> void {
+			view.array().flushHostWrites();
+			view.array().markDeviceWrite(buffer_offset(view), view.size_bytes());
+		}
+
+		/// Sync the host-side state of the array memory before it is bound to a kernel.
+		/// Pending host writes are flushed, and the whole array is considered written by device.
+		template<class Array>
+		auto sync_bound(Array& array)-> void {
+			array.flushHostWrites();
+			array.markDeviceWrite(0, array.size_bytes());
+		}
+
+		/// @return view into the range of elements of the array
+		template<class Array>
+		auto chunk_view(Array& array, std::size_t offset_begin, std::size_t offset_end)-> ArrayView<Array> {
+			return array_view(array, offset_begin, offset_end);
+		}
+
+		/// @return view into the range of elements (wrt the beginning of the view) of the array view
+		template<class Array>
+		auto chunk_view(ArrayView<Array>& view, std::size_t offset_begin, std::size_t offset_end
+		                )-> ArrayView<Array>
+		{
+			return array_view(view.array(), view.offset() + offset_begin, view.offset() + offset_end);
+		}
+
+		/// @return max number of elements in the chunk of arrays of given types that can be bound
+		/// to a kernel. Views of all arrays to the chunk fit maxStorageBufferRange of the device
+		/// (and have at most max_elements elements), and chunk boundaries satisfy its
+		/// minStorageBufferOffsetAlignment.
+		template<class... Arrs>
+		auto chunk_size(const vuh::Device& device, std::size_t max_elements=std::size_t(-1)
+		                )-> std::size_t
+		{
+			const auto& limits = device.properties().limits;
+			const auto range = std::min({max_elements, std::size_t(limits.maxStorageBufferRange)
+			                                           /sizeof(typename Arrs::value_type)...});
+			const auto alignment = std::max(std::size_t(limits.minStorageBufferOffsetAlignment)
+			                                , std::size_t(1));
+			return std::max(range/alignment*alignment, alignment);
+		}
+
+		/// True if the first type of the pack is integral.
+		/// Tells the max chunk size from the arrays in Program::run_chunked() arguments.
+		template<class... Ts> struct is_first_integral: std::false_type {};
+		template<class T, class... Ts>
+		struct is_first_integral<T, Ts...>: std::is_integral<std::decay_t<T>> {};
+
+		/// @return number of elements in the arrays. All arrays are expected to be of the same size.
+		template<class Arr, class... Arrs>
+		auto common_size(const Arr& array, const Arrs&... arrays)-> std::size_t {
+			using expand = int[];
+			(void)expand{0, ((void)assert(arrays.size() == array.size()), 0)...};
+			return array.size();
+		}
+
 		/// @return tuple element offset
 		template<size_t Idx, class T>
 		constexpr auto tuple_element_offset(const T& tup)-> std::size_t {
@@ -102,6 +240,9 @@ namespace vuh {
 
 			/// Noop. Action to be triggered when the fence is signaled.
 			constexpr auto operator()() noexcept-> void {}
+
+			/// Command buffer is only to be released, so the computation need not be waited for.
+			constexpr auto releasesOnly() const noexcept-> bool { return true; }
 		}; // struct Compute
 
 		/// Program base functionality.
@@ -109,9 +250,12 @@ namespace vuh {
 		class ProgramBase {
 		public:
 			/// Run the Program object on previously bound parameters, wait for completion.
+			/// Bound arrays are touched, and the commands are recorded anew if those were moved
+			/// since binding (see refresh()).
 			/// @pre bacth sizes should be specified before calling this.
 			/// @pre all paramerters should be specialized, pushed and bound before calling this.
 			auto run()-> void {
+				refresh();
 				auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 1, &_device.computeCmdBuffer()); // submit a single command buffer
 
 				// submit the command buffer to the queue and set up a fence.
@@ -121,8 +265,10 @@ namespace vuh {
 			}
 
 			/// Run the Program object on previously bound parameters.
+			/// Bound arrays are refreshed same as with run().
 			/// @return Delayed<Compute> object used for synchronization with host
 			auto run_async()-> vuh::Delayed<Compute> {
+				refresh();
 				auto buffer = _device.releaseComputeCmdBuffer();
 				auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 1, &buffer); // submit a single command buffer
 
@@ -131,7 +277,9 @@ namespace vuh {
 				auto fence = _device.createFence(vk::FenceCreateInfo()); // fence makes sure the control is not returned to CPU till command buffer is depleted
 				queue.submit({submitInfo}, fence);
 
-				return Delayed<Compute>{fence, _device, Compute(_device, buffer)};
+				auto r = Delayed<Compute>{fence, _device, Compute(_device, buffer)};
+				_last_use = r.serial();
+				return r;
 			}
 		protected:
 			/// Construct object using given a vuh::Device and path to SPIR-V shader code.
@@ -180,6 +328,9 @@ namespace vuh {
 			   , _pipeline(o._pipeline)
 			   , _device(o._device)
 			   , _batch(o._batch)
+			   , _last_use(o._last_use)
+			   , _bound(std::move(o._bound))
+			   , _relocations(o._relocations)
 			{
 				o._shader = nullptr; //
 			}
@@ -198,23 +349,53 @@ namespace vuh {
 				_pipeline   = o._pipeline;
 				_device     = o._device;
 				_batch      = o._batch;	
+				_last_use   = o._last_use;
+				_bound      = std::move(o._bound);
+				_relocations = o._relocations;
 			
 				o._shader = nullptr;
 				return *this;
 			}
 
 			/// Release resources associated with current object.
+			/// If the last async run is not complete yet the release is postponed till it is
+			/// (see ReleaseQueue).
 			auto release() noexcept-> void {
 				if(_shader){
-					_device.destroyShaderModule(_shader);
-					_device.destroyDescriptorPool(_dscpool);
-					_device.destroyDescriptorSetLayout(_dsclayout);
-					_device.destroyPipelineCache(_pipecache);
-					_device.destroyPipeline(_pipeline);
-					_device.destroyPipelineLayout(_pipelayout);
+					auto handles = Handles{_shader, _dscpool, _dsclayout, _pipecache, _pipeline, _pipelayout};
+					auto& releases = _device.releaseQueue();
+					if(!releases.isComplete(_last_use)){
+						try {
+							releases.defer(_last_use, handles);
+							return;
+						} catch(std::exception&) { // could not postpone, wait for the device instead
+							releases.wait(_device, _last_use);
+						}
+					}
+					handles(_device);
 				}
 			}
 
+			/// Vulkan objects owned by the program.
+			struct Handles {
+				vk::ShaderModule shader;
+				vk::DescriptorPool dscpool;
+				vk::DescriptorSetLayout dsclayout;
+				vk::PipelineCache pipecache;
+				vk::Pipeline pipeline;
+				vk::PipelineLayout pipelayout;
+
+				/// Destroy the objects.
+				auto operator()(vuh::Device& device) noexcept-> void {
+					device.destroyShaderModule(shader);
+					device.destroyDescriptorPool(dscpool);
+					device.destroyDescriptorSetLayout(dsclayout);
+					device.destroyPipelineCache(pipecache);
+					device.destroyPipeline(pipeline);
+					device.destroyPipelineLayout(pipelayout);
+				}
+			}; // struct Handles
+
 			/// Initialize the pipeline.
 			/// Creates descriptor set layout, pipeline cache and the pipeline layout.
 			template<size_t N, class... Arrs>
@@ -244,21 +425,66 @@ namespace vuh {
 				_dscset = _device.allocateDescriptorSets({_dscpool, 1, &_dsclayout})[0];
 			}
 
+			/// Keep the arguments of bind() to refresh those before every run (see refresh()).
+			/// record(program, args...) records the commands of the program over the kept arguments.
+			template<class F, class... Arrs>
+			auto keep_bound(F record, Arrs&... arrs)-> void {
+				auto bound = std::make_tuple(detail::keep_bound(arrs)...);
+				_bound = [record, bound](ProgramBase& program) mutable {
+					refresh_bound(program, record, bound, std::index_sequence_for<Arrs...>{});
+				};
+			}
+
+			/// Prepare the arguments of the last bind() for the next run.
+			/// Arrays are touched, so that evicted ones are restored and all are tagged with
+			/// the upcoming submission. If any array was moved since the commands were recorded
+			/// (see Device::numRelocations()) those are recorded anew, so that the kernel never
+			/// refers the released buffers.
+			auto refresh()-> void {
+				if(_bound){
+					_bound(*this);
+				}
+			}
+
+			// helper
+			template<class F, class Bound, size_t... I>
+			static auto refresh_bound(ProgramBase& program, F& record, Bound& bound
+			                          , std::index_sequence<I...>)-> void
+			{
+				using expand = int[];
+				(void)expand{0, (touch_bound(unwrap_bound(std::get<I>(bound))), 0)...};
+				if(program._device.numRelocations() != program._relocations){
+					record(program, unwrap_bound(std::get<I>(bound))...);
+				} else {
+					(void)expand{0, (sync_bound(unwrap_bound(std::get<I>(bound))), 0)...};
+				}
+			}
+
 			/// Starts writing to the device's compute command buffer.
 			/// Binds a pipeline and a descriptor set.
 			template<class... Arrs>
 			auto command_buffer_begin(Arrs&... arrs)-> void {
 				assert(_pipeline); /// pipeline supposed to be initialized before this
+				using expand = int[];
+				(void)expand{0, (touch_bound(arrs), 0)...}; // restoring evicted arrays changes their buffers
+				_relocations = _device.numRelocations();
 
 				constexpr auto N = sizeof...(arrs);
 				auto dscinfos = std::array<vk::DescriptorBufferInfo, N>{
 					                           {{arrs.buffer()
-				                               , arrs.offset()*sizeof(typename Arrs::value_type)
+				                               , buffer_offset(arrs)
 				                               , arrs.size_bytes()}... }
 				                };
+				for(const auto& info: dscinfos){
+					if(info.range > _device.properties().limits.maxStorageBufferRange){
+						throw std::length_error("array is too big to be bound to a kernel,"
+						                        " see Program::run_chunked()");
+					}
+				}
 				auto write_dscsets = dscinfos2writesets(_dscset, dscinfos
 				                                       , std::make_index_sequence<N>{});
 				_device.updateDescriptorSets(write_dscsets, {}); // associate buffers to binding points in bindLayout
+				(void)expand{0, (sync_bound(arrs), 0)...};
 
 				// Start recording commands into the newly allocated command buffer.
 				//	auto beginInfo = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit); // buffer is only submitted and used once
@@ -289,6 +515,9 @@ namespace vuh {
 
 			vuh::Device& _device;                ///< refer to device to run shader on
 			std::array<uint32_t, 3> _batch={0, 0, 0}; ///< 3D evaluation grid dimensions (number of workgroups to run)
+			uint64_t _last_use = 0;              ///< release queue number of the last async run, 0 if none
+			std::function<void(ProgramBase&)> _bound; ///< refreshes the arguments of the last bind() before the run
+			uint64_t _relocations = 0;           ///< Device::numRelocations() as of the last commands recording
 		}; // class ProgramBase
 
 		/// Part of Program handling specialization constants.
@@ -425,6 +654,9 @@ namespace vuh {
 				Base::init_pipeline();
 			}
 			create_command_buffer(p, args...);
+			Base::keep_bound([p](detail::ProgramBase& program, auto&... arrs){
+				static_cast<Program&>(program).create_command_buffer(p, arrs...);
+			}, args...);
 			return *this;
 		}
 
@@ -452,6 +684,35 @@ namespace vuh {
 			bind(params, args...);
 			return Base::run_async();
 		}
+
+		/// Run program over the arrays too big to be bound to a kernel as a whole
+		/// (bigger than maxStorageBufferRange of the device).
+		/// Arrays (all of the same size) are split to consecutive views of at most as many elements
+		/// as fit the single descriptor, and the program is run over each chunk in turn
+		/// with push constants made by chunk_params(offset, size) from the offset (elements)
+		/// of the chunk wrt the beginning of arrays and its size (elements).
+		/// Grid should cover the full chunk, the last chunk may be shorter.
+		/// Blocks till all chunks are processed.
+		/// @pre grid dimensions should be specified before calling this.
+		template<class F, class... Arrs
+		         , class=std::enable_if_t<!detail::is_first_integral<Arrs...>::value>>
+		auto run_chunked(F&& chunk_params, Arrs&&... args)-> void {
+			run_chunked(std::forward<F>(chunk_params), std::size_t(-1), std::forward<Arrs>(args)...);
+		}
+
+		/// Run program over the arrays split to chunks of at most max_chunk elements
+		/// (and fitting the descriptor range), otherwise same as run_chunked() above.
+		/// Chunk size is rounded down to the multiple of minStorageBufferOffsetAlignment of the device,
+		/// but not below it.
+		template<class F, class... Arrs>
+		auto run_chunked(F&& chunk_params, std::size_t max_chunk, Arrs&&... args)-> void {
+			const auto size = detail::common_size(args...);
+			const auto chunk = detail::chunk_size<std::decay_t<Arrs>...>(Base::_device, max_chunk);
+			for(auto offset = std::size_t(0); offset < size; offset += chunk){
+				const auto end = std::min(size, offset + chunk);
+				run(chunk_params(offset, end - offset), detail::chunk_view(args, offset, end)...);
+			}
+		}
 	private: // helpers
 		/// Set up the state of the kernel that depends on number and types of bound array parameters.
 		/// Initizalizes the pipeline layout, declares the push constants interface.
@@ -527,6 +788,10 @@ namespace vuh {
 			}
 			Base::command_buffer_begin(args...);
 			Base::command_buffer_end();
+			Base::keep_bound([](detail::ProgramBase& program, auto&... arrs){
+				static_cast<Program&>(program).command_buffer_begin(arrs...);
+				static_cast<Program&>(program).command_buffer_end();
+			}, args...);
 			return *this;
 		}
 
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace vuh {
+	class Device;
+
+	/// Queue of resources whose release is postponed till the device is done using them.
+	/// Async submissions (see Delayed) are numbered in the order they are made, and their fences
+	/// are owned by the queue. Resources last used by some submission (arrays, programs,
+	/// command buffers) are tagged with its number when destroyed, and actually released only
+	/// after all submissions up to the tagged one have completed.
+	/// Queue is drained opportunistically (without blocking) on every new submission and on every
+	/// completed wait, and completely when the owning device is released.
+	/// Queue does not keep a reference to the device, the device is passed to every call instead,
+	/// so that the queue remains valid when owning vuh::Device is moved.
+	/// Not thread-safe, same as the vuh::Device it belongs to.
+	class ReleaseQueue {
+	public:
+		/// Type-erased release action.
+		struct Item {
+			virtual ~Item() = default;
+			virtual auto operator()(vuh::Device& device) noexcept-> void = 0;
+		}; // struct Item
+
+		ReleaseQueue() = default;
+
+		ReleaseQueue(const ReleaseQueue&) = delete;
+		auto operator= (const ReleaseQueue&)-> ReleaseQueue& = delete;
+
+		auto track(vuh::Device& device, vk::Fence fence)-> uint64_t;
+		auto detach(vuh::Device& device, uint64_t serial) noexcept-> void;
+
+		/// Postpone the action till the submission with a given number (and all preceding ones)
+		/// completes. Action is called as f(vuh::Device&) or f(), and should not throw.
+		/// The action is left intact if the call throws.
+		template<class F>
+		auto defer(uint64_t serial, F&& f)-> void {
+			_deferred.reserve(_deferred.size() + 1);
+			auto item = std::unique_ptr<Item>(new Release<std::decay_t<F>>(std::forward<F>(f)));
+			_deferred.emplace_back(serial, std::move(item));
+		}
+
+		auto collect(vuh::Device& device) noexcept-> std::size_t;
+		auto wait(vuh::Device& device, uint64_t serial) noexcept-> void;
+		auto release(vuh::Device& device) noexcept-> void;
+
+		/// @return number to be given to the next tracked submission.
+		/// Resources being recorded to the commands of upcoming submission are tagged with it.
+		auto nextSerial() const-> uint64_t { return _submitted + 1; }
+
+		/// @return true if the submission with given number and all preceding ones have completed
+		/// (as of the last collect() call). Numbers not yet given to any submission are
+		/// considered complete, as well as 0 which stands for 'never submitted'.
+		auto isComplete(uint64_t serial) const-> bool {
+			return serial <= _completed || serial > _submitted;
+		}
+
+		/// @return number of actions waiting for their submissions to complete
+		auto numPending() const-> std::size_t { return _deferred.size(); }
+	private: // helpers
+		/// Release action wrapper.
+		template<class F>
+		struct Release: Item {
+			template<class G>
+			explicit Release(G&& g): f(std::forward<G>(g)) {}
+			auto operator()(vuh::Device& device) noexcept-> void override { call(f, device, 0); }
+
+			template<class G>
+			static auto call(G& g, vuh::Device& device, int)-> decltype(g(device)) { return g(device); }
+			template<class G>
+			static auto call(G& g, vuh::Device&, long)-> decltype(g()) { return g(); }
+
+			F f;
+		}; // struct Release
+
+		/// Tracked submission.
+		struct Submission {
+			uint64_t serial;  ///< submission number
+			vk::Fence fence;  ///< fence signalled on submission completion, owned by the queue
+			bool complete;    ///< true if fence was found signalled
+			bool attached;    ///< true if fence is still referred by Delayed object
+		}; // struct Submission
+	private: // data
+		std::deque<Submission> _submissions;  ///< tracked submissions not yet retired, in submission order
+		std::vector<std::pair<uint64_t, std::unique_ptr<Item>>> _deferred; ///< postponed actions tagged with submission number
+		uint64_t _submitted = 0;              ///< number of the last tracked submission
+		uint64_t _completed = 0;              ///< all submissions up to this number are complete
+	}; // class ReleaseQueue
+} // namespace vuh
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <iterator>
 #include <type_traits>
+#include <vector>
 
 namespace vuh {
 namespace traits {
@@ -17,12 +19,52 @@ namespace traits {
 		template<class T> auto is_iterable_impl(...)-> std::false_type;
 		
 		///
-		template<class T>		
+		template<class T>
 		auto is_contiguous_iterable_impl(int)
-		   -> decltype( T::data() + T::size()
+		   -> decltype( std::declval<T&>().data() + std::declval<T&>().size()
 		               , void()
-		               , void(*T::data())
+		               , void(*std::declval<T&>().data())
 		               , std::true_type{});
+		template<class T> auto is_contiguous_iterable_impl(...)-> std::false_type;
+
+		/// Iterators of std::vector (except for the std::vector<bool>) are contiguous.
+		template<class It, class V, class=void>
+		struct is_vector_iterator_of: std::false_type {};
+
+		template<class It, class V>
+		struct is_vector_iterator_of<It, V, std::enable_if_t<std::is_object<V>::value
+		                                                     && !std::is_same<V, bool>::value>>
+		   : std::integral_constant<bool
+		                           , std::is_same<It, typename std::vector<V>::iterator>::value
+		                             || std::is_same<It, typename std::vector<V>::const_iterator>::value>
+		{};
+
+		/// Iterators of std::vector with other allocators. Those are the same as with the default
+		/// allocator in libc++ and MSVC, while libstdc++ tells them by the vector type
+		/// they are parameterized with.
+		template<class It>
+		struct is_allocator_vector_iterator: std::false_type {};
+
+		template<template<class, class> class Iter, class P, class V, class A>
+		struct is_allocator_vector_iterator<Iter<P, std::vector<V, A>>>
+		   : std::integral_constant<bool
+		                           , std::is_same<Iter<P, std::vector<V, A>>
+		                                          , typename std::vector<V, A>::iterator>::value
+		                             || std::is_same<Iter<P, std::vector<V, A>>
+		                                             , typename std::vector<V, A>::const_iterator>::value>
+		{};
+
+		/// Iterators without std::iterator_traits (like hand-made output iterators) are not.
+		template<class It, class=void>
+		struct is_vector_iterator: std::false_type {};
+
+		template<class It>
+		struct is_vector_iterator<It, std::conditional_t<true, void
+		                                                 , typename std::iterator_traits<It>::value_type>>
+		   : std::integral_constant<bool
+		                           , is_vector_iterator_of<It, typename std::iterator_traits<It>::value_type>::value
+		                             || is_allocator_vector_iterator<It>::value>
+		{};
 
 		///
 		template<class... T> auto _are_comparable_host_iterators(...)-> std::false_type;
@@ -56,6 +98,14 @@ namespace traits {
 	/// (provides data(), size() and * operator)
 	template<class T> using is_contiguous_iterable = decltype(detail::is_contiguous_iterable_impl<T>(0));
 
+	/// Check if host iterator is known to point to contiguous storage: raw pointers and
+	/// iterators of std::vector (with any allocator, f.e. vuh::pinned_allocator). Other containers
+	/// are detected with is_contiguous_iterable instead, where the container itself is available.
+	template<class It>
+	struct is_contiguous_iterator
+	   : std::integral_constant<bool, std::is_pointer<It>::value || detail::is_vector_iterator<It>::value>
+	{};
+
 	/// doc me
 	template<class T1, class T2>
 	using are_comparable_host_iterators = decltype(detail::_are_comparable_host_iterators<T1, T2>(0));
@@ -3,5 +3,7 @@
 #include "device.h"
 #include "error.h"
 #include "instance.h"
+#include "mappedFile.h"
+#include "memoryStats.h"
 #include "program.hpp"
 #include "utils.h"
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vuh {
+	/// Pool of host threads running the host-side stages of async transfers (copies between
+	/// host memory and staging buffers, see copy_async() with vuh::host_async), so that those do
+	/// not block the calling thread.
+	/// Jobs are started in the order they were submitted, which is also the order of the
+	/// corresponding device submissions, so that a job waiting for the device never holds up
+	/// the jobs the device is waiting for.
+	/// Jobs should only make host copies and the Vulkan calls not requiring external
+	/// synchronization (waiting for fences, setting events, flushing mapped memory).
+	/// Remaining jobs are completed before the pool is destroyed.
+	/// Submitting jobs is thread-safe.
+	class WorkerPool {
+	public:
+		explicit WorkerPool(std::size_t n_threads=defaultThreads());
+		~WorkerPool() noexcept;
+
+		WorkerPool(const WorkerPool&) = delete;
+		auto operator= (const WorkerPool&)-> WorkerPool& = delete;
+
+		auto submit(std::function<void()> job)-> std::future<void>;
+
+		/// @return number of worker threads
+		auto size() const-> std::size_t { return _threads.size(); }
+
+		static auto defaultThreads()-> std::size_t;
+	private: // helpers
+		auto run() noexcept-> void;
+	private: // data
+		std::vector<std::thread> _threads;              ///< worker threads
+		std::deque<std::packaged_task<void()>> _jobs;   ///< jobs not yet started, in submission order
+		std::mutex _mutex;                              ///< guards the jobs queue and the stop flag
+		std::condition_variable _cv;                    ///< signalled on new jobs and on stop
+		bool _stop = false;                             ///< true if the pool is being destroyed
+	}; // class WorkerPool
+} // namespace vuh
@@ -12,10 +12,14 @@ using std::begin; using std::end;
 namespace {
 #ifndef NDEBUG
 	static const std::array<const char*, 1> default_layers = {"VK_LAYER_LUNARG_standard_validation"};
-	static const std::array<const char*, 1> default_extensions = {VK_EXT_DEBUG_REPORT_EXTENSION_NAME};
+	static const std::array<const char*, 3> default_extensions = {VK_EXT_DEBUG_REPORT_EXTENSION_NAME
+	                                        , VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
+	                                        , VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME};
 #else
 	static const std::array<const char*, 0> default_layers = {};
-	static const std::array<const char*, 0> default_extensions = {};
+	static const std::array<const char*, 2> default_extensions = {
+	                                          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
+	                                        , VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME};
 #endif
 
 	/// @return true if value x can be extracted from an array with a given function
@@ -60,14 +64,21 @@ namespace {
 	}
 
 	/// Filter requested extensions, throw away those not present on particular instance.
-	/// Add default debug extensions to debug build.
-	auto filter_extensions(const std::vector<const char*>& extensions) {
+	/// Add default extensions (debug extensions to debug build, and the ones used to query
+	/// device properties, memory budget and external memory capabilities).
+	auto filter_extensions(const std::vector<const char*>& extensions)-> std::vector<std::string> {
 		const auto avail_extensions = vk::enumerateInstanceExtensionProperties();
 		auto r = filter_list({}, extensions, avail_extensions
 		                     , [](const auto& l){return l.extensionName;});
 		r = filter_list(std::move(r), default_extensions, avail_extensions
 		                , [](const auto& l){return l.extensionName;});
-		return r;
+		auto ret = std::vector<std::string>{};
+		for(auto e: r){
+			if(end(ret) == std::find(ALL(ret), e)){
+				ret.emplace_back(e);
+			}
+		}
+		return ret;
 	}
 
 	/// Default debug reporter used when user did not care to provide his own.
@@ -84,10 +95,14 @@ namespace {
 
 	/// Create vulkan Instance with app specific parameters.
 	auto createInstance(const std::vector<const char*> layers
-	                   , const std::vector<const char*> extensions
+	                   , const std::vector<std::string>& extension_names
 	                   , const vk::ApplicationInfo& info
 	                   )-> vk::Instance
 	{
+		auto extensions = std::vector<const char*>{};
+		for(const auto& e: extension_names){
+			extensions.push_back(e.c_str());
+		}
 		auto createInfo = vk::InstanceCreateInfo(vk::InstanceCreateFlags(), &info
 		                                         , ARR_VIEW(layers), ARR_VIEW(extensions));
 		return vk::createInstance(createInfo);
@@ -123,7 +138,8 @@ namespace vuh {
 	                   , const vk::ApplicationInfo& info
 	                   , debug_reporter_t report_callback
 	                   )
-	   : _instance(createInstance(filter_layers(layers), filter_extensions(extension), info))
+	   : _extensions(filter_extensions(extension))
+	   , _instance(createInstance(filter_layers(layers), _extensions, info))
 	   , _reporter(report_callback ? report_callback : debugReporter)
 	   , _reporter_cbk(registerReporter(_instance, _reporter))
 	{}
@@ -135,7 +151,8 @@ namespace vuh {
 
 	/// Move constructor
 	Instance::Instance(Instance&& o) noexcept
-	   : _instance(o._instance)
+	   : _extensions(std::move(o._extensions))
+	   , _instance(o._instance)
 	   , _reporter(o._reporter)
 	   , _reporter_cbk(o._reporter_cbk)
 	{
@@ -145,6 +162,7 @@ namespace vuh {
 	/// Move assignment
 	auto Instance::operator=(Instance&& o) noexcept-> Instance& {
 		using std::swap;
+		swap(_extensions, o._extensions);
 		swap(_instance, o._instance);
 		swap(_reporter, o._reporter);
 		swap(_reporter_cbk, o._reporter_cbk);
@@ -187,4 +205,15 @@ namespace vuh {
 	{
 		_reporter(flags, VkDebugReportObjectTypeEXT{}, 0, 0, 0 , prefix, message, nullptr);
 	}
+
+	/// @return true if extension with a given name is enabled on the instance
+	auto Instance::hasExtension(const char* name) const-> bool {
+		return end(_extensions) != std::find(ALL(_extensions), name);
+	}
+
+	/// @return address of the instance-level function with a given name, nullptr if not available.
+	/// Used to load extension functions.
+	auto Instance::procAddr(const char* name) const-> PFN_vkVoidFunction {
+		return _instance.getProcAddr(name);
+	}
 } // namespace vuh
@@ -0,0 +1,185 @@
+#include <vuh/arr/mappedCopy.h>
+#include <vuh/workerPool.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define VUH_STREAMING_COPY
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+namespace {
+	constexpr std::size_t cache_line = 64;                 ///< copy loops move a cache line per iteration
+	constexpr std::size_t prefetch_distance = 8*cache_line; ///< how far ahead the source is prefetched
+	constexpr unsigned max_copy_threads = 4;               ///< memory bandwidth is saturated by a few threads
+
+	/// Copy function for a piece of the mapped memory copy.
+	using copy_fn = void(*)(char* dst, const char* src, std::size_t size);
+
+	/// Plain memcpy, suitable for the host-cached memory.
+	auto plainCopy(char* dst, const char* src, std::size_t size)-> void {
+		std::memcpy(dst, src, size);
+	}
+
+	/// @return number of bytes to copy till the pointer gets aligned to the cache line,
+	/// but not more than the size of the copy.
+	auto headSize(const char* ptr, std::size_t size)-> std::size_t {
+		const auto misalign = reinterpret_cast<uintptr_t>(ptr) % cache_line;
+		return std::min(size, misalign == 0 ? std::size_t(0) : cache_line - misalign);
+	}
+
+#ifdef VUH_STREAMING_COPY
+	/// Copy to write-combined (uncached) memory with non-temporal stores of whole cache lines,
+	/// so that the write-combining buffers are flushed complete and the destination never
+	/// pollutes the cache. Source is prefetched ahead.
+	auto streamingStore(char* dst, const char* src, std::size_t size)-> void {
+		const auto head = headSize(dst, size);
+		std::memcpy(dst, src, head);
+		dst += head; src += head; size -= head;
+		for(; size >= cache_line; size -= cache_line, src += cache_line, dst += cache_line){
+			_mm_prefetch(src + prefetch_distance, _MM_HINT_NTA);
+			const auto s = reinterpret_cast<const __m128i*>(src);
+			const auto x0 = _mm_loadu_si128(s);
+			const auto x1 = _mm_loadu_si128(s + 1);
+			const auto x2 = _mm_loadu_si128(s + 2);
+			const auto x3 = _mm_loadu_si128(s + 3);
+			const auto d = reinterpret_cast<__m128i*>(dst);
+			_mm_stream_si128(d, x0);
+			_mm_stream_si128(d + 1, x1);
+			_mm_stream_si128(d + 2, x2);
+			_mm_stream_si128(d + 3, x3);
+		}
+		std::memcpy(dst, src, size);
+		_mm_sfence(); // non-temporal stores are weakly ordered
+	}
+
+	/// Copy from write-combined (uncached) memory with streaming loads (SSE4.1 movntdqa).
+	/// Those fetch a whole cache line to the streaming load buffer, while ordinary loads
+	/// from uncached memory are served one at a time, which is an order of magnitude slower.
+	#ifdef __GNUC__
+	__attribute__((target("sse4.1")))
+	#endif
+	auto streamingLoad(char* dst, const char* src, std::size_t size)-> void {
+		const auto head = headSize(src, size);
+		std::memcpy(dst, src, head);
+		dst += head; src += head; size -= head;
+		for(; size >= cache_line; size -= cache_line, src += cache_line, dst += cache_line){
+			const auto s = reinterpret_cast<__m128i*>(const_cast<char*>(src));
+			const auto x0 = _mm_stream_load_si128(s);
+			const auto x1 = _mm_stream_load_si128(s + 1);
+			const auto x2 = _mm_stream_load_si128(s + 2);
+			const auto x3 = _mm_stream_load_si128(s + 3);
+			const auto d = reinterpret_cast<__m128i*>(dst);
+			_mm_storeu_si128(d, x0);
+			_mm_storeu_si128(d + 1, x1);
+			_mm_storeu_si128(d + 2, x2);
+			_mm_storeu_si128(d + 3, x3);
+		}
+		std::memcpy(dst, src, size);
+	}
+
+	/// @return true if the CPU supports streaming loads.
+	auto hasStreamingLoad()-> bool {
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+	#else
+		return __builtin_cpu_supports("sse4.1");
+	#endif
+	}
+#endif // VUH_STREAMING_COPY
+
+	/// @return number of threads (including the calling one) the big copies are split between.
+	auto copyThreads()-> std::size_t {
+		static const auto n = std::size_t(std::max(1u, std::min(max_copy_threads
+		                                                        , std::thread::hardware_concurrency())));
+		return n;
+	}
+
+	/// @return pool of threads helping the calling thread with big copies.
+	/// Shared by all devices. The pool is never destroyed, so that no threads are joined
+	/// at static destruction (which may deadlock when the library is unloaded).
+	/// Copy jobs never wait for other jobs, so that the pool may be used from any thread,
+	/// including the workers of the device pools.
+	auto copyPool()-> vuh::WorkerPool& {
+		static auto pool = new vuh::WorkerPool(copyThreads() - 1);
+		return *pool;
+	}
+
+	/// Split the copy between the calling thread and the copy pool if it is big enough.
+	/// Pieces are multiple of the cache line size.
+	auto parallelCopy(copy_fn copy, char* dst, const char* src, std::size_t size)-> void {
+		if(size == 0){
+			return;
+		}
+		const auto n_parts = std::min(copyThreads(), size/vuh::arr::min_parallel_copy);
+		if(n_parts < 2){
+			copy(dst, src, size);
+			return;
+		}
+		const auto part = (size/n_parts + cache_line - 1)/cache_line*cache_line;
+		auto done = std::vector<std::future<void>>{};
+		done.reserve(n_parts);
+		for(auto offset = part; offset < size; offset += part){
+			const auto n = std::min(part, size - offset);
+			try {
+				done.push_back(copyPool().submit([=]{ copy(dst + offset, src + offset, n); }));
+			} catch(std::exception&) { // could not hand it over, copy right here
+				copy(dst + offset, src + offset, n);
+			}
+		}
+		copy(dst, src, part);
+		for(auto& d: done){
+			d.get();
+		}
+	}
+} // namespace
+
+namespace vuh {
+namespace arr {
+	/// Copy bytes from host to mapped device memory with given properties.
+	/// Memory that is not host-cached (normally write-combined) is written with non-temporal
+	/// stores of whole cache lines, host-cached memory with plain memcpy.
+	/// Copies of at least 2*min_parallel_copy bytes are split between several threads.
+	/// Memory is not flushed.
+	auto memcpyToMapped(void* dst, const void* src, std::size_t size_bytes
+	                    , vk::MemoryPropertyFlags dst_props)-> void
+	{
+		auto copy = copy_fn(&plainCopy);
+#ifdef VUH_STREAMING_COPY
+		if(!(dst_props & vk::MemoryPropertyFlagBits::eHostCached)){
+			copy = &streamingStore;
+		}
+#endif
+		parallelCopy(copy, static_cast<char*>(dst), static_cast<const char*>(src), size_bytes);
+	}
+
+	/// Copy bytes from mapped device memory with given properties to host.
+	/// Memory that is not host-cached (normally write-combined) is read with streaming loads
+	/// where CPU supports those, host-cached memory with plain memcpy.
+	/// Copies of at least 2*min_parallel_copy bytes are split between several threads.
+	/// Memory should be invalidated before the call if needed.
+	auto memcpyFromMapped(void* dst, const void* src, std::size_t size_bytes
+	                      , vk::MemoryPropertyFlags src_props)-> void
+	{
+		auto copy = copy_fn(&plainCopy);
+#ifdef VUH_STREAMING_COPY
+		static const auto streaming_load = hasStreamingLoad();
+		if(streaming_load && !(src_props & vk::MemoryPropertyFlagBits::eHostCached)){
+			copy = &streamingLoad;
+		}
+#endif
+		parallelCopy(copy, static_cast<char*>(dst), static_cast<const char*>(src), size_bytes);
+	}
+} // namespace arr
+} // namespace vuh
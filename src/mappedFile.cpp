@@ -0,0 +1,268 @@
+#include <vuh/mappedFile.h>
+#include <vuh/error.h>
+
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	using Mode = vuh::MappedFile::Mode;
+
+	/// Throw the exception matching the access mode.
+	[[noreturn]] auto fail(Mode mode, const std::string& message)-> void {
+		if(mode == Mode::Read){
+			throw vuh::FileReadFailure(message);
+		}
+		throw vuh::FileWriteFailure(message);
+	}
+
+	/// @return granularity of the mapping offsets
+	auto mapGranularity()-> std::size_t {
+#ifdef _WIN32
+		auto info = SYSTEM_INFO{};
+		GetSystemInfo(&info);
+		return std::size_t(info.dwAllocationGranularity);
+#else
+		return std::size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	/// Resolve the size of the range to map given the current size of the file.
+	auto rangeSize(Mode mode, const std::string& path, std::size_t file_size
+	               , std::size_t offset, std::size_t size)-> std::size_t
+	{
+		if(size == vuh::MappedFile::whole_file){
+			if(offset > file_size){
+				fail(mode, "offset is past the end of file " + path);
+			}
+			return file_size - offset;
+		}
+		if(mode == Mode::Read && offset + size > file_size){
+			fail(mode, "range is past the end of file " + path);
+		}
+		return size;
+	}
+
+#ifdef _WIN32
+	/// Closes the handle on destruction.
+	struct Handle {
+		HANDLE h;
+		~Handle() noexcept {
+			if(h != nullptr && h != INVALID_HANDLE_VALUE){
+				CloseHandle(h);
+			}
+		}
+	};
+#else
+	/// Closes the file descriptor on destruction.
+	struct FileDescriptor {
+		int fd;
+		~FileDescriptor() noexcept {
+			if(fd >= 0){
+				::close(fd);
+			}
+		}
+	};
+#endif
+} // namespace
+
+namespace vuh {
+	/// Map the byte range of a file.
+	/// In Read mode the range should lie within the file. In Write mode the file is created
+	/// if it does not exist and extended if it is shorter than the end of the range.
+	/// Zero-sized ranges are valid and map nothing.
+	/// @throws vuh::FileReadFailure (Read mode) or vuh::FileWriteFailure (Write mode)
+	MappedFile::MappedFile(const std::string& path ///< file path
+	                       , std::size_t offset    ///< offset (bytes) of the range wrt the beginning of file
+	                       , std::size_t size      ///< size (bytes) of the range, whole_file to map till the end of file
+	                       , Mode mode             ///< access mode
+	                       )
+	   : _mode(mode)
+	{
+		const auto granularity = mapGranularity();
+#ifdef _WIN32
+		const auto read = mode == Mode::Read;
+		const auto file = Handle{CreateFileA(path.c_str()
+		                                     , read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE
+		                                     , FILE_SHARE_READ, nullptr
+		                                     , read ? OPEN_EXISTING : OPEN_ALWAYS
+		                                     , read ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL
+		                                     , nullptr)};
+		if(file.h == INVALID_HANDLE_VALUE){
+			fail(mode, "failed opening file " + path);
+		}
+		auto file_size = LARGE_INTEGER{};
+		if(!GetFileSizeEx(file.h, &file_size)){
+			fail(mode, "failed reading size of file " + path);
+		}
+		size = rangeSize(mode, path, std::size_t(file_size.QuadPart), offset, size);
+		if(size == 0){
+			return;
+		}
+		const auto end = uint64_t(offset + size); // mapping extends the file in write mode
+		const auto mapping = Handle{CreateFileMappingA(file.h, nullptr
+		                                               , read ? PAGE_READONLY : PAGE_READWRITE
+		                                               , DWORD(end >> 32), DWORD(end & 0xffffffffu)
+		                                               , nullptr)};
+		if(mapping.h == nullptr){
+			fail(mode, "failed mapping file " + path);
+		}
+		const auto map_offset = uint64_t(offset/granularity*granularity);
+		_map_size = size + std::size_t(offset - map_offset);
+		_map = MapViewOfFile(mapping.h, read ? FILE_MAP_READ : FILE_MAP_WRITE
+		                     , DWORD(map_offset >> 32), DWORD(map_offset & 0xffffffffu), _map_size);
+		if(_map == nullptr){
+			fail(mode, "failed mapping file " + path);
+		}
+#else
+		const auto file = FileDescriptor{::open(path.c_str()
+		                                        , mode == Mode::Read ? O_RDONLY : O_RDWR | O_CREAT
+		                                        , 0644)};
+		if(file.fd < 0){
+			fail(mode, "failed opening file " + path);
+		}
+		struct stat st;
+		if(::fstat(file.fd, &st) != 0){
+			fail(mode, "failed reading size of file " + path);
+		}
+		size = rangeSize(mode, path, std::size_t(st.st_size), offset, size);
+		if(size == 0){
+			return;
+		}
+		if(mode == Mode::Write && offset + size > std::size_t(st.st_size)
+		   && ::ftruncate(file.fd, off_t(offset + size)) != 0)
+		{
+			fail(mode, "failed extending file " + path);
+		}
+		const auto map_offset = offset/granularity*granularity;
+		_map_size = size + (offset - map_offset);
+		auto map = ::mmap(nullptr, _map_size
+		                  , mode == Mode::Read ? PROT_READ : PROT_READ | PROT_WRITE
+		                  , MAP_SHARED, file.fd, off_t(map_offset));
+		if(map == MAP_FAILED){
+			fail(mode, "failed mapping file " + path);
+		}
+		_map = map;
+		if(mode == Mode::Read){
+			::madvise(_map, _map_size, MADV_SEQUENTIAL);
+		}
+#endif
+		_data = static_cast<char*>(_map) + (offset - std::size_t(map_offset));
+		_size = size;
+	}
+
+	/// Unmap the file. Pending writes are left to the OS to write back.
+	MappedFile::~MappedFile() noexcept {
+		release();
+	}
+
+	/// Move constructor.
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+	   : _map(other._map), _map_size(other._map_size), _data(other._data), _size(other._size)
+	   , _mode(other._mode)
+	{
+		other._map = nullptr;
+		other._data = nullptr;
+		other._map_size = other._size = 0;
+	}
+
+	/// Move assignment. Current mapping is released.
+	auto MappedFile::operator= (MappedFile&& other) noexcept-> MappedFile& {
+		using std::swap;
+		swap(_map, other._map);
+		swap(_map_size, other._map_size);
+		swap(_data, other._data);
+		swap(_size, other._size);
+		swap(_mode, other._mode);
+		other.release();
+		return *this;
+	}
+
+	/// Hint the OS that the given byte range (wrt the beginning of the mapped range) is going
+	/// to be accessed soon, so that it starts reading it in the background (read-ahead).
+	/// Parts of the range past the end of mapping are ignored.
+	auto MappedFile::prefetch(std::size_t offset, std::size_t size) const noexcept-> void {
+#ifndef _WIN32
+		const auto p = pages(offset, size);
+		if(p.second != 0){
+			::madvise(p.first, p.second, MADV_WILLNEED);
+		}
+#else
+		(void)offset; (void)size;
+#endif
+	}
+
+	/// Hint the OS that the given byte range (wrt the beginning of the mapped range) of the
+	/// read-only mapping is not going to be accessed any more, so that its pages can be dropped
+	/// without waiting for the memory pressure. Noop for writable mappings.
+	auto MappedFile::discard(std::size_t offset, std::size_t size) const noexcept-> void {
+#ifndef _WIN32
+		if(_mode != Mode::Read){
+			return;
+		}
+		const auto p = pages(offset, size);
+		if(p.second != 0){
+			::madvise(p.first, p.second, MADV_DONTNEED);
+		}
+#else
+		(void)offset; (void)size;
+#endif
+	}
+
+	/// Write the modified pages of the mapping back to the file. Blocks till done.
+	/// @throws vuh::FileWriteFailure
+	auto MappedFile::sync() const-> void {
+		if(_map == nullptr || _mode != Mode::Write){
+			return;
+		}
+#ifdef _WIN32
+		if(!FlushViewOfFile(_map, _map_size)){
+			throw FileWriteFailure("failed writing back mapped file");
+		}
+#else
+		if(::msync(_map, _map_size, MS_SYNC) != 0){
+			throw FileWriteFailure("failed writing back mapped file");
+		}
+#endif
+	}
+
+	/// Unmap the file.
+	auto MappedFile::release() noexcept-> void {
+		if(_map != nullptr){
+#ifdef _WIN32
+			UnmapViewOfFile(_map);
+#else
+			::munmap(_map, _map_size);
+#endif
+		}
+		_map = nullptr;
+		_data = nullptr;
+		_map_size = _size = 0;
+	}
+
+	/// @return whole pages of the mapping covering the given byte range (wrt the beginning of
+	/// the mapped range) clipped to the mapping bounds: pointer to the first page and size (bytes).
+	auto MappedFile::pages(std::size_t offset, std::size_t size
+	                       ) const noexcept-> std::pair<char*, std::size_t>
+	{
+		if(_map == nullptr || offset >= _size){
+			return {nullptr, 0};
+		}
+		static const auto page = mapGranularity();
+		const auto begin = std::size_t(_data - static_cast<char*>(_map)) + offset;
+		const auto end = std::min(begin + std::min(size, _size - offset), _map_size);
+		const auto page_begin = begin/page*page;
+		return {static_cast<char*>(_map) + page_begin, end - page_begin};
+	}
+} // namespace vuh
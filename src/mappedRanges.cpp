@@ -0,0 +1,65 @@
+#include <vuh/arr/mappedRanges.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace vuh {
+namespace arr {
+	/// Constructor.
+	MappedRanges::MappedRanges(std::size_t atom)
+	   : _atom(atom)
+	{
+		assert(atom > 0);
+	}
+
+	/// Add the range of given size starting at given offset (bytes).
+	/// Range is extended to the atom boundaries and merged with the overlapping and adjacent ones.
+	/// Adding ranges in order of increasing offsets (or repeatedly the same range) is O(1).
+	auto MappedRanges::add(std::size_t offset, std::size_t size)-> void {
+		if(size == 0){
+			return;
+		}
+		auto begin = offset/_atom*_atom;
+		auto end = (offset + size + _atom - 1)/_atom*_atom;
+		if(_ranges.empty() || begin > _ranges.back().second){
+			_ranges.emplace_back(begin, end);
+			return;
+		}
+		if(begin >= _ranges.back().first){ // overlaps or touches the last range
+			_ranges.back().second = std::max(_ranges.back().second, end);
+			return;
+		}
+		// first range which is not entirely to the left of the new one
+		auto first = std::lower_bound(_ranges.begin(), _ranges.end(), begin
+		                              , [](const std::pair<std::size_t, std::size_t>& r, std::size_t b){
+		                                   return r.second < b;
+		                              });
+		// first range entirely to the right of the new one
+		auto last = std::upper_bound(first, _ranges.end(), end
+		                             , [](std::size_t e, const std::pair<std::size_t, std::size_t>& r){
+		                                  return e < r.first;
+		                             });
+		if(first == last){
+			_ranges.emplace(first, begin, end);
+			return;
+		}
+		first->first = std::min(first->first, begin);
+		first->second = std::max((last - 1)->second, end);
+		_ranges.erase(first + 1, last);
+	}
+
+	/// @return ranges in the form suitable for vkFlushMappedMemoryRanges and
+	/// vkInvalidateMappedMemoryRanges calls.
+	auto MappedRanges::ranges(vk::DeviceMemory memory ///< memory chunk belongs to
+	                          , std::size_t base_offset ///< offset of the chunk in memory
+	                          ) const-> std::vector<vk::MappedMemoryRange>
+	{
+		auto r = std::vector<vk::MappedMemoryRange>{};
+		r.reserve(_ranges.size());
+		for(const auto& range: _ranges){
+			r.emplace_back(memory, base_offset + range.first, range.second - range.first);
+		}
+		return r;
+	}
+} // namespace arr
+} // namespace vuh
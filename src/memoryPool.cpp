@@ -0,0 +1,474 @@
+#include <vuh/arr/memoryPool.h>
+#include <vuh/device.h>
+#include <vuh/releaseQueue.h>
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+namespace {
+	/// @return value rounded up to the nearest multiple of alignment
+	auto align_up(std::size_t value, std::size_t alignment)-> std::size_t {
+		return alignment > 1 ? (value + alignment - 1)/alignment*alignment : value;
+	}
+} // namespace
+
+namespace vuh {
+namespace arr {
+	/// Big chunk of device memory together with the free-list of its unused space.
+	struct MemoryPool::Block {
+		/// Chunk in use.
+		struct Live {
+			std::size_t size;                  ///< chunk size (bytes)
+			Owner owner;                       ///< handles to update on relocation, empty if not tracked
+			std::size_t size_bytes = 0;        ///< size of the buffer bound to the chunk
+			vk::BufferUsageFlags usage;        ///< usage flags of the buffer bound to the chunk
+		};
+
+		vk::DeviceMemory memory;                          ///< memory handle
+		std::size_t size;                                 ///< size of the block (bytes)
+		uint32_t memid;                                   ///< memory type id
+		std::size_t used = 0;                             ///< number of bytes in use (incl. alignment padding)
+		void* mapped = nullptr;                           ///< host pointer to the beginning of the block if mapped
+		bool dedicated = false;                           ///< true if block is a dedicated allocation for a single buffer
+		std::map<std::size_t, std::size_t> free_offsets;  ///< free chunks: offset -> size
+		std::multimap<std::size_t, std::size_t> free_sizes; ///< free chunks: size -> offset
+		std::map<std::size_t, Live> live;                 ///< chunks in use: offset -> chunk
+
+		/// Add chunk to free lists.
+		auto insert(std::size_t offset, std::size_t size)-> void {
+			free_offsets.emplace(offset, size);
+			free_sizes.emplace(size, offset);
+		}
+
+		/// Remove chunk pointed to by an iterator to free_offsets from both free lists.
+		auto erase(std::map<std::size_t, std::size_t>::iterator it)-> void {
+			auto range = free_sizes.equal_range(it->second);
+			for(auto s = range.first; s != range.second; ++s){
+				if(s->second == it->first){
+					free_sizes.erase(s);
+					break;
+				}
+			}
+			free_offsets.erase(it);
+		}
+
+		/// Find best-fit chunk and reserve the aligned range of given size in there.
+		/// @return offset of the reserved range or -1 if none is available.
+		auto reserve(std::size_t size, std::size_t alignment)-> std::size_t {
+			for(auto s = free_sizes.lower_bound(size); s != free_sizes.end(); ++s){
+				const auto chunk_offset = s->second;
+				const auto chunk_size = s->first;
+				const auto offset = align_up(chunk_offset, alignment);
+				if(offset + size > chunk_offset + chunk_size){
+					continue;
+				}
+				erase(free_offsets.find(chunk_offset));
+				if(offset > chunk_offset){ // alignment padding stays free
+					insert(chunk_offset, offset - chunk_offset);
+				}
+				if(offset + size < chunk_offset + chunk_size){
+					insert(offset + size, chunk_offset + chunk_size - offset - size);
+				}
+				used += size;
+				return offset;
+			}
+			return std::size_t(-1);
+		}
+
+		/// Reserve the range as reserve() does and register it as a chunk in use.
+		/// @return offset of the reserved range or -1 if none is available.
+		auto take(std::size_t size, std::size_t alignment)-> std::size_t {
+			const auto offset = reserve(size, alignment);
+			if(offset != std::size_t(-1)){
+				try {
+					live.emplace(offset, Live{size, {}, 0, {}});
+				} catch(std::bad_alloc&) {
+					release(offset, size);
+					throw;
+				}
+			}
+			return offset;
+		}
+
+		/// Return range to the free list merging it with neighbouring free chunks.
+		auto release(std::size_t offset, std::size_t size)-> void {
+			used -= size;
+			auto next = free_offsets.lower_bound(offset);
+			if(next != free_offsets.end() && offset + size == next->first){
+				size += next->second;
+				erase(next);
+			}
+			auto prev = free_offsets.lower_bound(offset);
+			if(prev != free_offsets.begin()){
+				--prev;
+				if(prev->first + prev->second == offset){
+					offset = prev->first;
+					size += prev->second;
+					erase(prev);
+				}
+			}
+			insert(offset, size);
+		}
+	}; // struct MemoryPool::Block
+
+	/// Constructor. No memory is allocated till the first allocate() request.
+	MemoryPool::MemoryPool(std::size_t block_size)
+	   : _block_size(block_size)
+	{}
+
+	/// Destructor.
+	/// @pre all memory blocks should be released with release() by now.
+	MemoryPool::~MemoryPool() noexcept {
+		assert(_blocks.empty());
+	}
+
+	/// Release all memory blocks.
+	/// Any outstanding allocations are invalidated.
+	auto MemoryPool::release(vuh::Device& device) noexcept-> void {
+		for(auto& b: _blocks){
+			if(b->mapped){
+				device.unmapMemory(b->memory);
+			}
+			device.freeMemory(b->memory);
+		}
+		_blocks.clear();
+	}
+
+	/// @return number of memory blocks currently allocated from device
+	auto MemoryPool::numBlocks() const-> std::size_t {
+		return _blocks.size();
+	}
+
+	/// Sub-allocate the chunk satisfying the given memory requirements in the memory of given type.
+	/// New block is allocated from the device if none of existing ones can hold the request.
+	/// If the buffer is passed as dedicated the chunk gets a block of its own, allocated as
+	/// dedicated to that buffer (see Device::allocateDedicated()). Such block is returned to
+	/// device as soon as the chunk is freed.
+	/// @throws vk::OutOfDeviceMemoryError (or other vk::Error) if new block allocation fails.
+	auto MemoryPool::allocate(vuh::Device& device, uint32_t memid
+	                          , const vk::MemoryRequirements& requirements
+	                          , vk::Buffer dedicated
+	                          )-> Allocation
+	{
+		// chunks of non-coherent memory are aligned to nonCoherentAtomSize, so that flushing
+		// or invalidating one never touches its neighbours
+		const auto atom = std::size_t(device.mapAlignment(memid));
+		const auto size = align_up(std::size_t(requirements.size), atom);
+		const auto alignment = std::max(std::size_t(requirements.alignment), atom);
+		if(dedicated){
+			auto& block = newBlock(device, memid, size, dedicated);
+			const auto offset = block.take(size, 1);
+			return Allocation{block.memory, offset, size, memid, &block, true};
+		}
+		for(auto& b: _blocks){ // first fit over blocks, best fit within the block
+			if(b->memid == memid && !b->dedicated && b->size - b->used >= size){
+				const auto offset = b->take(size, alignment);
+				if(offset != std::size_t(-1)){
+					return Allocation{b->memory, offset, size, memid, b.get()};
+				}
+			}
+		}
+		auto& block = newBlock(device, memid, std::max(_block_size, align_up(size, alignment)));
+		const auto offset = block.take(size, alignment);
+		assert(offset != std::size_t(-1));
+		return Allocation{block.memory, offset, size, memid, &block};
+	}
+
+	/// Return the chunk to the pool.
+	/// Drained blocks are released to device unless this is the only empty block of a default size
+	/// for given memory type. Dedicated blocks are always released.
+	auto MemoryPool::free(vuh::Device& device, const Allocation& allocation) noexcept-> void {
+		if(!allocation){
+			return;
+		}
+		auto& block = *allocation.block;
+		block.live.erase(allocation.offset);
+		block.release(allocation.offset, allocation.size);
+		trimBlock(device, block);
+	}
+
+	/// @return host pointer to the beginning of the allocated chunk.
+	/// The whole block is mapped on the first request and stays mapped during its lifetime,
+	/// so chunks from the same block can be accessed from host simultaneously.
+	/// @pre memory of allocation should be host-visible.
+	auto MemoryPool::map(vuh::Device& device, const Allocation& allocation)-> void* {
+		assert(allocation);
+		auto& block = *allocation.block;
+		if(!block.mapped){
+			block.mapped = device.mapMemory(block.memory, 0, VK_WHOLE_SIZE);
+		}
+		return static_cast<char*>(block.mapped) + allocation.offset;
+	}
+
+	/// Register the owner of the allocation making the allocation movable by defragment().
+	/// Buffer size and usage are needed to recreate the buffer in the new location.
+	/// Untracked allocations are never moved.
+	auto MemoryPool::track(const Allocation& allocation, const Owner& owner
+	                       , std::size_t size_bytes, vk::BufferUsageFlags usage) noexcept-> void
+	{
+		assert(allocation);
+		assert(owner.buffer && owner.memory && owner.allocation && owner.last_use);
+		auto& chunk = allocation.block->live.at(allocation.offset);
+		chunk.owner = owner;
+		chunk.size_bytes = size_bytes;
+		chunk.usage = usage;
+	}
+
+	/// Update the handles locations of the tracked allocation owner.
+	/// Should be called every time the owner is moved. Empty owner stops the tracking.
+	auto MemoryPool::retrack(const Allocation& allocation, const Owner& owner) noexcept-> void {
+		assert(allocation);
+		auto& chunk = allocation.block->live.at(allocation.offset);
+		if(chunk.owner.buffer){
+			chunk.owner = owner;
+		}
+	}
+
+	/// Compact the pool by moving tracked chunks from the sparsely used blocks to the denser
+	/// ones (or to the lower offsets of the same block) and release the drained blocks.
+	/// Buffers of the moved chunks are recreated in the new location, their data is copied
+	/// on the transfer queue and the owners handles are updated, so that arrays remain valid.
+	/// Programs bound to the moved arrays record their commands anew on the next run
+	/// (see Device::numRelocations()).
+	/// Blocks mapped to host memory are left alone, since arrays may hold pointers into those.
+	/// Chunks used by the async submissions not yet complete are left alone as well, so the call
+	/// never waits for other work on the device, only for its own copies.
+	/// Work is done in passes over the source blocks, emptiest first. The call returns when
+	/// all blocks are processed, or the given budget of bytes moved or the time spent is exhausted.
+	/// Time budget is checked between the moves, copies of the current pass are always completed.
+	/// @return number of bytes moved.
+	auto MemoryPool::defragment(vuh::Device& device, std::size_t max_bytes
+	                            , std::chrono::nanoseconds max_time
+	                            )-> std::size_t
+	{
+		using clock = std::chrono::steady_clock;
+		const auto now = clock::now();
+		const auto deadline = max_time >= clock::time_point::max() - now
+		                      ? clock::time_point::max()
+		                      : now + std::chrono::duration_cast<clock::duration>(max_time);
+		device.releaseQueue().collect(device); // find out which chunks are still in use
+		auto sources = std::vector<Block*>{};
+		for(auto& b: _blocks){
+			if(!b->dedicated && !b->mapped && b->used != 0 && b->used < b->size){
+				sources.push_back(b.get());
+			}
+		}
+		std::sort(begin(sources), end(sources), [](const Block* b1, const Block* b2){
+			return b1->used < b2->used;
+		});
+		auto moved = std::size_t(0);
+		for(auto block: sources){
+			if(moved >= max_bytes || clock::now() >= deadline){
+				break;
+			}
+			moved += evacuate(device, *block, max_bytes - moved, deadline);
+			trimBlock(device, *block);
+		}
+		return moved;
+	}
+
+	/// Allocate new block from device memory.
+	/// If the buffer is given the block memory is allocated as dedicated to that buffer.
+	auto MemoryPool::newBlock(vuh::Device& device, uint32_t memid, std::size_t size
+	                          , vk::Buffer dedicated)-> Block&
+	{
+		auto memory = dedicated ? device.allocateDedicated(dedicated, size, memid)
+		                        : device.allocateMemory({size, memid});
+		auto block = std::make_unique<Block>();
+		block->memory = memory;
+		block->size = size;
+		block->memid = memid;
+		block->dedicated = bool(dedicated);
+		block->insert(0, size);
+		_blocks.push_back(std::move(block));
+		return *_blocks.back();
+	}
+
+	/// Release the block if it is drained, unless this is the only empty block of a default size
+	/// for its memory type. Dedicated blocks are always released when drained.
+	auto MemoryPool::trimBlock(vuh::Device& device, Block& block) noexcept-> void {
+		if(block.used != 0){
+			return;
+		}
+		const auto has_spare = std::any_of(begin(_blocks), end(_blocks), [&](const auto& b){
+			return b.get() != &block && b->memid == block.memid && b->used == 0;
+		});
+		if(has_spare || block.size != _block_size || block.dedicated){
+			freeBlock(device, block);
+		}
+	}
+
+	/// Move tracked chunks of the block to the denser blocks of the same memory type,
+	/// or to the lower offsets of the same block if those can not take it.
+	/// Chunks in use by incomplete async submissions are skipped.
+	/// Copies are recorded to a single command buffer, submitted with a fence of their own
+	/// and waited for before returning.
+	/// @return number of bytes moved
+	auto MemoryPool::evacuate(vuh::Device& device, Block& block, std::size_t max_bytes
+	                          , std::chrono::steady_clock::time_point deadline
+	                          )-> std::size_t
+	{
+		/// Relocation of a single chunk.
+		struct Move {
+			std::size_t src_offset;  ///< chunk offset in the source block
+			Block* dst;              ///< destination block
+			std::size_t dst_offset;  ///< chunk offset in the destination block
+			std::size_t size;        ///< destination chunk size
+			vk::Buffer buffer;       ///< buffer bound to the destination chunk
+		};
+		auto moves = std::vector<Move>{};
+		auto aliases = std::map<Block*, vk::Buffer>{}; // whole-block buffers copies are done with
+		const auto alias = [&](Block* b)-> vk::Buffer {
+			auto it = aliases.find(b);
+			if(it == aliases.end()){
+				auto buffer = device.createBuffer({{}, b->size, vk::BufferUsageFlagBits::eTransferSrc
+				                                                | vk::BufferUsageFlagBits::eTransferDst});
+				if(!(device.getBufferMemoryRequirements(buffer).memoryTypeBits & (1u << b->memid))){
+					device.destroyBuffer(buffer);
+					return nullptr;
+				}
+				try {
+					device.bindBufferMemory(buffer, b->memory, 0);
+					it = aliases.emplace(b, buffer).first;
+				} catch(std::exception&) {
+					device.destroyBuffer(buffer);
+					throw;
+				}
+			}
+			return it->second;
+		};
+		auto fence = vk::Fence{};
+		const auto cleanup = [&]{
+			for(auto& m: moves){
+				device.destroyBuffer(m.buffer);
+				m.dst->live.erase(m.dst_offset);
+				m.dst->release(m.dst_offset, m.size);
+			}
+			for(auto& a: aliases){
+				device.destroyBuffer(a.second);
+			}
+			if(fence){
+				device.destroyFence(fence);
+			}
+		};
+
+		const auto& releases = device.releaseQueue();
+		auto moved = std::size_t(0);
+		auto cmd_buf = device.transferCmdBuffer();
+		try {
+			cmd_buf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			const auto atom = std::size_t(device.mapAlignment(block.memid));
+			auto offsets = std::vector<std::size_t>{};
+			for(const auto& c: block.live){
+				offsets.push_back(c.first);
+			}
+			for(auto it = offsets.rbegin(); it != offsets.rend(); ++it){ // top chunks first
+				const auto src_offset = *it;
+				const auto& chunk = block.live.at(src_offset);
+				if(!chunk.owner.buffer || chunk.size > max_bytes - moved
+				   || !releases.isComplete(*chunk.owner.last_use)) // still in use by the device
+				{
+					continue;
+				}
+				if(std::chrono::steady_clock::now() >= deadline){
+					break;
+				}
+				auto buffer = device.createBuffer({{}, chunk.size_bytes, chunk.usage});
+				const auto reqs = device.getBufferMemoryRequirements(buffer);
+				const auto size = align_up(std::size_t(reqs.size), atom);
+				const auto alignment = std::max(std::size_t(reqs.alignment), atom);
+				auto dst = static_cast<Block*>(nullptr);
+				auto dst_offset = std::size_t(-1);
+				if(reqs.memoryTypeBits & (1u << block.memid)){
+					for(auto& b: _blocks){
+						if(b.get() != &block && b->memid == block.memid && !b->dedicated
+						   && b->used > block.used && b->size - b->used >= size)
+						{
+							dst_offset = b->take(size, alignment);
+							if(dst_offset != std::size_t(-1)){
+								dst = b.get();
+								break;
+							}
+						}
+					}
+					if(!dst){
+						dst_offset = block.take(size, alignment);
+						if(dst_offset != std::size_t(-1)){
+							dst = &block;
+							if(dst_offset > src_offset){ // moving up does not help
+								block.live.erase(dst_offset);
+								block.release(dst_offset, size);
+								dst = nullptr;
+							}
+						}
+					}
+				}
+				if(!dst){
+					device.destroyBuffer(buffer);
+					continue;
+				}
+				moves.push_back(Move{src_offset, dst, dst_offset, size, buffer});
+				auto src_alias = alias(&block);
+				auto dst_alias = alias(dst);
+				if(!src_alias || !dst_alias){ // memory type can not be accessed by transfer buffers
+					device.destroyBuffer(buffer);
+					dst->live.erase(dst_offset);
+					dst->release(dst_offset, size);
+					moves.pop_back();
+					break;
+				}
+				device.bindBufferMemory(buffer, dst->memory, dst_offset);
+				cmd_buf.copyBuffer(src_alias, dst_alias
+				                   , vk::BufferCopy(src_offset, dst_offset, chunk.size));
+				moved += chunk.size;
+			}
+			cmd_buf.end();
+			if(moved != 0){
+				fence = device.createFence({});
+				auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmd_buf);
+				device.transferQueue().submit({submit_info}, fence);
+				device.waitForFences({fence}, true, uint64_t(-1));
+				device.destroyFence(fence);
+				fence = nullptr;
+			}
+		} catch(std::exception&) {
+			cleanup();
+			throw;
+		}
+		if(moved == 0){
+			cleanup();
+			return 0;
+		}
+		for(auto& m: moves){
+			auto src = block.live.find(m.src_offset);
+			const auto owner = src->second.owner;
+			device.destroyBuffer(*owner.buffer);
+			*owner.buffer = m.buffer;
+			*owner.memory = m.dst->memory;
+			*owner.allocation = Allocation{m.dst->memory, m.dst_offset, m.size, block.memid, m.dst};
+			auto& dst = m.dst->live.at(m.dst_offset);
+			dst.owner = owner;
+			dst.size_bytes = src->second.size_bytes;
+			dst.usage = src->second.usage;
+			block.release(m.src_offset, src->second.size);
+			block.live.erase(src);
+		}
+		for(auto& a: aliases){
+			device.destroyBuffer(a.second);
+		}
+		device.onRelocate(); // programs bound to the moved arrays record their commands anew
+		return moved;
+	}
+
+	/// Return the block memory to device.
+	auto MemoryPool::freeBlock(vuh::Device& device, Block& block) noexcept-> void {
+		if(block.mapped){
+			device.unmapMemory(block.memory);
+		}
+		device.freeMemory(block.memory);
+		_blocks.erase(std::find_if(begin(_blocks), end(_blocks)
+		                           , [&](const auto& b){ return b.get() == &block;}));
+	}
+} // namespace arr
+} // namespace vuh
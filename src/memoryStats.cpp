@@ -0,0 +1,170 @@
+#include <vuh/memoryStats.h>
+
+#include <cassert>
+#include <sstream>
+
+namespace {
+	/// Write usage counters as a JSON object.
+	auto writeUsage(std::ostream& out, const vuh::MemoryStats::Usage& usage)-> void {
+		out << "{\"count\": " << usage.count
+		    << ", \"total\": " << usage.total
+		    << ", \"bytes\": " << usage.bytes
+		    << ", \"peak_bytes\": " << usage.peak_bytes << "}";
+	}
+} // namespace
+
+namespace vuh {
+	/// Account the allocation of given size.
+	/// Allocations which are not new (moved from elsewhere) do not increment the total count.
+	auto MemoryStats::Counters::add(std::size_t size_bytes, bool is_new) noexcept-> void {
+		count.fetch_add(1, std::memory_order_relaxed);
+		if(is_new){
+			total.fetch_add(1, std::memory_order_relaxed);
+		}
+		const auto b = bytes.fetch_add(size_bytes, std::memory_order_relaxed) + size_bytes;
+		auto peak = peak_bytes.load(std::memory_order_relaxed);
+		while(b > peak && !peak_bytes.compare_exchange_weak(peak, b, std::memory_order_relaxed)){}
+	}
+
+	/// Account the release of the allocation of given size.
+	auto MemoryStats::Counters::remove(std::size_t size_bytes) noexcept-> void {
+		count.fetch_sub(1, std::memory_order_relaxed);
+		bytes.fetch_sub(size_bytes, std::memory_order_relaxed);
+	}
+
+	/// @return current values of the counters
+	auto MemoryStats::Counters::snapshot() const-> Usage {
+		auto r = Usage{};
+		r.count = count.load(std::memory_order_relaxed);
+		r.total = total.load(std::memory_order_relaxed);
+		r.bytes = bytes.load(std::memory_order_relaxed);
+		r.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+		return r;
+	}
+
+	/// Constructor. All counters start at zero.
+	MemoryStats::MemoryStats(const vk::PhysicalDeviceMemoryProperties& properties)
+	   : _num_types(properties.memoryTypeCount)
+	   , _num_heaps(properties.memoryHeapCount)
+	{
+		for(uint32_t i = 0; i < _num_types; ++i){
+			_type_heap[i] = properties.memoryTypes[i].heapIndex;
+		}
+		for(auto& l: _latency){
+			l.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	/// Account the array allocation in the memory of given type.
+	auto MemoryStats::onAllocate(uint32_t memory_id, std::size_t size_bytes
+	                             , std::chrono::steady_clock::duration latency) noexcept-> void
+	{
+		assert(memory_id < _num_types);
+		_types[memory_id].add(size_bytes);
+		_heaps[_type_heap[memory_id]].add(size_bytes);
+		_total.add(size_bytes);
+
+		auto us = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+		auto bucket = std::size_t(0);
+		for(; us != 0 && bucket + 1 < num_latency_buckets; us >>= 1){
+			++bucket;
+		}
+		_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Account the array release.
+	auto MemoryStats::onFree(uint32_t memory_id, std::size_t size_bytes) noexcept-> void {
+		assert(memory_id < _num_types);
+		_types[memory_id].remove(size_bytes);
+		_heaps[_type_heap[memory_id]].remove(size_bytes);
+		_total.remove(size_bytes);
+	}
+
+	/// Account the array memory moved to another memory type (see arr::ResidencyManager).
+	/// Device-wide counters are not affected, and the move does not count as a new allocation.
+	auto MemoryStats::onMove(uint32_t from_id, uint32_t to_id, std::size_t size_bytes) noexcept-> void {
+		assert(from_id < _num_types && to_id < _num_types);
+		_types[from_id].remove(size_bytes);
+		_heaps[_type_heap[from_id]].remove(size_bytes);
+		_types[to_id].add(size_bytes, false);
+		_heaps[_type_heap[to_id]].add(size_bytes, false);
+	}
+
+	/// Account the fall-back of an allocator to the less preferred memory.
+	auto MemoryStats::onFallback() noexcept-> void {
+		_fallbacks.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// @return usage counters of the memory type
+	auto MemoryStats::memoryType(uint32_t memory_id) const-> Usage {
+		assert(memory_id < _num_types);
+		return _types[memory_id].snapshot();
+	}
+
+	/// @return usage counters of the memory heap
+	auto MemoryStats::heap(uint32_t heap_id) const-> Usage {
+		assert(heap_id < _num_heaps);
+		return _heaps[heap_id].snapshot();
+	}
+
+	/// @return usage counters of the whole device
+	auto MemoryStats::total() const-> Usage {
+		return _total.snapshot();
+	}
+
+	/// @return number of allocator fall-backs to the less preferred memory
+	auto MemoryStats::fallbacks() const-> uint64_t {
+		return _fallbacks.load(std::memory_order_relaxed);
+	}
+
+	/// @return allocation latency histogram (see num_latency_buckets)
+	auto MemoryStats::latencyHistogram() const-> std::array<uint64_t, num_latency_buckets> {
+		auto r = std::array<uint64_t, num_latency_buckets>{};
+		for(std::size_t i = 0; i < num_latency_buckets; ++i){
+			r[i] = _latency[i].load(std::memory_order_relaxed);
+		}
+		return r;
+	}
+
+	/// Set high watermarks to the current usage, so that peaks of the next period can be measured.
+	auto MemoryStats::resetPeaks() noexcept-> void {
+		const auto reset = [](Counters& c){
+			c.peak_bytes.store(c.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		};
+		for(auto& c: _types){ reset(c); }
+		for(auto& c: _heaps){ reset(c); }
+		reset(_total);
+	}
+
+	/// @return all counters as a JSON object.
+	/// Histogram is written as an array of bucket counts, together with the upper bounds
+	/// of buckets (microseconds).
+	auto MemoryStats::toJson() const-> std::string {
+		auto out = std::ostringstream{};
+		out << "{\"total\": ";
+		writeUsage(out, total());
+		out << ", \"heaps\": [";
+		for(uint32_t i = 0; i < _num_heaps; ++i){
+			out << (i ? ", " : "");
+			writeUsage(out, heap(i));
+		}
+		out << "], \"memory_types\": [";
+		for(uint32_t i = 0; i < _num_types; ++i){
+			out << (i ? ", " : "") << "{\"heap\": " << _type_heap[i] << ", \"usage\": ";
+			writeUsage(out, memoryType(i));
+			out << "}";
+		}
+		out << "], \"fallbacks\": " << fallbacks();
+		out << ", \"latency_us\": {\"upper_bounds\": [";
+		for(std::size_t i = 0; i + 1 < num_latency_buckets; ++i){
+			out << (i ? ", " : "") << (uint64_t(1) << i);
+		}
+		out << "], \"counts\": [";
+		const auto histogram = latencyHistogram();
+		for(std::size_t i = 0; i < num_latency_buckets; ++i){
+			out << (i ? ", " : "") << histogram[i];
+		}
+		out << "]}}";
+		return out.str();
+	}
+} // namespace vuh
@@ -0,0 +1,83 @@
+#include <vuh/arr/pinnedHeap.h>
+#include <vuh/device.h>
+#include <vuh/error.h>
+
+#include <cassert>
+
+namespace vuh {
+namespace arr {
+	/// Destructor. Heap should be released with release() before this.
+	PinnedHeap::~PinnedHeap() noexcept {
+		assert(_chunks.empty());
+	}
+
+	/// Allocate host-coherent memory of given size.
+	/// @return host pointer to the beginning of allocated memory. It stays valid till deallocate().
+	/// @throws vuh::NoSuitableMemoryFound if device has no host-coherent memory with enough space left
+	/// @throws vk::OutOfDeviceMemoryError (or other vk::Error) if memory allocation fails
+	auto PinnedHeap::allocate(vuh::Device& device, std::size_t size_bytes)-> void* {
+		auto buffer = device.createBuffer({{}, size_bytes, vk::BufferUsageFlagBits::eStorageBuffer
+		                                                  | vk::BufferUsageFlagBits::eTransferSrc
+		                                                  | vk::BufferUsageFlagBits::eTransferDst});
+		auto allocation = MemoryPool::Allocation{};
+		try {
+			const auto memid = device.selectMemory(buffer, vk::MemoryPropertyFlagBits::eHostVisible
+			                                               | vk::MemoryPropertyFlagBits::eHostCoherent);
+			if(memid == uint32_t(-1)){
+				throw NoSuitableMemoryFound("no host-coherent memory available for pinned allocation");
+			}
+			const auto reqs = device.bufferRequirements(buffer);
+			allocation = device.memoryPool().allocate(device, memid, reqs.memory
+			                                 , device.useDedicated(reqs) ? buffer : vk::Buffer{});
+			device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+			auto ptr = static_cast<char*>(device.memoryPool().map(device, allocation));
+			_chunks.emplace(ptr, Chunk{buffer, allocation, size_bytes});
+			return ptr;
+		} catch(...) {
+			device.memoryPool().free(device, allocation);
+			device.destroyBuffer(buffer);
+			throw;
+		}
+	}
+
+	/// Return memory previously allocated with allocate().
+	/// Noop for null pointer.
+	auto PinnedHeap::deallocate(vuh::Device& device, void* ptr) noexcept-> void {
+		if(ptr == nullptr){
+			return;
+		}
+		auto it = _chunks.find(static_cast<const char*>(ptr));
+		assert(it != _chunks.end());
+		device.destroyBuffer(it->second.buffer);
+		device.memoryPool().free(device, it->second.allocation);
+		_chunks.erase(it);
+	}
+
+	/// @return location of the host pointer in pinned buffers.
+	/// Pointer may point anywhere inside the allocated memory.
+	/// Returned range has a null buffer if pointer does not belong to this heap.
+	auto PinnedHeap::find(const void* ptr) const-> Range {
+		const auto p = static_cast<const char*>(ptr);
+		auto it = _chunks.upper_bound(p);
+		if(it == _chunks.begin()){
+			return Range{};
+		}
+		--it;
+		const auto offset = std::size_t(p - it->first);
+		if(offset >= it->second.size_bytes){
+			return Range{};
+		}
+		return Range{it->second.buffer, offset, it->second.size_bytes - offset};
+	}
+
+	/// Release all allocations.
+	/// @pre memory pool of the device should still be alive.
+	auto PinnedHeap::release(vuh::Device& device) noexcept-> void {
+		for(auto& c: _chunks){
+			device.destroyBuffer(c.second.buffer);
+			device.memoryPool().free(device, c.second.allocation);
+		}
+		_chunks.clear();
+	}
+} // namespace arr
+} // namespace vuh
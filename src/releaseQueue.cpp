@@ -0,0 +1,90 @@
+#include <vuh/releaseQueue.h>
+#include <vuh/device.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace vuh {
+	/// Start tracking the async submission. Takes ownership of the fence signalled on its completion,
+	/// the fence is destroyed after it is signalled and detached by the caller.
+	/// Completed submissions are collected.
+	/// @return number given to the submission
+	auto ReleaseQueue::track(vuh::Device& device, vk::Fence fence)-> uint64_t {
+		_submissions.push_back(Submission{_submitted + 1, fence, false, true});
+		++_submitted;
+		collect(device);
+		return _submitted;
+	}
+
+	/// Let the queue know the fence of the submission is no longer referred outside of the queue,
+	/// so that it can be destroyed once signalled. Completed submissions are collected.
+	auto ReleaseQueue::detach(vuh::Device& device, uint64_t serial) noexcept-> void {
+		auto it = std::lower_bound(begin(_submissions), end(_submissions), serial
+		                           , [](const Submission& s, uint64_t n){ return s.serial < n; });
+		if(it != end(_submissions) && it->serial == serial){
+			it->attached = false;
+		}
+		collect(device);
+	}
+
+	/// Check the state of tracked submissions without blocking, release the resources whose
+	/// submissions have completed and destroy the fences no longer referred.
+	/// @return number of released actions
+	auto ReleaseQueue::collect(vuh::Device& device) noexcept-> std::size_t {
+		for(auto& s: _submissions){
+			if(!s.complete){
+				if(device.getFenceStatus(s.fence) != vk::Result::eSuccess){
+					break;
+				}
+				s.complete = true;
+			}
+			_completed = std::max(_completed, s.serial);
+		}
+		while(!_submissions.empty() && _submissions.front().complete && !_submissions.front().attached){
+			device.destroyFence(_submissions.front().fence);
+			_submissions.pop_front();
+		}
+		if(_submissions.empty()){
+			_completed = _submitted;
+		}
+
+		const auto ready = std::stable_partition(begin(_deferred), end(_deferred)
+		                                         , [this](const auto& d){ return !isComplete(d.first); });
+		auto items = std::vector<std::unique_ptr<Item>>{};
+		for(auto it = ready; it != end(_deferred); ++it){
+			items.push_back(std::move(it->second));
+		}
+		_deferred.erase(ready, end(_deferred));
+		for(auto& item: items){ // actions are called after the queue is consistent again
+			(*item)(device);
+		}
+		return items.size();
+	}
+
+	/// Block till the submission with given number and all preceding ones complete,
+	/// and collect the released resources.
+	auto ReleaseQueue::wait(vuh::Device& device, uint64_t serial) noexcept-> void {
+		for(const auto& s: _submissions){
+			if(s.serial > serial){
+				break;
+			}
+			if(!s.complete){
+				device.waitForFences({s.fence}, true, uint64_t(-1));
+			}
+		}
+		collect(device);
+	}
+
+	/// Wait for all tracked submissions, release all postponed resources and destroy all fences.
+	/// Delayed objects still referring the fences should not be used after this call.
+	auto ReleaseQueue::release(vuh::Device& device) noexcept-> void {
+		wait(device, _submitted);
+		for(auto& s: _submissions){
+			device.destroyFence(s.fence);
+		}
+		_submissions.clear();
+		_completed = _submitted;
+		collect(device);
+		assert(_deferred.empty());
+	}
+} // namespace vuh
@@ -0,0 +1,284 @@
+#include <vuh/arr/residencyManager.h>
+#include <vuh/arr/arrayUtils.h>
+#include <vuh/device.h>
+#include <vuh/memoryStats.h>
+#include <vuh/releaseQueue.h>
+
+#include <algorithm>
+#include <cassert>
+#include <exception>
+
+namespace {
+	/// @return value rounded up to the nearest multiple of alignment
+	auto align_up(std::size_t value, std::size_t alignment)-> std::size_t {
+		return alignment > 1 ? (value + alignment - 1)/alignment*alignment : value;
+	}
+
+	/// @return id of the host-visible and host-coherent memory type allowed by the type bits outside
+	/// of the given heap with enough budget left to take the allocation of given size,
+	/// -1 if there is none. Coherent memory needs no flushes, so arrays need not track the host writes.
+	auto host_memory(const vuh::Device& device, uint32_t type_bits, uint32_t heap_id
+	                 , vk::DeviceSize size)-> uint32_t
+	{
+		const auto& props = device.memoryProperties();
+		const auto host = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		for(uint32_t i = 0; i < props.memoryTypeCount; ++i){
+			const auto& type = props.memoryTypes[i];
+			if((type_bits & (1u << i))
+			   && (type.propertyFlags & host) == host
+			   && type.heapIndex != heap_id
+			   && size <= device.heapAvailable(type.heapIndex))
+			{
+				return i;
+			}
+		}
+		return uint32_t(-1);
+	}
+} // namespace
+
+namespace vuh {
+namespace arr {
+	/// Register the memory to be managed.
+	/// Memory is only registered if it is device-local and not host-visible, and the buffer
+	/// bound to it may take part in transfers (so that the data can be moved around).
+	/// Memory is considered just used.
+	auto ResidencyManager::track(const vuh::Device& device, const Owner& owner
+	                             , std::size_t size_bytes, vk::BufferUsageFlags usage) noexcept-> void
+	{
+		assert(owner.buffer && owner.memory && owner.memid && owner.dedicated
+		       && owner.flags && owner.mapped && owner.last_use);
+		const auto flags = device.memoryProperties(*owner.memid);
+		const auto transfer = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+		if(!(flags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+		   || (flags & vk::MemoryPropertyFlagBits::eHostVisible)
+		   || (usage & transfer) != transfer)
+		{
+			return;
+		}
+		try {
+			_entries[static_cast<VkDeviceMemory>(*owner.memory)]
+			      = Entry{owner, size_bytes, usage, *owner.memid, ++_clock};
+		} catch(std::exception&) { // memory just remains unmanaged
+		}
+	}
+
+	/// Update the handles locations of the tracked memory owner.
+	/// Should be called every time the owner is moved.
+	auto ResidencyManager::retrack(const Owner& owner) noexcept-> void {
+		auto it = _entries.find(static_cast<VkDeviceMemory>(*owner.memory));
+		if(it != _entries.end()){
+			it->second.owner = owner;
+		}
+	}
+
+	/// Stop managing the memory. Should be called before the memory is released.
+	/// Noop if memory is not tracked.
+	auto ResidencyManager::untrack(vk::DeviceMemory memory) noexcept-> void {
+		_entries.erase(static_cast<VkDeviceMemory>(memory));
+	}
+
+	/// Mark the memory as just used. Evicted memory is restored to its original memory type
+	/// if there is room for it, or room can be made by evicting other (less recently used) memory.
+	/// Otherwise memory stays where it is.
+	/// Should be called before the buffer handle of the memory owner is used, since that changes
+	/// when memory is moved. Noop if memory is not tracked.
+	auto ResidencyManager::touch(vuh::Device& device, vk::DeviceMemory memory)-> void {
+		auto it = _entries.find(static_cast<VkDeviceMemory>(memory));
+		if(it == _entries.end()){
+			return;
+		}
+		auto& entry = it->second; // references to map elements survive the rehashing
+		entry.last_use = ++_clock;
+		if(*entry.owner.memid == entry.home){
+			return;
+		}
+		const auto heap_id = device.memoryProperties().memoryTypes[entry.home].heapIndex;
+		if(device.heapAvailable(heap_id) < entry.size_bytes){
+			evict(device, heap_id, entry.size_bytes, memory);
+		}
+		if(device.heapAvailable(heap_id) >= entry.size_bytes){
+			relocate(device, {{&entry, entry.home}});
+		}
+	}
+
+	/// Make room for the buffer in the first device-local memory type matching the flags,
+	/// evicting the least recently used memory from the corresponding heap if the buffer does
+	/// not fit in the heap budget. Noop if flags do not request device-local memory.
+	auto ResidencyManager::makeRoom(vuh::Device& device, vk::Buffer buffer
+	                                , vk::MemoryPropertyFlags flags)-> void
+	{
+		if(!(flags & vk::MemoryPropertyFlagBits::eDeviceLocal)){
+			return;
+		}
+		const auto reqs = device.getBufferMemoryRequirements(buffer);
+		const auto& props = device.memoryProperties();
+		for(uint32_t i = 0; i < props.memoryTypeCount; ++i){
+			if((reqs.memoryTypeBits & (1u << i))
+			   && (props.memoryTypes[i].propertyFlags & flags) == flags)
+			{
+				const auto heap_id = props.memoryTypes[i].heapIndex;
+				if(device.heapAvailable(heap_id) < reqs.size){
+					evict(device, heap_id, reqs.size);
+				}
+				return;
+			}
+		}
+	}
+
+	/// Evict least recently used resident memory of the heap to the host-visible memory,
+	/// till there is enough budget left in the heap to allocate given number of bytes,
+	/// or there is nothing more to evict.
+	/// @return number of bytes evicted
+	auto ResidencyManager::evict(vuh::Device& device, uint32_t heap_id, std::size_t size_bytes
+	                             , vk::DeviceMemory keep)-> std::size_t
+	{
+		const auto& props = device.memoryProperties();
+		auto candidates = std::vector<Entry*>{};
+		for(auto& e: _entries){
+			if(e.first != static_cast<VkDeviceMemory>(keep)
+			   && *e.second.owner.memid == e.second.home
+			   && props.memoryTypes[e.second.home].heapIndex == heap_id)
+			{
+				candidates.push_back(&e.second);
+			}
+		}
+		std::sort(begin(candidates), end(candidates)
+		          , [](const Entry* e1, const Entry* e2){ return e1->last_use < e2->last_use; });
+
+		const auto available = std::size_t(device.heapAvailable(heap_id));
+		auto moves = std::vector<std::pair<Entry*, uint32_t>>{};
+		auto freed = std::size_t(0);
+		for(auto e: candidates){
+			if(available + freed >= size_bytes){
+				break;
+			}
+			moves.emplace_back(e, uint32_t(-1));
+			freed += e->size_bytes;
+		}
+		return moves.empty() ? 0 : relocate(device, moves);
+	}
+
+	/// @return true if memory is managed
+	auto ResidencyManager::isTracked(vk::DeviceMemory memory) const-> bool {
+		return _entries.count(static_cast<VkDeviceMemory>(memory)) != 0;
+	}
+
+	/// @return true if the memory is in its original memory type (or is not managed).
+	auto ResidencyManager::isResident(vk::DeviceMemory memory) const-> bool {
+		auto it = _entries.find(static_cast<VkDeviceMemory>(memory));
+		return it == _entries.end() || *it->second.owner.memid == it->second.home;
+	}
+
+	/// @return number of managed memory allocations currently evicted
+	auto ResidencyManager::numEvicted() const-> std::size_t {
+		return std::size_t(std::count_if(begin(_entries), end(_entries), [](const auto& e){
+			return *e.second.owner.memid != e.second.home;
+		}));
+	}
+
+	/// Move memory of the given entries to the given memory types (-1 stands for any host-visible
+	/// memory outside of the entry home heap).
+	/// Waits for the async submissions that last used the entries, recreates buffers in the new
+	/// memory, copies the data with a single transfer submission and waits for it to complete.
+	/// The owners handles, memory flags and mappings are updated, and the relocation is recorded
+	/// with the device, so that programs bound to the moved arrays record their commands anew.
+	/// Entries which can not be moved (no suitable memory or allocation fails) are left in place.
+	/// @return number of bytes moved
+	auto ResidencyManager::relocate(vuh::Device& device
+	                                , const std::vector<std::pair<Entry*, uint32_t>>& moves
+	                                )-> std::size_t
+	{
+		/// Relocation of a single entry.
+		struct Move {
+			Entry* entry;             ///< moved entry
+			uint32_t memid;           ///< destination memory type id
+			vk::Buffer buffer;        ///< buffer bound to the destination memory
+			vk::DeviceMemory memory;  ///< destination memory
+		};
+		auto done = std::vector<Move>{};
+		auto fence = vk::Fence{};
+		const auto cleanup = [&]{
+			for(auto& m: done){
+				device.destroyBuffer(m.buffer);
+				device.freeMemory(m.memory);
+			}
+			if(fence){
+				device.destroyFence(fence);
+			}
+		};
+
+		// memory may be in use by the async submissions, blocking ones are complete already
+		auto last_use = uint64_t(0);
+		for(const auto& mv: moves){
+			last_use = std::max(last_use, *mv.first->owner.last_use);
+		}
+		device.releaseQueue().wait(device, last_use);
+		auto moved = std::size_t(0);
+		auto cmd_buf = device.transferCmdBuffer();
+		try {
+			cmd_buf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			for(const auto& mv: moves){
+				auto& entry = *mv.first;
+				auto buffer = device.createBuffer({{}, entry.size_bytes, entry.usage});
+				const auto reqs = device.getBufferMemoryRequirements(buffer);
+				const auto home_heap = device.memoryProperties().memoryTypes[entry.home].heapIndex;
+				const auto memid = mv.second != uint32_t(-1) ? mv.second
+				                 : host_memory(device, reqs.memoryTypeBits, home_heap, reqs.size);
+				if(memid == uint32_t(-1) || !(reqs.memoryTypeBits & (1u << memid))){
+					device.destroyBuffer(buffer);
+					continue;
+				}
+				auto memory = vk::DeviceMemory{};
+				try {
+					const auto size = align_up(std::size_t(reqs.size)
+					                           , std::size_t(device.mapAlignment(memid)));
+					memory = device.allocateMemory({size, memid});
+				} catch(vk::Error&) { // no room there, leave the entry in place
+					device.destroyBuffer(buffer);
+					continue;
+				}
+				done.push_back(Move{&entry, memid, buffer, memory});
+				device.bindBufferMemory(buffer, memory, 0);
+				const auto regions = copyRegions(0, 0, entry.size_bytes);
+				cmd_buf.copyBuffer(*entry.owner.buffer, buffer, uint32_t(regions.size()), regions.data());
+				moved += entry.size_bytes;
+			}
+			cmd_buf.end();
+			if(!done.empty()){
+				fence = device.createFence({});
+				auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmd_buf);
+				device.transferQueue().submit({submit_info}, fence);
+				device.waitForFences({fence}, true, uint64_t(-1));
+				device.destroyFence(fence);
+				fence = nullptr;
+			}
+		} catch(std::exception&) {
+			cleanup();
+			throw;
+		}
+
+		for(auto& m: done){
+			auto entry = *m.entry;
+			const auto old_memory = *entry.owner.memory;
+			if(*entry.owner.mapped){ // evicted memory is mapped on host access
+				device.unmapMemory(old_memory);
+				*entry.owner.mapped = nullptr;
+			}
+			device.destroyBuffer(*entry.owner.buffer);
+			device.freeMemory(old_memory);
+			device.memoryStats().onMove(*entry.owner.memid, m.memid, entry.size_bytes);
+			*entry.owner.buffer = m.buffer;
+			*entry.owner.memory = m.memory;
+			*entry.owner.memid = m.memid;
+			*entry.owner.dedicated = false;
+			*entry.owner.flags = device.memoryProperties(m.memid);
+			_entries.erase(static_cast<VkDeviceMemory>(old_memory));
+			_entries.emplace(static_cast<VkDeviceMemory>(m.memory), entry);
+		}
+		if(!done.empty()){
+			device.onRelocate();
+		}
+		return moved;
+	}
+} // namespace arr
+} // namespace vuh
@@ -0,0 +1,240 @@
+#include <vuh/arr/stagingRing.h>
+#include <vuh/arr/allocDevice.hpp>
+#include <vuh/arr/arrayProperties.h>
+#include <vuh/device.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+namespace {
+	/// @return value rounded up to the nearest multiple of alignment
+	auto align_up(std::size_t value, std::size_t alignment)-> std::size_t {
+		return (value + alignment - 1)/alignment*alignment;
+	}
+
+	/// Staging buffer together with its memory.
+	struct Stage {
+		vk::Buffer buffer;
+		vk::DeviceMemory memory;
+		uint32_t memid;
+	};
+
+	/// Create host-visible buffer with memory bound to it.
+	template<class Props>
+	auto createStage(vuh::Device& device, std::size_t size_bytes)-> Stage {
+		using Alloc = vuh::arr::AllocDevice<Props>;
+		auto buffer = Alloc::makeBuffer(device, size_bytes, {});
+		try {
+			auto alloc = Alloc{};
+			auto memory = alloc.allocMemory(device, buffer, {});
+			device.bindBufferMemory(buffer, memory, 0);
+			return Stage{buffer, memory, alloc.memId()};
+		} catch(std::runtime_error&) {
+			device.destroyBuffer(buffer);
+			throw;
+		}
+	}
+
+	/// Create staging buffer suitable for the given transfer direction.
+	auto createStage(vuh::Device& device, vuh::arr::StagingRing::Direction direction
+	                 , std::size_t size_bytes)-> Stage
+	{
+		using namespace vuh::arr;
+		return direction == StagingRing::Direction::Upload
+		       ? createStage<properties::HostCoherent>(device, size_bytes)
+		       : createStage<properties::HostCached>(device, size_bytes);
+	}
+} // namespace
+
+namespace vuh {
+namespace arr {
+	/// Constructor. Used by the StagingRing only.
+	StagingRing::Chunk::Chunk(vuh::Device& device, StagingRing* ring, vk::Buffer buffer
+	                          , vk::DeviceMemory memory, uint32_t memid
+	                          , std::size_t offset, std::size_t size, void* data)
+	   : _device(&device), _ring(ring), _buffer(buffer), _memory(memory), _memid(memid)
+	   , _offset(offset), _size(size), _data(data)
+	{}
+
+	/// Move constructor.
+	StagingRing::Chunk::Chunk(Chunk&& other) noexcept
+	   : _device(other._device), _ring(other._ring), _buffer(other._buffer), _memory(other._memory)
+	   , _memid(other._memid), _offset(other._offset), _size(other._size), _data(other._data)
+	{
+		other._device = nullptr;
+	}
+
+	/// Move assignment. Current chunk is given back immediately.
+	auto StagingRing::Chunk::operator= (Chunk&& other) noexcept-> Chunk& {
+		release();
+		_device = other._device;
+		_ring = other._ring;
+		_buffer = other._buffer;
+		_memory = other._memory;
+		_memid = other._memid;
+		_offset = other._offset;
+		_size = other._size;
+		_data = other._data;
+		other._device = nullptr;
+		return *this;
+	}
+
+	/// Give the chunk back to the ring (or release transient buffer resources).
+	StagingRing::Chunk::~Chunk() noexcept {
+		release();
+	}
+
+	/// @return memory property flags of the chunk memory.
+	auto StagingRing::Chunk::memoryProperties() const-> vk::MemoryPropertyFlags {
+		return _device->memoryProperties(_memid);
+	}
+
+	/// Make host writes to the chunk available to the device.
+	/// Noop for host-coherent memory.
+	auto StagingRing::Chunk::flush() const-> void {
+		if(!(_device->memoryProperties(_memid) & vk::MemoryPropertyFlagBits::eHostCoherent)){
+			_device->flushMappedMemoryRanges(mappedRange());
+		}
+	}
+
+	/// Make device writes to the chunk visible to the host.
+	/// Noop for host-coherent memory.
+	auto StagingRing::Chunk::invalidate() const-> void {
+		if(!(_device->memoryProperties(_memid) & vk::MemoryPropertyFlagBits::eHostCoherent)){
+			_device->invalidateMappedMemoryRanges(mappedRange());
+		}
+	}
+
+	/// @return memory range covering the chunk, rounded to nonCoherentAtomSize.
+	/// Chunks (and transient buffers memory) are allocated at that granularity.
+	auto StagingRing::Chunk::mappedRange() const-> vk::MappedMemoryRange {
+		const auto atom = std::size_t(_device->mapAlignment(_memid));
+		return vk::MappedMemoryRange(_memory, _offset, align_up(_size, atom));
+	}
+
+	/// Give the chunk back to the ring (or release transient buffer resources).
+	auto StagingRing::Chunk::release() noexcept-> void {
+		if(!_device){
+			return;
+		}
+		if(_ring){
+			_ring->recycle(_offset);
+		} else {
+			_device->unmapMemory(_memory);
+			_device->freeMemory(_memory);
+			_device->destroyBuffer(_buffer);
+		}
+		_device = nullptr;
+	}
+
+	/// Create the ring of given size (bytes) in host-visible memory suitable for the given
+	/// transfer direction.
+	StagingRing::StagingRing(vuh::Device& device, Direction direction, std::size_t size)
+	   : _direction(direction)
+	{
+		auto stage = createStage(device, direction, size);
+		_buffer = stage.buffer;
+		_memory = stage.memory;
+		_memid = stage.memid;
+		_alignment = std::max(std::size_t(device.mapAlignment(_memid)), alignof(std::max_align_t));
+		_size = size/_alignment*_alignment;
+		try {
+			_mapped = device.mapMemory(_memory, 0, VK_WHOLE_SIZE);
+		} catch(vk::Error&) {
+			release(device);
+			throw;
+		}
+	}
+
+	/// Destructor.
+	/// @pre ring resources should be released by now with release().
+	StagingRing::~StagingRing() noexcept {
+		assert(!_buffer);
+	}
+
+	/// Take a chunk of staging memory of at least given size.
+	/// If the free space of the ring is not enough a transient buffer is created for the chunk.
+	auto StagingRing::acquire(vuh::Device& device, std::size_t size_bytes)-> Chunk {
+		const auto size = align_up(std::max(size_bytes, std::size_t(1)), _alignment);
+		const auto offset = reserve(size);
+		if(offset != std::size_t(-1)){
+			return Chunk(device, this, _buffer, _memory, _memid, offset, size_bytes
+			             , static_cast<char*>(_mapped) + offset);
+		}
+		auto stage = createStage(device, _direction, size_bytes);
+		auto data = static_cast<void*>(nullptr);
+		try {
+			data = device.mapMemory(stage.memory, 0, VK_WHOLE_SIZE);
+		} catch(vk::Error&) {
+			device.freeMemory(stage.memory);
+			device.destroyBuffer(stage.buffer);
+			throw;
+		}
+		return Chunk(device, nullptr, stage.buffer, stage.memory, stage.memid, 0, size_bytes, data);
+	}
+
+	/// @return memory property flags of the ring memory.
+	/// Transient chunks are allocated with the same requirements, so normally in the same memory type.
+	auto StagingRing::memoryProperties(const vuh::Device& device) const-> vk::MemoryPropertyFlags {
+		return device.memoryProperties(_memid);
+	}
+
+	/// Release the ring resources.
+	/// @pre all chunks taken from the ring should be released by now (chunks outliving the ring
+	/// would recycle to the freed memory). Device::setStagingRingSize() checks that.
+	auto StagingRing::release(vuh::Device& device) noexcept-> void {
+		assert(_segments.empty());
+		if(_buffer){
+			if(_mapped){
+				device.unmapMemory(_memory);
+				_mapped = nullptr;
+			}
+			device.freeMemory(_memory);
+			device.destroyBuffer(_buffer);
+			_buffer = nullptr;
+		}
+	}
+
+	/// Reserve the range of given size following the most recent chunk, wrapping around the end
+	/// of the ring if necessary.
+	/// @return offset of reserved range or -1 if there is not enough free space.
+	auto StagingRing::reserve(std::size_t size)-> std::size_t {
+		auto offset = std::size_t(-1);
+		if(_segments.empty()){
+			_head = 0;
+			if(size <= _size){
+				offset = 0;
+			}
+		} else {
+			const auto tail = _segments.front().offset;
+			if(_head > tail){ // free space is [head, size) and [0, tail)
+				if(_head + size <= _size){
+					offset = _head;
+				} else if(size <= tail){
+					offset = 0;
+				}
+			} else if(_head + size <= tail){ // wrapped, free space is [head, tail)
+				offset = _head;
+			}
+		}
+		if(offset != std::size_t(-1)){
+			_segments.push_back(Segment{offset, false});
+			_head = offset + size;
+		}
+		return offset;
+	}
+
+	/// Mark the chunk at given offset released and reclaim the space of all released chunks
+	/// at the front of the queue.
+	auto StagingRing::recycle(std::size_t offset) noexcept-> void {
+		auto it = std::find_if(begin(_segments), end(_segments)
+		                       , [offset](const Segment& s){ return s.offset == offset && !s.released; });
+		assert(it != end(_segments));
+		it->released = true;
+		while(!_segments.empty() && _segments.front().released){
+			_segments.pop_front();
+		}
+	}
+} // namespace arr
+} // namespace vuh
@@ -1,9 +1,98 @@
 #include <vuh/utils.h>
 #include <vuh/error.h>
+#include <vuh/mappedFile.h>
 #include <vuh/arr/arrayUtils.h>
+#include <vuh/arr/mappedCopy.h>
+#include <vuh/arr/stagingRing.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iterator>
+#include <vector>
+
+namespace {
+	/// Double-buffered transfer between the host and device buffer through the staging ring.
+	/// Keeps two staging chunks each with its own command buffer and fence, so that host side
+	/// copy to/from one of them may overlap with the device side copy of the other.
+	class Stream {
+	public:
+		/// Staging chunk with resources to run transfer commands on it.
+		struct Slot {
+			vuh::arr::StagingRing::Chunk stage; ///< staging memory
+			vk::CommandBuffer cmd_buffer;       ///< transfer command buffer
+			vk::Fence fence;                    ///< signalled when the transfer command completes
+			std::size_t offset = 0;             ///< offset of the chunk data wrt the beginning of transfer
+			std::size_t size = 0;               ///< size of the chunk data (bytes)
+			bool pending = false;               ///< true if the chunk data is waiting to be consumed
+
+			explicit Slot(vuh::arr::StagingRing::Chunk&& stage): stage(std::move(stage)) {}
+		};
+
+		/// Constructor. Takes two chunks of given size from the ring.
+		Stream(vuh::Device& device, vuh::arr::StagingRing& ring, std::size_t chunk_size)
+		   : _device(device)
+		{
+			_slots.reserve(2);
+			try {
+				for(auto cmd_buffer: device.allocateCommandBuffers({device.transferCmdPool()
+				                                          , vk::CommandBufferLevel::ePrimary, 2}))
+				{
+					_slots.emplace_back(ring.acquire(device, chunk_size));
+					_slots.back().cmd_buffer = cmd_buffer;
+					_slots.back().fence = device.createFence({vk::FenceCreateFlagBits::eSignaled});
+				}
+			} catch(std::runtime_error&) {
+				release();
+				throw;
+			}
+		}
+
+		/// Destructor. Waits for all in-flight transfers and releases resources.
+		~Stream() noexcept { release(); }
+
+		Stream(const Stream&) = delete;
+		auto operator= (const Stream&)-> Stream& = delete;
+
+		/// @return i-th slot (modulo number of slots)
+		auto slot(std::size_t i)-> Slot& { return _slots[i % _slots.size()]; }
+
+		/// Block till transfer command submitted with the slot completes.
+		auto wait(Slot& slot)-> void {
+			_device.waitForFences({slot.fence}, true, uint64_t(-1));
+		}
+
+		/// Submit the copy command. Slot should be free (see wait()).
+		auto submit(Slot& slot, vk::Buffer src, std::size_t src_offset
+		            , vk::Buffer dst, std::size_t dst_offset, std::size_t size_bytes)-> void
+		{
+			_device.resetFences({slot.fence});
+			slot.cmd_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			auto region = vk::BufferCopy(src_offset, dst_offset, size_bytes);
+			slot.cmd_buffer.copyBuffer(src, dst, region);
+			slot.cmd_buffer.end();
+			auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &slot.cmd_buffer);
+			_device.transferQueue().submit({submit_info}, slot.fence);
+		}
+	private: // helpers
+		auto release() noexcept-> void {
+			for(auto& s: _slots){
+				if(s.fence){
+					_device.waitForFences({s.fence}, true, uint64_t(-1));
+					_device.destroyFence(s.fence);
+				}
+				if(s.cmd_buffer){
+					_device.freeCommandBuffers(_device.transferCmdPool(), s.cmd_buffer);
+				}
+			}
+			_slots.clear();
+		}
+	private: // data
+		vuh::Device& _device;     ///< device to run transfers on
+		std::vector<Slot> _slots; ///< staging chunks
+	}; // class Stream
+} // namespace
 
 namespace vuh {
 	
@@ -23,6 +112,22 @@ namespace vuh {
 	}
 
 namespace arr {
+	/// @return regions of the buffer copy command transferring given range of bytes.
+	/// Range is split to consecutive regions of at most max_copy_region bytes.
+	auto copyRegions(std::size_t src_offset ///< source buffer offset (bytes)
+	                 , std::size_t dst_offset ///< destination buffer offset (bytes)
+	                 , std::size_t size_bytes ///< number of bytes to copy
+	                 )-> std::vector<vk::BufferCopy>
+	{
+		auto r = std::vector<vk::BufferCopy>{};
+		r.reserve((size_bytes + max_copy_region - 1)/max_copy_region);
+		for(auto offset = std::size_t(0); offset < size_bytes; offset += max_copy_region){
+			r.emplace_back(src_offset + offset, dst_offset + offset
+			               , std::min(max_copy_region, size_bytes - offset));
+		}
+		return r;
+	}
+
 	/// Copy data between device buffers using the device transfer command pool and queue.
 	/// Source and destination buffers are supposed to be allocated on the same device.
 	/// Fully sync, no latency hiding whatsoever.
@@ -36,13 +141,134 @@ namespace arr {
 	{
 		auto cmd_buf = device.transferCmdBuffer();
 		cmd_buf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-		auto region = vk::BufferCopy(src_offset, dst_offset, size_bytes);
-		cmd_buf.copyBuffer(src, dst, region);
+		const auto regions = copyRegions(src_offset, dst_offset, size_bytes);
+		cmd_buf.copyBuffer(src, dst, uint32_t(regions.size()), regions.data());
 		cmd_buf.end();
 		auto queue = device.transferQueue();
 		auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmd_buf);
 		queue.submit({submit_info}, nullptr);
 		queue.waitIdle();
 	}
+
+	/// @return size (bytes) of the chunk streaming transfers are split to.
+	/// That is half the size of staging ring rounded down to the multiple of granularity.
+	/// Transfers not bigger than that may go through the staging ring in a single piece.
+	auto streamChunkSize(const StagingRing& ring ///< staging ring of the transfer direction (device upload or readback ring)
+	                     , std::size_t granularity ///< chunk size should be multiple of this (normally the array element size)
+	                     )-> std::size_t
+	{
+		const auto half_ring = ring.size()/2;
+		return std::max(granularity, half_ring/granularity*granularity);
+	}
+
+	/// Copy data from host to the device buffer in chunks through the upload staging ring.
+	/// Filling the next chunk on the host overlaps with the device side copy of the previous one.
+	/// Staging memory in use is bounded by the two chunks. Blocks till transfer is complete.
+	auto streamToDevice(vuh::Device& device   ///< device where the buffer is allocated
+	                    , vk::Buffer dst      ///< destination buffer
+	                    , std::size_t dst_offset ///< destination buffer offset (bytes)
+	                    , std::size_t size_bytes ///< size of data to transfer (bytes)
+	                    , std::size_t granularity ///< chunk boundaries are multiple of this (normally the array element size)
+	                    , const stream_fill_t& fill ///< copies the host data to staging memory
+	                    )-> void
+	{
+		const auto chunk_size = std::min(streamChunkSize(device.uploadRing(), granularity), size_bytes);
+		Stream stream(device, device.uploadRing(), chunk_size);
+		for(std::size_t offset = 0, i = 0; offset < size_bytes; offset += chunk_size, ++i){
+			auto& slot = stream.slot(i);
+			stream.wait(slot);
+			const auto size = std::min(chunk_size, size_bytes - offset);
+			fill(slot.stage.data(), offset, size);
+			slot.stage.flush();
+			stream.submit(slot, slot.stage.buffer(), slot.stage.offset(), dst, dst_offset + offset, size);
+		}
+	}
+
+	/// Copy data from the device buffer to host in chunks through the readback staging ring.
+	/// Consuming the chunk on the host overlaps with the device side copy of the next one.
+	/// Staging memory in use is bounded by the two chunks. Blocks till transfer is complete.
+	auto streamToHost(vuh::Device& device   ///< device where the buffer is allocated
+	                  , vk::Buffer src      ///< source buffer
+	                  , std::size_t src_offset ///< source buffer offset (bytes)
+	                  , std::size_t size_bytes ///< size of data to transfer (bytes)
+	                  , std::size_t granularity ///< chunk boundaries are multiple of this (normally the array element size)
+	                  , const stream_drain_t& drain ///< copies data from staging memory to host
+	                  )-> void
+	{
+		const auto chunk_size = std::min(streamChunkSize(device.readbackRing(), granularity), size_bytes);
+		Stream stream(device, device.readbackRing(), chunk_size);
+		auto consume = [&](Stream::Slot& slot){
+			stream.wait(slot);
+			if(slot.pending){
+				slot.stage.invalidate();
+				drain(slot.stage.data(), slot.offset, slot.size);
+				slot.pending = false;
+			}
+		};
+		auto i = std::size_t(0);
+		for(std::size_t offset = 0; offset < size_bytes; offset += chunk_size, ++i){
+			auto& slot = stream.slot(i);
+			consume(slot);
+			slot.offset = offset;
+			slot.size = std::min(chunk_size, size_bytes - offset);
+			stream.submit(slot, src, src_offset + offset, slot.stage.buffer(), slot.stage.offset()
+			              , slot.size);
+			slot.pending = true;
+		}
+		consume(stream.slot(i));     // older of the two in-flight chunks
+		consume(stream.slot(i + 1));
+	}
+
+	/// Copy the mapped file range to the device buffer through the upload staging ring.
+	/// File pages are copied straight to the staging memory, in chunks as streamToDevice() does.
+	/// Pages of the next chunk are requested ahead of time, so that reading the file overlaps
+	/// with copying of the current chunk, and pages of the copied chunks are dropped.
+	/// Blocks till transfer is complete.
+	auto fileToDevice(vuh::Device& device        ///< device where the buffer is allocated
+	                  , const vuh::MappedFile& src ///< source file range
+	                  , vk::Buffer dst           ///< destination buffer
+	                  , std::size_t dst_offset   ///< destination buffer offset (bytes)
+	                  , std::size_t granularity  ///< chunk boundaries are multiple of this (normally the array element size)
+	                  )-> void
+	{
+		if(src.size() == 0){
+			return;
+		}
+		const auto chunk_size = std::min(streamChunkSize(device.uploadRing(), granularity), src.size());
+		const auto data = static_cast<const char*>(src.data());
+		const auto props = device.uploadRing().memoryProperties(device);
+		src.prefetch(0, chunk_size);
+		streamToDevice(device, dst, dst_offset, src.size(), granularity
+		               , [&](void* stage, std::size_t offset, std::size_t size){
+		                    src.prefetch(offset + size, chunk_size); // read-ahead the next chunk
+		                    memcpyToMapped(stage, data + offset, size, props);
+		                    src.discard(offset, size);
+		                 });
+	}
+
+	/// Copy data from the device buffer to the writable mapped file range through the readback
+	/// staging ring. Staging memory is copied straight to the file pages, in chunks as
+	/// streamToHost() does. Blocks till transfer is complete, writing the pages back to the file
+	/// is left to the OS (see MappedFile::sync()).
+	auto deviceToFile(vuh::Device& device        ///< device where the buffer is allocated
+	                  , vk::Buffer src           ///< source buffer
+	                  , std::size_t src_offset   ///< source buffer offset (bytes)
+	                  , const vuh::MappedFile& dst ///< destination file range
+	                  , std::size_t size_bytes   ///< size of data to transfer (bytes)
+	                  , std::size_t granularity  ///< chunk boundaries are multiple of this (normally the array element size)
+	                  )-> void
+	{
+		assert(dst.mode() == vuh::MappedFile::Mode::Write);
+		assert(size_bytes <= dst.size());
+		if(size_bytes == 0){
+			return;
+		}
+		const auto data = static_cast<char*>(dst.data());
+		const auto props = device.readbackRing().memoryProperties(device);
+		streamToHost(device, src, src_offset, size_bytes, granularity
+		             , [&](const void* stage, std::size_t offset, std::size_t size){
+		                  memcpyFromMapped(data + offset, stage, size, props);
+		               });
+	}
 } // namespace arr
 } // namespace vuh
@@ -0,0 +1,72 @@
+#include <vuh/workerPool.h>
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+namespace vuh {
+	/// Constructor. Starts given number of worker threads (at least one).
+	WorkerPool::WorkerPool(std::size_t n_threads) {
+		n_threads = std::max(n_threads, std::size_t(1));
+		_threads.reserve(n_threads);
+		try {
+			for(std::size_t i = 0; i < n_threads; ++i){
+				_threads.emplace_back([this]{ run(); });
+			}
+		} catch(std::system_error&) { // could not start all threads, make do with the ones that did start
+			if(_threads.empty()){
+				throw;
+			}
+		}
+	}
+
+	/// Destructor. Completes the remaining jobs and joins the worker threads.
+	WorkerPool::~WorkerPool() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_all();
+		for(auto& t: _threads){
+			t.join();
+		}
+	}
+
+	/// Queue the job to be run on one of the worker threads.
+	/// @return future of the job completion, carrying the exception thrown by the job if any.
+	auto WorkerPool::submit(std::function<void()> job)-> std::future<void> {
+		auto task = std::packaged_task<void()>(std::move(job));
+		auto r = task.get_future();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push_back(std::move(task));
+		}
+		_cv.notify_one();
+		return r;
+	}
+
+	/// @return default number of worker threads.
+	/// Host-side transfer stages are memory bound, so a couple of threads are enough to
+	/// saturate the memory bandwidth.
+	auto WorkerPool::defaultThreads()-> std::size_t {
+		return std::max(std::size_t(1), std::min(std::size_t(2)
+		                                         , std::size_t(std::thread::hardware_concurrency())));
+	}
+
+	/// Worker thread loop. Runs jobs till the pool is stopped and no jobs are left.
+	auto WorkerPool::run() noexcept-> void {
+		for(;;){
+			auto task = std::packaged_task<void()>{};
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cv.wait(lock, [this]{ return _stop || !_jobs.empty(); });
+				if(_jobs.empty()){
+					return;
+				}
+				task = std::move(_jobs.front());
+				_jobs.pop_front();
+			}
+			task(); // exceptions are stored in the future
+		}
+	}
+} // namespace vuh
@@ -4,11 +4,25 @@
 #include <vuh/array.hpp>
 #include <vuh/arr/copy_async.hpp>
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 using std::begin;
 using std::end;
 
+namespace {
+	/// Host output iterator failing on the first write.
+	struct FailingIter {
+		struct Proxy {
+			auto operator=(float)-> Proxy& { throw std::runtime_error("host write failed"); }
+		};
+		auto operator*() const-> Proxy { return {}; }
+		auto operator++()-> FailingIter& { return *this; }
+	};
+} // namespace
+
 TEST_CASE("async copy device-local memory", "[array][correctness][async]"){
 	constexpr auto arr_size = size_t(128);
 	auto host_data = [](){
@@ -50,6 +64,32 @@ TEST_CASE("async copy device-local memory", "[array][correctness][async]"){
 			}
 			REQUIRE(array_dst.toHost<std::vector<float>>() == host_data);
 		}
+		SECTION("to host-cached memory, device writes invalidated"){
+			auto array_dst = vuh::Array<float, vuh::mem::HostCached>(device, arr_size, 0.f);
+			vuh::copy_async(device_begin(array_src), device_end(array_src), device_begin(array_dst)).wait();
+			REQUIRE(std::vector<float>(begin(array_dst), end(array_dst)) == host_data);
+		}
+		SECTION("disjoint ranges to several arrays in a single batch"){
+			constexpr auto chunk_size = size_t(4);
+			auto array_dst1 = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			auto array_dst2 = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			auto batch = vuh::CopyBatch(device);
+			for(size_t i = 0; i < arr_size; i += chunk_size){ // chunks in reversed order
+				batch.add(device_begin(array_src) + i, device_begin(array_src) + i + chunk_size
+				          , device_begin(array_dst1) + (arr_size - chunk_size - i));
+				batch.add(device_begin(array_src) + i, device_begin(array_src) + i + chunk_size
+				          , device_begin(array_dst2) + i);
+			}
+			REQUIRE(batch.size() == 2*arr_size/chunk_size);
+			vuh::copy_async(std::move(batch)).wait();
+
+			auto expected = std::vector<float>{};
+			for(size_t i = arr_size; i != 0; i -= chunk_size){
+				expected.insert(end(expected), begin(host_data) + (i - chunk_size), begin(host_data) + i);
+			}
+			REQUIRE(array_dst1.toHost<std::vector<float>>() == expected);
+			REQUIRE(array_dst2.toHost<std::vector<float>>() == host_data);
+		}
 	}
 	SECTION("device-local memory to/from host"){
 		SECTION("async copy from host. explicit wait()"){
@@ -103,5 +143,209 @@ TEST_CASE("async copy device-local memory", "[array][correctness][async]"){
 			}
 			REQUIRE(host_data_tst == host_data);
 		}
+		SECTION("staging ring overflow. 2 halves, scoped"){
+			device.setStagingRingSize(arr_size/2*sizeof(float)); // only one half fits the ring
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			auto host_data_tst = std::vector<float>(arr_size, 0.f);
+			{
+				auto f1 = vuh::copy_async(begin(host_data), begin(host_data) + arr_size/2
+				                          , device_begin(array));
+				auto f2 = vuh::copy_async(begin(host_data) + arr_size/2, end(host_data)
+				                          , device_begin(array) + arr_size/2);
+			}
+			{
+				auto f1 = vuh::copy_async(device_begin(array), device_begin(array) + arr_size/2
+				                          , begin(host_data_tst));
+				auto f2 = vuh::copy_async(device_begin(array) + arr_size/2, device_end(array)
+				                          , begin(host_data_tst) + arr_size/2);
+			}
+			REQUIRE(host_data_tst == host_data);
+			REQUIRE(device.uploadRing().numChunks() == 0);
+			REQUIRE(device.readbackRing().numChunks() == 0);
+		}
+		SECTION("staging ring is not resized while its chunks are in use"){
+			const auto new_size = arr_size/2*sizeof(float);
+			{
+				auto chunk = device.uploadRing().acquire(device, arr_size*sizeof(float));
+				REQUIRE_THROWS_AS(device.setStagingRingSize(new_size), std::logic_error);
+			}
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			{
+				auto fence = vuh::copy_async(begin(host_data), end(host_data), device_begin(array));
+				if(array.isHostVisible()){
+					WARN("device-local memory is host-visible, copy does not use the staging ring");
+				} else {
+					REQUIRE(device.uploadRing().numChunks() == 1);
+					REQUIRE_THROWS_AS(device.setStagingRingSize(new_size), std::logic_error);
+				}
+			}
+			REQUIRE(device.uploadRing().numChunks() == 0);
+			REQUIRE_NOTHROW(device.setStagingRingSize(new_size));
+			REQUIRE(device.uploadRing().size() <= new_size);
+			REQUIRE(array.toHost<std::vector<float>>() == host_data);
+		}
+		SECTION("host stages on the worker pool. 2 halves, scoped"){
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			auto host_data_tst = std::vector<float>(arr_size, 0.f);
+			{
+				auto f1 = vuh::copy_async(begin(host_data), begin(host_data) + arr_size/2
+				                          , device_begin(array), vuh::host_async);
+				auto f2 = vuh::copy_async(begin(host_data) + arr_size/2, end(host_data)
+				                          , device_begin(array) + arr_size/2, vuh::host_async);
+			}
+			{
+				auto f1 = vuh::copy_async(device_begin(array), device_begin(array) + arr_size/2
+				                          , begin(host_data_tst), vuh::host_async);
+				auto f2 = vuh::copy_async(device_begin(array) + arr_size/2, device_end(array)
+				                          , begin(host_data_tst) + arr_size/2, vuh::host_async);
+				f2.wait();
+				f1.wait();
+			}
+			REQUIRE(host_data_tst == host_data);
+			REQUIRE(device.uploadRing().numChunks() == 0);
+			REQUIRE(device.readbackRing().numChunks() == 0);
+		}
+		SECTION("host stages on the worker pool. transfers bigger than the ring"){
+			device.setStagingRingSize(arr_size/4*sizeof(float)); // would be streamed without the tag
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			auto host_data_tst = std::vector<float>(arr_size, 0.f);
+			vuh::copy_async(begin(host_data), end(host_data), device_begin(array), vuh::host_async).get();
+			vuh::copy_async(device_begin(array), device_end(array), begin(host_data_tst)
+			                , vuh::host_async).get();
+			REQUIRE(host_data_tst == host_data);
+			REQUIRE(device.uploadRing().numChunks() == 0);
+			REQUIRE(device.readbackRing().numChunks() == 0);
+		}
+		SECTION("host stage errors are reported by get()"){
+			auto array = vuh::Array<float, vuh::mem::Device>(device, host_data);
+			auto host_data_tst = std::vector<float>(arr_size, 0.f);
+			auto ok = vuh::copy_async(device_begin(array), device_end(array), begin(host_data_tst)
+			                          , vuh::host_async);
+			REQUIRE_NOTHROW(ok.get());
+			REQUIRE(host_data_tst == host_data);
+			auto failed = vuh::copy_async(device_begin(array), device_end(array), FailingIter{}
+			                              , vuh::host_async);
+			REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+			auto failed_quietly = vuh::copy_async(device_begin(array), device_end(array), FailingIter{}
+			                                      , vuh::host_async);
+			REQUIRE_NOTHROW(failed_quietly.wait()); // wait() never throws
+		}
+		SECTION("gather from and scatter to many host pieces with single transfers"){
+			auto array = vuh::Array<float, vuh::mem::Device>(device, std::vector<float>(arr_size, 0.f));
+			auto pieces = std::vector<std::vector<float>>{std::vector<float>(8, 1.f)
+			                                              , std::vector<float>(16, 2.f)
+			                                              , std::vector<float>(4, 3.f)};
+			const auto offsets = std::vector<std::size_t>{100, 0, 50};
+			vuh::gather_async(pieces, offsets, array).wait();
+
+			auto expected = std::vector<float>(arr_size, 0.f);
+			std::fill_n(begin(expected) + 100, 8, 1.f);
+			std::fill_n(begin(expected), 16, 2.f);
+			std::fill_n(begin(expected) + 50, 4, 3.f);
+			REQUIRE(array.toHost<std::vector<float>>() == expected);
+
+			auto readback = std::vector<std::vector<float>>{std::vector<float>(4), std::vector<float>(8)};
+			vuh::scatter_async(array, {50, 100}, readback).wait();
+			REQUIRE(readback[0] == pieces[2]);
+			REQUIRE(readback[1] == pieces[0]);
+		}
+		SECTION("to/from pinned host memory without staging"){
+			using pinned_vector = std::vector<float, vuh::pinned_allocator<float>>;
+			auto src = pinned_vector(begin(host_data), end(host_data)
+			                         , vuh::pinned_allocator<float>(device));
+			auto dst = pinned_vector(arr_size, 0.f, vuh::pinned_allocator<float>(device));
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			vuh::copy_async(vuh::pinned_span(src), device_begin(array)).wait();
+			vuh::copy_async(device_begin(array), device_end(array), vuh::pinned_span(dst)).wait();
+			REQUIRE(std::vector<float>(begin(dst), end(dst)) == host_data);
+			REQUIRE(device.uploadRing().numChunks() == 0);
+		}
+		SECTION("to/from memory-mapped file"){
+			const auto path = std::string("vuh_array_async_t.bin");
+			std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(host_data.data())
+			                                            , std::streamsize(arr_size*sizeof(float)));
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			vuh::copy_async(vuh::mapped_file(path), device_begin(array)).wait();
+			REQUIRE(array.toHost<std::vector<float>>() == host_data);
+
+			vuh::copy_async(device_begin(array), device_end(array)
+			                , vuh::mapped_file(path, arr_size*sizeof(float), arr_size*sizeof(float)
+			                                   , vuh::MappedFile::Mode::Write)).wait();
+			auto file = vuh::mapped_file(path, arr_size*sizeof(float));
+			const auto data = static_cast<const float*>(file.data());
+			REQUIRE(std::vector<float>(data, data + arr_size) == host_data);
+			file = vuh::mapped_file(path, 0, 0);
+			std::remove(path.c_str());
+		}
+		SECTION("packed sub-arrays uploaded with a single transfer"){
+			auto layout = vuh::PackedLayout(device);
+			const auto slot_floats = layout.add<float>(arr_size);
+			const auto slot_ints = layout.add<int>(3);
+			REQUIRE(slot_ints.offset_bytes % layout.alignment() == 0);
+			REQUIRE(slot_ints.offset_bytes >= arr_size*sizeof(float));
+
+			auto packed = vuh::PackedArray<vuh::mem::Device>(device, layout);
+			auto floats = packed.view(slot_floats);
+			auto ints = packed.view(slot_ints);
+			const auto host_ints = std::vector<int>{1, 2, 3};
+			auto stage = vuh::packed_stage(packed);
+			stage.write(floats, begin(host_data), end(host_data));
+			stage.write(ints, begin(host_ints), end(host_ints));
+			vuh::copy_async(std::move(stage)).wait();
+
+			auto out_floats = std::vector<float>(arr_size);
+			auto out_ints = std::vector<int>(3);
+			vuh::copy_async(floats, begin(out_floats)).wait();
+			vuh::copy_async(ints, begin(out_ints)).wait();
+			REQUIRE(out_floats == host_data);
+			REQUIRE(out_ints == host_ints);
+
+			const auto new_ints = std::vector<int>{4, 5, 6};
+			vuh::copy_async(begin(new_ints), end(new_ints), ints).wait();
+			vuh::copy_async(ints, begin(out_ints)).wait();
+			REQUIRE(out_ints == new_ints);
+		}
+		SECTION("out-of-core array stages tile loads in one piece"){
+			device.setStagingRingSize(arr_size/4*sizeof(float)); // tiles would be streamed
+			auto store = host_data;
+			auto data = vuh::TiledArray<float>(device, vuh::HostSpan<float>(store.data(), store.size())
+			                                   , arr_size/2, 2);
+			data.prefetch(1);
+			if(data.array().isHostVisible()){
+				WARN("device-local memory is host-visible, tiles are not staged");
+			} else {
+				REQUIRE(device.stagingRingSize() >= 2*data.tileSize()*sizeof(float));
+				REQUIRE(device.uploadRing().numChunks() == 1); // held by the pending load
+			}
+			auto tile = data.tile(1, decltype(data)::Access::Read);
+			REQUIRE(device.uploadRing().numChunks() == 0);
+			auto tile_data = std::vector<float>(tile.size());
+			tile.array().rangeToHost(tile.offset(), tile.offset() + tile.size(), tile_data.begin());
+			REQUIRE(tile_data == std::vector<float>(arr_size/2, 6.28f)); // second half of the store
+		}
+		SECTION("out-of-core array paging tiles between host and device"){
+			auto store = host_data;
+			auto data = vuh::TiledArray<float>(device, vuh::HostSpan<float>(store.data(), store.size())
+			                                   , arr_size/4 + 1, 2);
+			REQUIRE(data.numTiles() == 4);
+			REQUIRE(data.tileSize(3) == arr_size - 3*(arr_size/4 + 1));
+			for(size_t i = 0; i < data.numTiles(); ++i){
+				auto tile = data.tile(i);
+				data.prefetch(i + 1);
+				REQUIRE(data.isResident(i + 1) == (i + 1 < data.numTiles()));
+
+				const auto begin = i*data.tileSize();
+				auto tile_data = std::vector<float>(tile.size());
+				tile.array().rangeToHost(tile.offset(), tile.offset() + tile.size(), tile_data.begin());
+				REQUIRE(tile_data == std::vector<float>(store.begin() + begin
+				                                        , store.begin() + begin + tile.size()));
+				std::fill(tile_data.begin(), tile_data.end(), float(i));
+				tile.array().fromHost(tile_data.begin(), tile_data.end(), tile.offset());
+			}
+			data.writeBack();
+			for(size_t i = 0; i < arr_size; ++i){
+				REQUIRE(store[i] == float(i/data.tileSize()));
+			}
+		}
 	}
 }
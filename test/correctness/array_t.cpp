@@ -3,7 +3,12 @@
 #include <vuh/vuh.h>
 #include <vuh/array.hpp>
 
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <numeric>
 
 using std::begin;
 using std::end;
@@ -16,6 +21,16 @@ TEST_CASE("array with memory directly allocated from device", "[array][correctne
 		for(auto& x: r){ x *= 2.f; }
 		return r;
 	}();
+	const auto host_seq = [&]{ // position-dependent values to catch misplaced chunks
+		auto r = std::vector<float>(arr_size);
+		std::iota(begin(r), end(r), 1.f);
+		return r;
+	}();
+	const auto host_seq_doubled = [&]{
+		auto r = host_seq;
+		for(auto& x: r){ x *= 2.f; }
+		return r;
+	}();
 
 	auto instance = vuh::Instance();
 	auto device = instance.devices().at(0);
@@ -71,7 +86,312 @@ TEST_CASE("array with memory directly allocated from device", "[array][correctne
 			auto array = vuh::Array<float, vuh::mem::Device>(device, host_data);
 			REQUIRE(array.toHost<std::vector<float>>() == host_data);
 		}
-		// auto d7 = vuh::Array<float, vuh::pool::Device>(pool, arr_size);
+		SECTION("repeated partial transfers"){
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size, [](size_t){ return 0.f; });
+			for(size_t i = 0; i < arr_size; i += 16){
+				array.fromHost(begin(host_seq) + i, begin(host_seq) + i + 16, i);
+				auto chunk = std::vector<float>(16, 0.f);
+				array.rangeToHost(i, i + 16, begin(chunk));
+				for(size_t j = 0; j < chunk.size(); ++j){
+					REQUIRE(chunk[j] == host_seq[i + j]);
+				}
+			}
+			const auto host_dst = array.toHost<std::vector<float>>();
+			for(size_t i = 0; i < arr_size; ++i){
+				REQUIRE(host_dst[i] == host_seq[i]);
+			}
+		}
+		SECTION("transfers streamed in chunks"){
+			device.setStagingRingSize(16*sizeof(float)); // 8 elements per chunk
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size
+			                                                 , [&](size_t i){return host_seq[i];});
+			auto host_dst = array.toHost<std::vector<float>>();
+			for(size_t i = 0; i < arr_size; ++i){
+				REQUIRE(host_dst[i] == host_seq[i]);
+			}
+			array.fromHost(begin(host_seq_doubled), end(host_seq_doubled));
+			array.toHost(begin(host_dst), [](auto x){ return 0.5f*x;});
+			for(size_t i = 0; i < arr_size; ++i){
+				REQUIRE(host_dst[i] == host_seq[i]);
+			}
+			auto chunk = std::vector<float>(arr_size - 11, 0.f);
+			array.rangeToHost(3, arr_size - 8, begin(chunk));
+			for(size_t i = 0; i < chunk.size(); ++i){
+				REQUIRE(chunk[i] == host_seq_doubled[i + 3]);
+			}
+			array.fromHost(begin(host_seq) + 5, end(host_seq) - 7, 5); // streamed to offset
+			host_dst = array.toHost<std::vector<float>>();
+			for(size_t i = 0; i < arr_size; ++i){
+				REQUIRE(host_dst[i] == (i >= 5 && i < arr_size - 7 ? host_seq[i] : host_seq_doubled[i]));
+			}
+		}
+		SECTION("host span over host-visible memory"){
+			auto array = vuh::Array<float, vuh::mem::Device>(device, host_data);
+			if(array.isHostVisible()){
+				auto span = array.hostSpan();
+				REQUIRE(std::vector<float>(begin(span), end(span)) == host_data);
+				for(auto& x: span){ x *= 2.f; }
+				array.flush();
+				REQUIRE(array.toHost<std::vector<float>>() == host_data_doubled);
+			}
+		}
+		SECTION("contiguous and non-contiguous host containers transfer same data"){
+			REQUIRE(vuh::traits::is_contiguous_iterable<std::array<float, 4>>::value);
+			REQUIRE_FALSE(vuh::traits::is_contiguous_iterable<std::deque<float>>::value);
+			REQUIRE(vuh::traits::is_contiguous_iterator<std::vector<float>::const_iterator>::value);
+			REQUIRE(vuh::traits::is_contiguous_iterator<
+			        std::vector<float, vuh::pinned_allocator<float>>::iterator>::value);
+			REQUIRE_FALSE(vuh::traits::is_contiguous_iterator<std::vector<bool>::iterator>::value);
+
+			const auto host_deque = std::deque<float>(begin(host_data_doubled), end(host_data_doubled));
+			auto array = vuh::Array<float, vuh::mem::Device>(device, host_deque);
+			REQUIRE(array.toHost<std::vector<float>>() == host_data_doubled);
+			array.fromHost(begin(host_data), end(host_data));
+			REQUIRE(array.toHost<std::deque<float>>() == std::deque<float>(begin(host_data), end(host_data)));
+
+			auto host_dst = std::vector<float>(arr_size, 0.f);
+			array.rangeToHost(1, arr_size, begin(host_dst) + 1);
+			REQUIRE(std::equal(begin(host_data) + 1, end(host_data), begin(host_dst) + 1));
+			REQUIRE(host_dst[0] == 0.f);
+		}
+	}
+	SECTION("device memory usage is accounted per heap"){
+		const auto usage = [&]{
+			auto r = vk::DeviceSize(0);
+			for(uint32_t i = 0; i < device.memoryProperties().memoryHeapCount; ++i){
+				r += device.heapBudget(i).usage;
+			}
+			return r;
+		};
+		const auto usage_before = usage();
+		auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+		REQUIRE(usage() >= usage_before + array.size_bytes());
+	}
+	SECTION("arrays memory telemetry"){
+		auto& stats = device.memoryStats();
+		const auto before = stats.total();
+		{
+			auto array = vuh::Array<float, vuh::mem::Device>(device, arr_size);
+			const auto usage = stats.total();
+			REQUIRE(usage.count == before.count + 1);
+			REQUIRE(usage.bytes == before.bytes + array.size_bytes());
+			REQUIRE(usage.peak_bytes >= usage.bytes);
+		}
+		REQUIRE(stats.total().bytes == before.bytes);
+		REQUIRE(stats.total().total == before.total + 1);
+		REQUIRE(stats.toJson().find("\"latency_us\"") != std::string::npos);
+	}
+	SECTION("huge arrays get dedicated allocations"){
+		const auto threshold = device.dedicatedThreshold();
+		device.setDedicatedThreshold(arr_size*sizeof(float));
+		{
+			auto array = vuh::Array<float, vuh::mem::Device>(device, host_data);
+			REQUIRE(array.isDedicated());
+			REQUIRE(array.toHost<std::vector<float>>() == host_data);
+			auto array_pool = vuh::Array<float, vuh::pool::Device>(device, host_data_doubled);
+			REQUIRE(array_pool.isDedicated());
+			REQUIRE(array_pool.offset() == 0);
+			REQUIRE(array_pool.toHost<std::vector<float>>() == host_data_doubled);
+		}
+		REQUIRE(device.memoryPool().numBlocks() == 0);
+		device.setDedicatedThreshold(threshold);
+	}
+	SECTION("device-local memory sub-allocated from pool"){
+		SECTION("size constructor"){
+			auto array = vuh::Array<float, vuh::pool::Device>(device, arr_size);
+			REQUIRE(array.size() == arr_size);
+			REQUIRE(array.size_bytes() == arr_size*sizeof(float));
+		}
+		SECTION("arrays share memory block"){
+			auto array_1 = vuh::Array<float, vuh::pool::Device>(device, host_data);
+			auto array_2 = vuh::Array<float, vuh::pool::Device>(device, host_data_doubled);
+			REQUIRE(array_2.offset() >= array_1.offset() + array_1.size_bytes());
+			REQUIRE(device.memoryPool().numBlocks() == 1);
+			REQUIRE(array_1.toHost<std::vector<float>>() == host_data);
+			REQUIRE(array_2.toHost<std::vector<float>>() == host_data_doubled);
+		}
+		SECTION("released memory is reused"){
+			const auto offset = vuh::Array<float, vuh::pool::Device>(device, arr_size).offset();
+			auto array = vuh::Array<float, vuh::pool::Device>(device, host_data);
+			REQUIRE(array.offset() == offset);
+			REQUIRE(array.toHost<std::vector<float>>() == host_data);
+		}
+		SECTION("defragmentation moves arrays to free space"){
+			auto array_1 = vuh::Array<float, vuh::pool::Device>(device, arr_size);
+			auto array_2 = vuh::Array<float, vuh::pool::Device>(device, host_data);
+			const auto offset = array_1.offset();
+			{ auto released = std::move(array_1); }
+			REQUIRE(device.memoryPool().defragment(device, 0) == 0);
+			const auto moved = device.memoryPool().defragment(device, std::size_t(-1));
+			if(!array_2.isHostVisible()){ // mapped blocks are not defragmented
+				REQUIRE(moved >= array_2.size_bytes());
+				REQUIRE(array_2.offset() <= offset);
+			}
+			REQUIRE(array_2.toHost<std::vector<float>>() == host_data);
+		}
+		SECTION("defragmentation compacts sparse blocks and releases drained ones"){
+			// pool with blocks of 4 chunks driven directly, its memory is never mapped
+			const auto usage = vk::BufferUsageFlagBits::eStorageBuffer
+			                   | vk::BufferUsageFlagBits::eTransferSrc
+			                   | vk::BufferUsageFlagBits::eTransferDst;
+			const auto size_bytes = arr_size*sizeof(float);
+			struct Chunk {
+				vk::Buffer buffer;
+				vk::DeviceMemory memory;
+				vuh::arr::MemoryPool::Allocation allocation;
+				uint64_t last_use = 0;
+			};
+			auto chunks = std::array<Chunk, 12>{};
+			for(auto& c: chunks){
+				c.buffer = device.createBuffer({{}, size_bytes, usage});
+			}
+			const auto reqs = device.getBufferMemoryRequirements(chunks[0].buffer);
+			const auto memid = device.selectMemory(chunks[0].buffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+			REQUIRE(memid != uint32_t(-1));
+			const auto atom = std::size_t(device.mapAlignment(memid));
+			const auto alignment = std::max(std::size_t(reqs.alignment), atom);
+			const auto chunk_size = (std::size_t(reqs.size) + atom - 1)/atom*atom;
+			const auto unit = (chunk_size + alignment - 1)/alignment*alignment;
+			vuh::arr::MemoryPool pool(4*unit);
+
+			const auto upload = [&](const Chunk& c, float value){
+				auto stage = device.uploadRing().acquire(device, size_bytes);
+				std::fill_n(static_cast<float*>(stage.data()), arr_size, value);
+				stage.flush();
+				vuh::arr::copyBuf(device, stage.buffer(), c.buffer, size_bytes, stage.offset(), 0);
+			};
+			const auto download = [&](const Chunk& c){
+				auto stage = device.readbackRing().acquire(device, size_bytes);
+				vuh::arr::copyBuf(device, c.buffer, stage.buffer(), size_bytes, 0, stage.offset());
+				stage.invalidate();
+				const auto data = static_cast<const float*>(stage.data());
+				return std::vector<float>(data, data + arr_size);
+			};
+			const auto release = [&](Chunk& c){
+				pool.free(device, c.allocation);
+				device.destroyBuffer(c.buffer);
+				c.buffer = nullptr;
+			};
+			for(size_t i = 0; i < chunks.size(); ++i){
+				auto& c = chunks[i];
+				c.allocation = pool.allocate(device, memid, reqs);
+				c.memory = c.allocation.memory;
+				device.bindBufferMemory(c.buffer, c.memory, c.allocation.offset);
+				pool.track(c.allocation, {&c.buffer, &c.memory, &c.allocation, &c.last_use}
+				           , size_bytes, usage);
+				upload(c, float(i));
+			}
+			REQUIRE(pool.numBlocks() == 3);
+			for(auto i: {1, 2, 3, 5, 6, 7, 10, 11}){ // blocks are left with 1, 1 and 2 chunks
+				release(chunks[i]);
+			}
+			REQUIRE(pool.numBlocks() == 3);
+
+			// chunks of both sparse blocks move to the denser one, one drained block is kept spare
+			REQUIRE(pool.defragment(device, std::size_t(-1)) == 2*chunk_size);
+			REQUIRE(pool.numBlocks() == 2);
+			for(auto i: {0, 4, 8, 9}){
+				REQUIRE(chunks[i].memory == chunks[8].allocation.memory);
+				REQUIRE(chunks[i].allocation.memory == chunks[8].allocation.memory);
+				REQUIRE(download(chunks[i]) == std::vector<float>(arr_size, float(i)));
+			}
+			for(auto i: {0, 4, 8, 9}){
+				release(chunks[i]);
+			}
+			REQUIRE(pool.numBlocks() == 1);
+			pool.release(device);
+		}
+	}
+	SECTION("residency manager evicts least recently used arrays to host memory"){
+		auto& residency = device.enableResidency();
+		auto array_1 = vuh::Array<float, vuh::mem::Device>(device, host_data);
+		auto array_2 = vuh::Array<float, vuh::mem::Device>(device, host_data_doubled);
+		if(residency.numTracked() != 2){
+			WARN("device-local memory is host-visible, residency is not managed");
+		} else {
+			const auto& props = device.memoryProperties();
+			auto heap_id = uint32_t(0);
+			for(uint32_t i = 0; i < props.memoryTypeCount; ++i){
+				const auto flags = props.memoryTypes[i].propertyFlags;
+				if((flags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+				   && !(flags & vk::MemoryPropertyFlagBits::eHostVisible))
+				{
+					heap_id = props.memoryTypes[i].heapIndex;
+					break;
+				}
+			}
+			array_2.touch(); // array_1 is now the least recently used
+			// room for less than one more array, so that the next allocation has to evict one
+			device.limitHeap(heap_id, array_1.size_bytes() - 1);
+			auto array_3 = vuh::Array<float, vuh::mem::Device>(device, host_seq);
+			REQUIRE(residency.numTracked() == 3);
+			REQUIRE(residency.numEvicted() == 1);
+			REQUIRE(array_1.isHostVisible()); // memory properties follow the eviction
+			REQUIRE_FALSE(array_2.isHostVisible());
+			REQUIRE_FALSE(array_3.isHostVisible()); // new array got the device memory
+			REQUIRE(array_1.toHost<std::vector<float>>() == host_data); // read from mapped host memory
+			REQUIRE(array_3.toHost<std::vector<float>>() == host_seq);
+
+			array_1.touch(); // restored on use, array_2 is the least recently used now
+			REQUIRE(residency.numEvicted() == 1);
+			REQUIRE_FALSE(array_1.isHostVisible());
+			REQUIRE(array_2.isHostVisible());
+			REQUIRE(array_1.toHost<std::vector<float>>() == host_data);
+			REQUIRE(array_2.toHost<std::vector<float>>() == host_data_doubled);
+
+			array_2.fromHost(begin(host_seq_doubled), end(host_seq_doubled)); // written while evicted
+			device.limitHeap(heap_id, VK_WHOLE_SIZE);
+			array_2.touch();
+			REQUIRE(residency.numEvicted() == 0);
+			REQUIRE(array_2.toHost<std::vector<float>>() == host_seq_doubled);
+		}
+	}
+	SECTION("auto memory placement depends on the device kind"){
+		auto array = vuh::Array<float, vuh::mem::Auto>(device, host_data);
+		if(device.hasUnifiedMemory()){
+			REQUIRE(array.isHostVisible());
+		} else if(array.isHostVisible()){ // fall-back on device-local memory exhaustion
+			REQUIRE(device.memoryStats().fallbacks() != 0);
+		}
+		REQUIRE(array.toHost<std::vector<float>>() == host_data);
+		array.fromHost(begin(host_data_doubled), end(host_data_doubled));
+		REQUIRE(array.toHost<std::vector<float>>() == host_data_doubled);
+	}
+	SECTION("device-local memory taken from arena"){
+		vuh::arr::Arena<vuh::arr::properties::Device> arena(device, 4*arr_size*sizeof(float));
+		SECTION("size constructor"){
+			auto array = vuh::Array<float, vuh::arena::Device>(arena, arr_size);
+			REQUIRE(array.size() == arr_size);
+			REQUIRE(array.size_bytes() == arr_size*sizeof(float));
+			REQUIRE(arena.used() >= array.size_bytes());
+		}
+		SECTION("arrays take consecutive chunks and reset makes memory available again"){
+			{
+				auto array_1 = vuh::Array<float, vuh::arena::Device>(arena, arr_size);
+				auto array_2 = vuh::Array<float, vuh::arena::Device>(arena, arr_size);
+				array_1.fromHost(begin(host_data), end(host_data));
+				array_2.fromHost(begin(host_data_doubled), end(host_data_doubled));
+				REQUIRE(array_2.offset() >= array_1.offset() + array_1.size_bytes());
+				REQUIRE(array_1.toHost<std::vector<float>>() == host_data);
+				REQUIRE(array_2.toHost<std::vector<float>>() == host_data_doubled);
+			}
+			arena.reset();
+			REQUIRE(arena.used() == 0);
+			auto array = vuh::Array<float, vuh::arena::Device>(arena, arr_size);
+			REQUIRE(array.offset() == 0);
+		}
+		SECTION("exhausted arena throws"){
+			auto array = vuh::Array<float, vuh::arena::Device>(arena, 3*arr_size);
+			REQUIRE_THROWS_AS((vuh::Array<float, vuh::arena::Device>(arena, 2*arr_size))
+			                  , vk::OutOfDeviceMemoryError);
+		}
+	}
+	SECTION("host memory sub-allocated from pool"){
+		auto array_1 = vuh::Array<float, vuh::pool::Host>(device, arr_size, 3.14f);
+		auto array_2 = vuh::Array<float, vuh::pool::Host>(device, begin(host_data_doubled)
+		                                                  , end(host_data_doubled));
+		REQUIRE(std::vector<float>(begin(array_1), end(array_1)) == host_data);
+		REQUIRE(std::vector<float>(begin(array_2), end(array_2)) == host_data_doubled);
 	}
 	SECTION("device-local host-visible (unified) memory"){
 		try{
@@ -139,6 +459,73 @@ TEST_CASE("array with memory directly allocated from device", "[array][correctne
 			}
 			REQUIRE(std::vector<float>(begin(array), end(array)) == host_data_doubled);
 		}
+		SECTION("bulk transfers with streaming copies split between threads"){
+			const auto big_size = 2*vuh::arr::min_parallel_copy/sizeof(float) + 17; // odd size, parallel copy
+			auto big_data = std::vector<float>(big_size);
+			std::iota(begin(big_data), end(big_data), 0.f);
+			auto array = vuh::Array<float, vuh::mem::Host>(device, big_size);
+			array.fromHost(big_data.data() + 1, big_data.data() + big_size, 1); // misaligned both ways
+			array.fromHost(big_data.data(), big_data.data() + 1);
+			auto big_data_tst = std::vector<float>(big_size, 0.f);
+			array.toHost(big_data_tst.data());
+			REQUIRE(big_data_tst == big_data);
+
+			auto array_dst = vuh::Array<float, vuh::mem::Device>(device, big_data);
+			std::fill(begin(big_data_tst), end(big_data_tst), 0.f);
+			array_dst.rangeToHost(3, big_size, big_data_tst.data() + 3);
+			REQUIRE(std::equal(begin(big_data) + 3, end(big_data), begin(big_data_tst) + 3));
+		}
+	}
+	SECTION("host memory imported from existing allocation"){
+		constexpr auto chunk = std::size_t(1) << 16; // multiple of the import alignment on any practical device
+		auto storage = std::vector<float>(2*chunk/sizeof(float));
+		auto ptr = static_cast<void*>(storage.data());
+		auto space = storage.size()*sizeof(float);
+		auto data = static_cast<float*>(std::align(chunk, chunk, ptr, space));
+		std::fill_n(data, chunk/sizeof(float), 3.14f);
+
+		auto array = vuh::Array<float, vuh::mem::HostImport>(device
+		                                        , vuh::HostSpan<float>(data, chunk/sizeof(float)));
+		REQUIRE(array.size() == chunk/sizeof(float));
+		REQUIRE(std::all_of(begin(array), end(array), [](float x){ return x == 3.14f; }));
+		array[0] = 2.71f;
+		REQUIRE((data[0] == 2.71f) == array.isImported());
+	}
+	SECTION("device memory shared with other processes through file descriptors"){
+		if(device.canExportMemory()){
+			auto array = vuh::Array<float, vuh::mem::External>(device, begin(host_data), end(host_data));
+			auto external = array.exportMemory();
+			REQUIRE(external.fd >= 0);
+			REQUIRE(external.size_bytes == arr_size*sizeof(float));
+
+			auto importer = device; // stands for the device of the consumer process
+			auto imported = vuh::Array<float, vuh::mem::External>(importer, external);
+			REQUIRE(imported.size() == arr_size);
+			REQUIRE(imported.toHost<std::vector<float>>() == host_data);
+		} else {
+			REQUIRE_THROWS_AS((vuh::Array<float, vuh::mem::External>(device, arr_size))
+			                  , vuh::NoSuitableMemoryFound);
+		}
+	}
+	SECTION("host cached memory"){
+		SECTION("pending mapped ranges are rounded and coalesced"){
+			auto ranges = vuh::arr::MappedRanges(64);
+			ranges.add(0, 4);
+			ranges.add(4, 4);
+			ranges.add(200, 8);
+			ranges.add(100, 10);
+			REQUIRE(ranges.size() == 2);
+			ranges.add(128, 64);
+			REQUIRE(ranges.size() == 1);
+			REQUIRE(ranges.ranges(nullptr, 256).at(0).offset == 256);
+			REQUIRE(ranges.ranges(nullptr, 256).at(0).size == 256);
+		}
+		SECTION("random access with operator []"){
+			auto array = vuh::Array<float, vuh::mem::HostCached>(device, arr_size, 3.14f);
+			array[arr_size/2] = 2.71f;
+			array.flush();
+			REQUIRE(array[arr_size/2] == Approx(2.71f));
+		}
 	}
 	SECTION("void memory allocator should throw"){
 		REQUIRE_THROWS(([&](){
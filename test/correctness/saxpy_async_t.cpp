@@ -99,5 +99,20 @@ TEST_CASE("data transfer and computation interleaved. sync host side.", "[correc
 
 		REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
 	}
-
+	SECTION("array and program destroyed during computation are released after it completes"){
+		using Specs = vuh::typelist<uint32_t>;
+		struct Params{uint32_t size; float a;};
+		d_y.fromHost(begin(y), end(y));
+		{
+			auto d_tmp = vuh::Array<float>(device, x);
+			auto program = vuh::Program<Specs, Params>(device, "../shaders/saxpy.spv");
+			program.grid(arr_size/grid_x).spec(grid_x).run_async({arr_size, a}, d_y, d_tmp).detach();
+		} // neither destructor blocks
+
+		auto& releases = device.releaseQueue();
+		releases.wait(device, releases.nextSerial() - 1);
+		REQUIRE(releases.numPending() == 0);
+		d_y.toHost(begin(y));
+		REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
+	}
 }
@@ -4,7 +4,11 @@
 
 #include <vuh/vuh.h>
 #include <vuh/array.hpp>
+#include <vuh/arr/copy_async.hpp>
 
+#include <algorithm>
+#include <numeric>
+#include <utility>
 #include <vector>
 #include <cstdint>
 
@@ -35,6 +39,43 @@ TEST_CASE("saxpy_once_1D", "[program][correctness]"){
 
 		REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
 	}
+	SECTION("run split to chunks fitting the descriptor range"){
+		using Specs = vuh::typelist<uint32_t>;
+		struct Params{uint32_t size; float a;};
+		auto program = vuh::Program<Specs, Params>(device, "../shaders/saxpy.spv");
+		program.grid(128/64).spec(64).run_chunked([a](size_t, size_t size){
+			return Params{uint32_t(size), a};
+		}, d_y, vuh::array_view(d_x, 0, 128));
+		d_y.toHost(begin(y));
+
+		REQUIRE(y == approx(out_ref).eps(1.e-5));
+	}
+	SECTION("run split to several chunks"){
+		using Specs = vuh::typelist<uint32_t>;
+		struct Params{uint32_t size; float a;};
+		const auto alignment = size_t(device.properties().limits.minStorageBufferOffsetAlignment);
+		const auto chunk = std::max(alignment, size_t(64)); // both powers of 2, so multiple of each
+		const auto n = 3*chunk + chunk/2 + 1;               // last chunk is shorter
+		auto y_n = std::vector<float>(n, 1.0f);
+		auto x_n = std::vector<float>(n);
+		std::iota(begin(x_n), end(x_n), 0.f);               // position-dependent values
+		auto d_y_n = vuh::Array<float>(device, y_n);
+		auto d_x_n = vuh::Array<float>(device, x_n);
+
+		auto chunks = std::vector<std::pair<size_t, size_t>>{};
+		auto program = vuh::Program<Specs, Params>(device, "../shaders/saxpy.spv");
+		program.grid(uint32_t(chunk/64)).spec(64).run_chunked([&](size_t offset, size_t size){
+			chunks.emplace_back(offset, size);
+			return Params{uint32_t(size), a*float(1 + offset/chunk)}; // scaling differs per chunk
+		}, chunk, d_y_n, d_x_n);
+		d_y_n.toHost(begin(y_n));
+
+		REQUIRE(chunks == (std::vector<std::pair<size_t, size_t>>{
+		                   {0, chunk}, {chunk, chunk}, {2*chunk, chunk}, {3*chunk, n - 3*chunk}}));
+		for(size_t i = 0; i < n; ++i){
+			REQUIRE(y_n[i] == Approx(1.0f + a*float(1 + i/chunk)*x_n[i]).epsilon(1.e-5));
+		}
+	}
 	SECTION("no specialization constants"){
 		struct Params{uint32_t size; float a;};
 		auto program = vuh::Program<vuh::typelist<>, Params>(device, "../shaders/saxpy_nospec.spv");
@@ -91,6 +132,75 @@ TEST_CASE("saxpy_repeated_1D", "[correctness]"){
 
 		REQUIRE(y == approx(out_ref).eps(1.e-5));
 	}
+	SECTION("bind once run multiple across defragmentation"){
+		using Specs = vuh::typelist<uint32_t>;
+		struct Params{uint32_t size; float a;};
+		// pooled arrays are filled and read through the host arrays, so that pool blocks
+		// are never mapped and are always subject to defragmentation
+		auto h_y = vuh::Array<float, vuh::mem::HostCoherent>(device, begin(y), end(y));
+		auto h_x = vuh::Array<float, vuh::mem::HostCoherent>(device, begin(x), end(x));
+		auto gap = vuh::Array<float, vuh::pool::Device>(device, 128);
+		auto p_y = vuh::Array<float, vuh::pool::Device>(device, 128);
+		auto p_x = vuh::Array<float, vuh::pool::Device>(device, 128);
+		vuh::copy_async(device_begin(h_y), device_end(h_y), device_begin(p_y)).wait();
+		vuh::copy_async(device_begin(h_x), device_end(h_x), device_begin(p_x)).wait();
+
+		auto program = vuh::Program<Specs, Params>(device, "../shaders/saxpy.spv");
+		program.grid(128/64).spec(64).bind({128, a}, p_y, p_x);
+		for(size_t i = 0; i < n_repeat; ++i){
+			if(i == n_repeat/2){ // bound array is moved to the gap, its old buffer is destroyed
+				{ auto released = std::move(gap); }
+				const auto buffer_x = p_x.buffer();
+				REQUIRE(device.memoryPool().defragment(device, std::size_t(-1)) >= p_x.size_bytes());
+				REQUIRE(p_x.buffer() != buffer_x);
+			}
+			program.run();
+		}
+		vuh::copy_async(device_begin(p_y), device_end(p_y), device_begin(h_y)).wait();
+
+		REQUIRE(std::vector<float>(h_y.begin(), h_y.end()) == approx(out_ref).eps(1.e-5));
+	}
+	SECTION("bind once run multiple across eviction"){
+		using Specs = vuh::typelist<uint32_t>;
+		struct Params{uint32_t size; float a;};
+		auto& residency = device.enableResidency();
+		auto r_y = vuh::Array<float>(device, y);
+		auto r_x = vuh::Array<float>(device, x);
+		if(residency.numTracked() != 2){
+			WARN("device-local memory is host-visible, residency is not managed");
+		} else {
+			const auto& props = device.memoryProperties();
+			auto heap_id = uint32_t(0);
+			for(uint32_t i = 0; i < props.memoryTypeCount; ++i){
+				const auto flags = props.memoryTypes[i].propertyFlags;
+				if((flags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+				   && !(flags & vk::MemoryPropertyFlagBits::eHostVisible))
+				{
+					heap_id = props.memoryTypes[i].heapIndex;
+					break;
+				}
+			}
+			auto program = vuh::Program<Specs, Params>(device, "../shaders/saxpy.spv");
+			program.grid(128/64).spec(64).bind({128, a}, r_y, r_x);
+			for(size_t i = 0; i < n_repeat/2; ++i){
+				program.run();
+			}
+			// the filler takes the place of the least recently bound array, which is evicted
+			// and has its buffer destroyed, and is restored by the next run
+			device.limitHeap(heap_id, r_y.size_bytes() - 1);
+			const auto buffer_y = r_y.buffer();
+			auto filler = vuh::Array<float>(device, 128);
+			REQUIRE(residency.numEvicted() == 1);
+			REQUIRE(r_y.buffer() != buffer_y);
+			for(size_t i = n_repeat/2; i < n_repeat; ++i){
+				program.run();
+			}
+			REQUIRE_FALSE(r_y.isHostVisible());
+			r_y.toHost(begin(y));
+
+			REQUIRE(y == approx(out_ref).eps(1.e-5));
+		}
+	}
 	SECTION("multiple bind and run"){
 		using Specs = vuh::typelist<uint32_t>;
 		struct Params{uint32_t size; float a;};
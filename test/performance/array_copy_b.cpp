@@ -4,6 +4,7 @@
 #include <vuh/vuh.h>
 
 #include <cstdlib>
+#include <deque>
 #include <memory>
 #include <vector>
 
@@ -71,6 +72,30 @@ namespace {
 		auto TearDown()-> void {}
 	}; // struct FixDataHostCached
 
+	/// Same data in contiguous and non-contiguous host containers
+	struct DataDeviceLocal {
+		std::vector<float> host_array;
+		std::deque<float> host_deque;
+		vuh::Array<float, vuh::mem::Device> device_array{device, 64};
+	};
+
+	///
+	struct FixDataDeviceLocal: private DataDeviceLocal {
+		using Type = DataDeviceLocal;
+
+		auto SetUp(const Params& p)-> Type& {
+			if(p.size != host_array.size()) {
+				this->host_array = std::vector<float>(p.size);
+				std::generate(begin(this->host_array), end(this->host_array), std::rand);
+				this->host_deque = std::deque<float>(begin(this->host_array), end(this->host_array));
+				this->device_array = vuh::Array<float, vuh::mem::Device>(device, p.size);
+			}
+			return *this;
+		}
+
+		auto TearDown()-> void {}
+	}; // struct FixDataDeviceLocal
+
 	/// Benchmarked function.
 	/// Copy host data to device host-visible memory
 	/// Assumed to work with FixCreateHostData fixture.
@@ -92,6 +117,38 @@ namespace {
 		std::copy(data.device_array.begin(), data.device_array.end(), begin(data.host_array));
 	}
 
+	/// Copy host data to device host-visible memory with Array::fromHost().
+	/// Contiguous source is copied in bulk (streaming stores), compare to copy_host_to_host_visible.
+	auto copy_host_to_host_visible_bulk(DataHostVisible& data, const Params& /*params*/)-> void {
+		data.device_array.fromHost(begin(data.host_array), end(data.host_array));
+	}
+
+	/// Copy host-visible memory to host with Array::toHost().
+	/// Contiguous destination is copied in bulk (streaming loads), compare to copy_host_visible_to_host.
+	auto copy_host_visible_to_host_bulk(DataHostVisible& data, const Params& /*params*/)-> void {
+		data.device_array.toHost(begin(data.host_array));
+	}
+
+	/// Upload through the staging memory from contiguous source, copied in bulk.
+	auto copy_vector_to_device(DataDeviceLocal& data, const Params& /*params*/)-> void {
+		data.device_array.fromHost(begin(data.host_array), end(data.host_array));
+	}
+
+	/// Upload through the staging memory from non-contiguous source, copied element by element.
+	auto copy_deque_to_device(DataDeviceLocal& data, const Params& /*params*/)-> void {
+		data.device_array.fromHost(begin(data.host_deque), end(data.host_deque));
+	}
+
+	/// Readback through the staging memory to contiguous destination, copied in bulk.
+	auto copy_device_to_vector(DataDeviceLocal& data, const Params& /*params*/)-> void {
+		data.device_array.toHost(begin(data.host_array));
+	}
+
+	/// Readback through the staging memory to non-contiguous destination, copied element by element.
+	auto copy_device_to_deque(DataDeviceLocal& data, const Params& /*params*/)-> void {
+		data.device_array.toHost(begin(data.host_deque));
+	}
+
 	/// Set of parameters to run benchmakrs on.
 	static const auto params = std::vector<Params>({{1024u}, {1u<<19}, {1u<<20}, {1u<<29}});
 } // namespace
@@ -100,6 +157,12 @@ SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_to_host_visible, FixDataHostVi
 SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_visible_to_host, FixDataHostVisible, params)
 SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_to_host_cached, FixDataHostCached, params)
 SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_cached_to_host, FixDataHostCached, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_to_host_visible_bulk, FixDataHostVisible, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_host_visible_to_host_bulk, FixDataHostVisible, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_vector_to_device, FixDataDeviceLocal, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_deque_to_device, FixDataDeviceLocal, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_device_to_vector, FixDataDeviceLocal, params)
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(copy_device_to_deque, FixDataDeviceLocal, params)
 
 
 SLTBENCH_MAIN()